@@ -20,12 +20,16 @@
 # Day 0 corresponds to the date "Oneday, 1 Onemonth 1", where dates are formatted "D Month Y".
 # Year 1 is directly preceded by Year -1, so there is no "Year 0".
 # ===================
+import sys
+from array import array
+
 month_names = ["Onemonth", "Twomonth", "Threemonth", "Fourmonth", "Fivemonth",
                 "Sixmonth", "Sevenmonth", "Eightmonth", "Ninemonth", "Tenmonth"]
 weekdays = ["Oneday", "Twoday", "Threeday", "Fourday", "Fiveday", "Sixday"]
 
+# Called once the module is imported.  Returns the object TimelineBuilder looks the calendar's functions up on.
 def init_calendar():
-    return
+    return sys.modules[__name__]
 
 def get_day_of_week(in_date: int) -> str:
     # Python modulo doesn't require compensating for negative numerators in this case.
@@ -42,6 +46,19 @@ def get_date_format() -> str:
 def get_timespan_format() -> str:
     return "%0 years %1 months %2 days"
 
+# Optional.  Hands TimelineBuilder everything it needs to format full dates itself, without calling format_date.
+# The date format has to produce exactly what format_date does.  On top of get_date_format's %N placeholders,
+# "%N{table}" looks component N up in a table (value "first" gets the first name), and "%{table}" names the day
+# in a table that repeats every len(names) days (day "cycle_start" gets the first name).
+def get_format_tables() -> dict:
+    return {
+        "date_format": "%{weekday}, %2 %1{month} %0",
+        "tables": {
+            "month": {"names": month_names, "first": 1},
+            "weekday": {"names": weekdays, "cycle_start": 0},
+        },
+    }
+
 def format_date(in_date: int) -> str:
     return format_broken_date_impl(in_date, break_date(in_date))
 
@@ -133,26 +150,18 @@ def combine_date(in_date: list[int]) -> int:
 
     date_len: int = len(in_date)
 
-    year_days: int = (in_date[0] - 1) * 300
+    # Year -1 directly precedes year 1, so there's no year zero to skip over going backwards.
+    year_days: int = (in_date[0] - 1) * 300 if in_date[0] > 0 else in_date[0] * 300
 
     month_days: int = 0
     if date_len >= 2:
-        if in_date[0] > 0:
-            month_days = (in_date[1] - 1) * 30
-        else:
-            month_days = (10 - in_date[1]) * 30
+        month_days = (in_date[1] - 1) * 30
 
     days: int = 0
     if date_len == get_broken_date_length():
-        if in_date[0] > 0:
-            days = in_date[2] - 1
-        else:
-            days = 30 - in_date[2]
+        days = in_date[2] - 1
 
-    if in_date[0] > 0:
-        return year_days + month_days + days
-    else:
-        return -1 * (abs(year_days) + month_days + days) - 1
+    return year_days + month_days + days
 
 def move_date(start_date: int, delta_span: list[int]) -> int:
     delta_len: int = len(delta_span)
@@ -183,4 +192,21 @@ def validate_date(in_date: list[int]) -> bool:
     valid_months: bool = date_len < 2 or (in_date[1] > 0 and in_date[1] <= 10)
     valid_years: bool = in_date[0] != 0
 
-    return valid_days and valid_months and valid_years
\ No newline at end of file
+    return valid_days and valid_months and valid_years
+
+# ===================
+# Optional batch functions.  TimelineBuilder hands these flat buffers of 64-bit ints (day numbers, or broken dates
+# laid end to end) and falls back to the scalar functions above for any that a script doesn't define.
+# ===================
+def break_dates(in_dates) -> array:
+    result: array = array("q")
+    for in_date in in_dates:
+        result.extend(break_date(in_date))
+    return result
+
+def combine_dates(in_dates) -> array:
+    date_len: int = get_broken_date_length()
+    return array("q", (combine_date(list(in_dates[i:i + date_len])) for i in range(0, len(in_dates), date_len)))
+
+def format_dates(in_dates) -> list[str]:
+    return [format_date(in_date) for in_date in in_dates]
@@ -0,0 +1,137 @@
+# ===================
+# Copyright (c) 2023 Tyler Pixley, all rights reserved.
+# 
+# This file (harptos_cal.py) is part of TimelineBuilder.
+#
+# TimelineBuilder is free software: you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation, either version 3 of the License, or (at your option) any later version.
+#
+# TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+# WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+# PARTICULAR PURPOSE. See the GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along with
+# TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+# ===================
+
+# ===================
+# Implementing a calendar in the style of the Calendar of Harptos: twelve 30-day months, with a one-day festival
+# between some of them.  Festivals are months of their own, so that a broken date is always a year, month, and day.
+# Day 0 corresponds to the date "1 Hammer 1 DR".  Years before 1 DR count down through 0 DR into negative years.
+# Shieldmeet is left out, so that every year is 365 days.
+# ===================
+import sys
+
+month_names = ["Hammer", "Midwinter", "Alturiak", "Ches", "Tarsakh", "Greengrass", "Mirtul", "Kythorn",
+                "Flamerule", "Midsummer", "Eleasis", "Eleint", "Highharvestide", "Marpenoth", "Uktar",
+                "Feast of the Moon", "Nightal"]
+month_lengths = [30, 1, 30, 30, 30, 1, 30, 30, 30, 1, 30, 30, 1, 30, 30, 1, 30]
+month_starts = [sum(month_lengths[:month]) for month in range(len(month_lengths))]
+year_length = sum(month_lengths)
+
+def init_calendar():
+    # The module itself holds the calendar's functions.
+    return sys.modules[__name__]
+
+def get_broken_date_length() -> int:
+    # Broken dates represent a day, month, and year
+    return 3
+
+def get_date_format() -> str:
+    return "%2 %1 %0 DR"
+
+def get_timespan_format() -> str:
+    return "%0 years %1 months %2 days"
+
+def format_date(in_date: int) -> str:
+    return format_broken_date(break_date(in_date))
+
+def format_broken_date(in_date: list[int]) -> str:
+    if not validate_date(in_date):
+        raise RuntimeError("Invalid date!")
+
+    date_len: int = len(in_date)
+    if date_len == 1:
+        return "{year} DR".format(year = in_date[0])
+
+    month: str = month_names[in_date[1] - 1]
+    if date_len == 2 or month_lengths[in_date[1] - 1] == 1:
+        return "{month} {year} DR".format(month = month, year = in_date[0])
+    return "{day} {month} {year} DR".format(day = in_date[2], month = month, year = in_date[0])
+
+def format_date_span(start_date: int, end_date: int) -> str:
+    return format_timespan(break_date_span(start_date, end_date))
+
+def format_timespan(in_span: list[int]) -> str:
+    span_len: int = len(in_span)
+    if span_len == 0 or span_len > get_broken_date_length():
+        raise RuntimeError("Invalid timespan!")
+
+    parts: list[str] = []
+    for value, unit in zip(in_span, ["year", "month", "day"]):
+        if value == 1:
+            parts.append("1 " + unit)
+        elif value != 0:
+            parts.append("{num} {unit}s".format(num = value, unit = unit))
+    return ", ".join(parts)
+
+def break_date(in_date: int) -> list[int]:
+    year_day: int = in_date % year_length
+    month: int = len(month_starts) - 1
+    while month_starts[month] > year_day:
+        month -= 1
+    return [in_date // year_length + 1, month + 1, year_day - month_starts[month] + 1]
+
+def break_date_span(start_date: int, end_date: int) -> list[int]:
+    if end_date < start_date:
+        return [-value for value in break_date_span(end_date, start_date)]
+
+    # Spans count whole years, then whole months, then the days left over.
+    broken_start: list[int] = break_date(start_date)
+    broken_end: list[int] = break_date(end_date)
+    months: int = (broken_end[0] - broken_start[0]) * len(month_lengths) + broken_end[1] - broken_start[1]
+    if move_date(start_date, [0, months]) > end_date:
+        months -= 1
+    return [months // len(month_lengths), months % len(month_lengths), end_date - move_date(start_date, [0, months])]
+
+def combine_date(in_date: list[int]) -> int:
+    if not validate_date(in_date):
+        raise RuntimeError("Invalid date!")
+
+    date_len: int = len(in_date)
+    days: int = (in_date[0] - 1) * year_length
+    if date_len >= 2:
+        days += month_starts[in_date[1] - 1]
+    if date_len == 3:
+        days += in_date[2] - 1
+    return days
+
+def move_date(start_date: int, delta_span: list[int]) -> int:
+    delta_len: int = len(delta_span)
+    if delta_len == 0 or delta_len > get_broken_date_length():
+        raise RuntimeError("Invalid delta span!")
+
+    # Years and months keep the day of the month where they can, and land on the month's last day where they can't.
+    broken_date: list[int] = break_date(start_date)
+    month_index: int = broken_date[0] * len(month_lengths) + broken_date[1] - 1 + delta_span[0] * len(month_lengths)
+    if delta_len >= 2:
+        month_index += delta_span[1]
+    year: int = month_index // len(month_lengths)
+    month: int = month_index % len(month_lengths) + 1
+    day: int = min(broken_date[2], month_lengths[month - 1])
+
+    day_offset: int = delta_span[2] if delta_len == 3 else 0
+    return combine_date([year, month, day]) + day_offset
+
+def validate_date(in_date: list[int]) -> bool:
+    date_len = len(in_date)
+
+    valid_len: bool = date_len > 0 and date_len <= get_broken_date_length()
+    if not valid_len:
+        return False
+
+    valid_months: bool = date_len < 2 or (in_date[1] > 0 and in_date[1] <= len(month_lengths))
+    valid_days: bool = date_len < 3 or (valid_months and in_date[2] > 0 and in_date[2] <= month_lengths[in_date[1] - 1])
+
+    return valid_days and valid_months
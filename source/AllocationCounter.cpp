@@ -0,0 +1,101 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (AllocationCounter.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "AllocationCounter.h"
+
+#if TB_COUNT_ALLOCATIONS
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+/*
+	Replacements for the global allocation functions.  Only the plain forms are replaced; the array and nothrow forms
+	call these by default.  Aligned allocations keep the standard implementation and aren't counted.
+*/
+static thread_local uint64 ThreadAllocations = 0;
+static thread_local int64 ThreadLiveBytes = 0;
+
+static int64 GetBlockSize(void* memory)
+{
+#if defined(_WIN32)
+	return static_cast<int64>(_msize(memory));
+#else
+	return static_cast<int64>(malloc_usable_size(memory));
+#endif
+}
+
+void* operator new(std::size_t size)
+{
+	ThreadAllocations++;
+
+	// Same contract as the standard version: never return null, and give the new handler a chance to free memory.
+	const std::size_t allocationSize = size == 0 ? 1 : size;
+	while (true)
+	{
+		if (void* memory = std::malloc(allocationSize))
+		{
+			ThreadLiveBytes += GetBlockSize(memory);
+			return memory;
+		}
+
+		std::new_handler handler = std::get_new_handler();
+		if (handler == nullptr)
+		{
+			throw std::bad_alloc();
+		}
+		handler();
+	}
+}
+
+void operator delete(void* memory) noexcept
+{
+	if (memory != nullptr)
+	{
+		ThreadLiveBytes -= GetBlockSize(memory);
+	}
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	if (memory != nullptr)
+	{
+		ThreadLiveBytes -= GetBlockSize(memory);
+	}
+	std::free(memory);
+}
+
+uint64 TBAllocationCounter::GetThreadAllocations()
+{
+	return ThreadAllocations;
+}
+
+int64 TBAllocationCounter::GetThreadLiveBytes()
+{
+	return ThreadLiveBytes;
+}
+#else
+uint64 TBAllocationCounter::GetThreadAllocations()
+{
+	return 0;
+}
+
+int64 TBAllocationCounter::GetThreadLiveBytes()
+{
+	return 0;
+}
+#endif //TB_COUNT_ALLOCATIONS
\ No newline at end of file
@@ -0,0 +1,50 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (AllocationCounter.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+
+/*
+	Counts heap allocations made through operator new, per thread.  Used by benchmarks to see how much a call
+	allocates.  That includes QMap and QHash, whose nodes are allocated by templates compiled into this program, but
+	not QList, QString or Python, which allocate through malloc or their own allocators.
+
+	Counting replaces the global operator new and delete, so it's only compiled into builds with TB_COUNT_ALLOCATIONS
+	set, which the Benchmark configuration does.  Otherwise the counts stay at zero.
+*/
+class TBAllocationCounter
+{
+public:
+	// This is a static method class only.  Never instantiate.
+	TBAllocationCounter() = delete;
+
+	static constexpr bool IsEnabled()
+	{
+#if TB_COUNT_ALLOCATIONS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	// Allocations made by the calling thread since it started.
+	static uint64 GetThreadAllocations();
+	// Bytes the calling thread has allocated and not freed, as the allocator sized the blocks.  Only meaningful as a
+	// difference, and only if nothing it allocated in between was freed by another thread.
+	static int64 GetThreadLiveBytes();
+};
\ No newline at end of file
@@ -0,0 +1,59 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (CacheFile.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QIODevice>
+
+#include <vector>
+
+/*
+	Helpers for the tables calendars save to the user cache folder.  Each file starts with its own magic number and
+	version, followed by the hash of the script it was built from.
+*/
+
+// Reads or writes a vector of int64 as a count followed by the values.
+inline void WriteInt64Vector(QDataStream& stream, const std::vector<int64>& values)
+{
+	stream << static_cast<qint64>(values.size());
+	for (int64 value : values)
+	{
+		stream << static_cast<qint64>(value);
+	}
+}
+
+inline bool ReadInt64Vector(QDataStream& stream, std::vector<int64>& outValues)
+{
+	qint64 count = 0;
+	stream >> count;
+	if (stream.status() != QDataStream::Ok || count < 0 || count > stream.device()->bytesAvailable() / static_cast<qint64>(sizeof(qint64)))
+	{
+		return false;
+	}
+
+	outValues.resize(count);
+	for (int64& value : outValues)
+	{
+		qint64 readValue = 0;
+		stream >> readValue;
+		value = readValue;
+	}
+	return stream.status() == QDataStream::Ok;
+}
\ No newline at end of file
@@ -17,21 +17,161 @@
 
 #include "PyBind.h"		// This has to come first to not conflict with Qt defines.
 #include "Calendar.h"
+#include "NativeCalendar.h"
+#include "PeriodicCalendar.h"
+#include "YearIndexCalendar.h"
+#include "ScriptInterpreterPool.h"
+#include "CalendarProcessPool.h"
+#include "DateFormat.h"
 #include "Logging.h"
+#include "Settings.h"
+#include "UserFiles.h"
 
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+
+#include <algorithm>
+#include <array>
+#include <memory>
 #include <vector>
 #include <string>
+#include <stdexcept>
+#include <type_traits>
+
+// Native rules are checked on days this far apart, so that a few thousand of them cover a few thousand years either
+// side of day 0.  Prime, so that the checks don't keep landing on the same day of a month or week.
+static constexpr int64 NATIVE_RULES_CHECK_STRIDE = 331;
+
+// TBDate is just a day count, so a span of them can be handed to Python as a buffer of int64 without copying.
+static_assert(sizeof(TBDate) == sizeof(int64) && std::is_standard_layout_v<TBDate>);
 
-// These are not safe to call until the CalendarScript is initialized.
+// These are not safe to call until the CalendarScript is initialized.  Every call is watched, and fails with a
+// TBScriptException if it runs past its budget or the calendar's circuit breaker is open.
 #define ScriptFunction(type, functionName, ...) \
-	CallPythonFunction<type>(*CalendarScript, functionName, __FUNCTION__, __LINE__ __VA_OPT__(,) __VA_ARGS__)
+	CallWatchedScript(*this, TBScriptBudget::Long, functionName, [&, callingFunction = __FUNCTION__]() \
+		{ return CallPythonFunction<type>(*CalendarScript, functionName, callingFunction, __LINE__ __VA_OPT__(,) __VA_ARGS__); })
 #define VoidScriptFunction(functionName, ...) \
-	CallVoidPythonFunction(*CalendarScript, functionName, __FUNCTION__, __LINE__ __VA_OPT__(,) __VA_ARGS__)
-// These are not safe to call until the CalendarObject is initialized.
+	CallWatchedScript(*this, TBScriptBudget::Long, functionName, [&, callingFunction = __FUNCTION__]() \
+		{ CallVoidPythonFunction(*CalendarScript, functionName, callingFunction, __LINE__ __VA_OPT__(,) __VA_ARGS__); })
+// These are not safe to call until ScriptMethods has been resolved.  methodName is a member of TBCalendarScriptMethods.
 #define ScriptMethod(type, methodName, ...) \
-	CallPythonMethod<type>(*CalendarObject, methodName, __FUNCTION__, __LINE__ __VA_OPT__(,) __VA_ARGS__)
-#define VoidScriptMethod(functionName, ...) \
-	CallVoidPythonMethod(*CalendarObject, methodName, __FUNCTION__, __LINE__ __VA_OPT__(,) __VA_ARGS__)
+	CallWatchedScript(*this, TBScriptBudget::Call, ScriptMethods->methodName.Name, [&, callingFunction = __FUNCTION__]() \
+		{ return CallResolvedPythonMethod<type>(ScriptMethods->methodName, callingFunction, __LINE__ __VA_OPT__(,) __VA_ARGS__); })
+#define VoidScriptMethod(methodName, ...) \
+	CallWatchedScript(*this, TBScriptBudget::Call, ScriptMethods->methodName.Name, [&, callingFunction = __FUNCTION__]() \
+		{ CallVoidResolvedPythonMethod(ScriptMethods->methodName, callingFunction, __LINE__ __VA_OPT__(,) __VA_ARGS__); })
+// For batch calls, which get the longer budget.
+#define LongScriptMethod(type, methodName, ...) \
+	CallWatchedScript(*this, TBScriptBudget::Long, ScriptMethods->methodName.Name, [&, callingFunction = __FUNCTION__]() \
+		{ return CallResolvedPythonMethod<type>(ScriptMethods->methodName, callingFunction, __LINE__ __VA_OPT__(,) __VA_ARGS__); })
+#define TryScriptMethod(type, methodName, ...) \
+	TryCallWatchedScript<type>(*this, ScriptMethods->methodName.Name, [&]() \
+		{ return TryCallResolvedPythonMethod<type>(ScriptMethods->methodName __VA_OPT__(,) __VA_ARGS__); })
+
+static void LogScriptTimeout(const TBCalendarSystem& calendar, const char* functionName, TBScriptBudget budget, const TBScriptWatch& watch)
+{
+	TBLog::Warning("Calendar script function '%0' (%1) ran past its %2 ms budget and was interrupted.", functionName, calendar.GetName(),
+		TBScriptWatchdog::Get().GetBudget(budget).count());
+	if (watch.OpenedBreaker())
+	{
+		TBLog::Error("Calendar system '%0' keeps running past its time budget.  Its script won't be called again for %1 ms.", calendar.GetName(),
+			TBScriptWatchdog::Get().GetBreakerCooldown().count());
+	}
+}
+
+// Runs call under the watchdog.  The GIL must already be held.
+template<typename CallFunction>
+static auto CallWatchedScript(const TBCalendarSystem& calendar, TBScriptBudget budget, const char* functionName, CallFunction call) -> decltype(call())
+{
+	TBScriptCircuitBreaker& breaker = calendar.GetCircuitBreaker();
+	if (!breaker.AllowCall())
+	{
+		throw TBScriptException(TBScriptError(TBScriptErrorCode::CircuitOpen, functionName));
+	}
+
+	TBScriptWatch watch(breaker, budget);
+	try
+	{
+		return call();
+	}
+	catch (py::error_already_set&)
+	{
+		if (watch.Finish())
+		{
+			LogScriptTimeout(calendar, functionName, budget, watch);
+			throw TBScriptException(TBScriptError(TBScriptErrorCode::TimedOut, functionName));
+		}
+		throw;
+	}
+}
+
+template<typename T, typename CallFunction>
+static TBScriptResult<T> TryCallWatchedScript(const TBCalendarSystem& calendar, const char* functionName, CallFunction call)
+{
+	TBScriptCircuitBreaker& breaker = calendar.GetCircuitBreaker();
+	if (!breaker.AllowCall())
+	{
+		return TBScriptError(TBScriptErrorCode::CircuitOpen, functionName);
+	}
+
+	TBScriptWatch watch(breaker, TBScriptBudget::Call);
+	TBScriptResult<T> result = call();
+	if (watch.Finish())
+	{
+		LogScriptTimeout(calendar, functionName, TBScriptBudget::Call, watch);
+		if (!result)
+		{
+			return TBScriptError(TBScriptErrorCode::TimedOut, functionName);
+		}
+	}
+	return result;
+}
+
+/*
+	Every calendar entry point, resolved on the calendar object once in InitializeScript.
+*/
+struct TBCalendarScriptMethods
+{
+	TBResolvedPythonMethod GetBrokenDateLength;
+	TBResolvedPythonMethod GetDateFormat;
+	TBResolvedPythonMethod GetTimespanFormat;
+	TBResolvedPythonMethod FormatDate;
+	TBResolvedPythonMethod FormatBrokenDate;
+	TBResolvedPythonMethod FormatDateSpan;
+	TBResolvedPythonMethod FormatTimespan;
+	TBResolvedPythonMethod BreakDate;
+	TBResolvedPythonMethod BreakDateSpan;
+	TBResolvedPythonMethod CombineDate;
+	TBResolvedPythonMethod MoveDate;
+	TBResolvedPythonMethod ValidateDate;
+
+	// Optional batch functions
+	TBResolvedPythonMethod BreakDates;
+	TBResolvedPythonMethod CombineDates;
+	TBResolvedPythonMethod FormatDates;
+	TBResolvedPythonMethod GetFormatTables;
+
+	void Resolve(const py::object& calendarObject)
+	{
+		GetBrokenDateLength.Resolve(calendarObject, "get_broken_date_length");
+		GetDateFormat.Resolve(calendarObject, "get_date_format");
+		GetTimespanFormat.Resolve(calendarObject, "get_timespan_format");
+		FormatDate.Resolve(calendarObject, "format_date");
+		FormatBrokenDate.Resolve(calendarObject, "format_broken_date");
+		FormatDateSpan.Resolve(calendarObject, "format_date_span");
+		FormatTimespan.Resolve(calendarObject, "format_timespan");
+		BreakDate.Resolve(calendarObject, "break_date");
+		BreakDateSpan.Resolve(calendarObject, "break_date_span");
+		CombineDate.Resolve(calendarObject, "combine_date");
+		MoveDate.Resolve(calendarObject, "move_date");
+		ValidateDate.Resolve(calendarObject, "validate_date");
+		BreakDates.Resolve(calendarObject, "break_dates");
+		CombineDates.Resolve(calendarObject, "combine_dates");
+		FormatDates.Resolve(calendarObject, "format_dates");
+		GetFormatTables.Resolve(calendarObject, "get_format_tables");
+	}
+};
 
 /*
 	Helper functions for converting between Python arrays and QLists
@@ -43,20 +183,88 @@ void PythonObjectToQList(const py::object& inObject, QList<T>& outList)
 	outList = QList<T>(intermediate.begin(), intermediate.end());
 }
 
+// Looks up a script result in one of the result caches, calling into the script and caching its result on a miss.
+template<typename T, typename KeyType, typename ComputeFunction>
+T CachedScriptResult(TBShardedCache<KeyType, QVariant>& cache, const KeyType& key, ComputeFunction compute)
+{
+	QVariant cachedResult;
+	if (cache.Find(key, cachedResult))
+	{
+		return cachedResult.value<T>();
+	}
+
+	T result = compute();
+	cache.Insert(key, QVariant::fromValue(result));
+	return result;
+}
+
+// Same as CachedScriptResult, for the non-throwing calls.  Failures aren't cached.
+template<typename T, typename KeyType, typename ComputeFunction>
+TBScriptResult<T> TryCachedScriptResult(TBShardedCache<KeyType, QVariant>& cache, const KeyType& key, ComputeFunction compute)
+{
+	QVariant cachedResult;
+	if (cache.Find(key, cachedResult))
+	{
+		return cachedResult.value<T>();
+	}
+
+	TBScriptResult<T> result = compute();
+	if (result)
+	{
+		cache.Insert(key, QVariant::fromValue(*result));
+	}
+	return result;
+}
+
 /*
 	TBCalendarSystem
 */
 TBCalendarSystem::TBCalendarSystem() : JsonableObject(),
+	CalendarID(),
 	Name(),
 	Description(),
 	ScriptName(),
 	CalendarScript(),
 	CalendarObject(),
+	ScriptMethods(),
+	InterpreterPool(),
+	ProcessPool(),
+	FormatProgram(),
+	NativeRules(),
+	PeriodicTable(),
+	YearIndex(),
+	NativeBackend(nullptr),
 	CachedBrokenDateLength(0),
 	CachedDateFormat(),
-	CachedTimespanFormat()
+	CachedTimespanFormat(),
+	ScriptGeneration(0),
+	Replaced(false),
+	DayResultCache(),
+	BrokenDateResultCache(),
+	TickGenerator(),
+	CircuitBreaker()
 {}
 
+TBCalendarSystem::~TBCalendarSystem()
+{
+	if (TBCalendarExecutor::IsInitialized())
+	{
+		TBCalendarExecutor::Get().CancelOwner(this);
+	}
+
+	// Script objects have to be released under the GIL, which this thread may not be holding.  The interpreter pool
+	// also needs it to hand over to its workers while they shut down.
+	if (Py_IsInitialized())
+	{
+		TBScopedGil gil;
+		InterpreterPool.reset();
+		ProcessPool.reset();
+		ScriptMethods.reset();
+		CalendarObject.reset();
+		CalendarScript.reset();
+	}
+}
+
 bool TBCalendarSystem::LoadFromJson(const QJsonObject& jsonObject)
 {
 	JsonableObject::LoadFromJson(jsonObject);
@@ -64,18 +272,42 @@ bool TBCalendarSystem::LoadFromJson(const QJsonObject& jsonObject)
 	Name = JsonToString(jsonObject, "name");
 	Description = JsonToString(jsonObject, "description");
 	ScriptName = JsonToString(jsonObject, "script_name");
+	CalendarID = JsonToUuid(jsonObject, "id");
+	if (CalendarID.isNull())
+	{
+		// Keeps references stable for descriptors written before calendars had IDs.
+		static const QUuid scriptNamespace(0x5c1b0a52, 0x3f43, 0x4c58, 0x9c, 0x0e, 0x6f, 0x4d, 0x8f, 0x1f, 0x7a, 0x21);
+		CalendarID = QUuid::createUuidV5(scriptNamespace, ScriptName);
+	}
+
+	// Native rules are optional, and a calendar whose rules don't load still works through its script.
+	NativeRules.reset();
+	if (jsonObject.contains("native_rules"))
+	{
+		NativeRules = std::make_unique<TBNativeCalendar>();
+		if (!jsonObject["native_rules"].isObject() || !NativeRules->LoadFromJson(jsonObject["native_rules"].toObject()))
+		{
+			TBLog::Warning("Could not load native rules for calendar system '%0'.  Falling back to its script.", Name);
+			NativeRules.reset();
+		}
+	}
 
 	return LoadSuccessful;
 }
 
 void TBCalendarSystem::PopulateJson(QJsonObject& jsonObject) const
 {
+	jsonObject.insert("id", UuidToJson(CalendarID));
 	jsonObject.insert("name", Name);
 	jsonObject.insert("description", Description);
 	jsonObject.insert("script_path", ScriptName);
+	if (NativeRules)
+	{
+		ObjectToJson(jsonObject, "native_rules", *NativeRules);
+	}
 }
 
-bool TBCalendarSystem::InitializeScript()
+bool TBCalendarSystem::InitializeScript(bool reloadModule)
 {
 	if (ScriptName.isEmpty())
 	{
@@ -83,12 +315,42 @@ bool TBCalendarSystem::InitializeScript()
 		return false;
 	}
 
+	// Queued work would otherwise run against whatever the script turns into.
+	if (TBCalendarExecutor::IsInitialized())
+	{
+		TBCalendarExecutor::Get().CancelOwner(this);
+	}
+	TBScopedGil gil;
+
+	// Anything cached from a previous initialization may not match what the script does now.
+	ResetResultCaches();
+	PeriodicTable.reset();
+	YearIndex.reset();
+	NativeBackend = nullptr;
+	InterpreterPool.reset();
+	ProcessPool.reset();
+	FormatProgram.reset();
+	// A fixed script deserves another chance.
+	CircuitBreaker.Reset();
+
+	// Anything derived from the old script is now out of date.  Generations are shared between calendars, so that a
+	// new instance of a calendar never matches a generation from the one it replaced.
+	static std::atomic<uint64> lastScriptGeneration = 0;
+	ScriptGeneration = ++lastScriptGeneration;
+
+	// A module that was imported before is reloaded, so that changes to the script file are picked up.  Other modules
+	// it imports are left as they are.
+	reloadModule = reloadModule || (CalendarScript && *CalendarScript);
 	CalendarScript = std::make_unique<py::module_>();
 	CalendarObject = std::make_unique<py::object>();
 
 	try
 	{
 		*CalendarScript = py::module_::import(ScriptName.toUtf8());
+		if (reloadModule)
+		{
+			CalendarScript->reload();
+		}
 	}
 	catch (py::error_already_set& pythonException)
 	{
@@ -98,63 +360,828 @@ bool TBCalendarSystem::InitializeScript()
 
 	*CalendarObject = ScriptFunction(py::object, "init_calendar");
 
-	CachedBrokenDateLength = ScriptMethod(int32, "get_broken_date_length");
-	CachedDateFormat = ScriptMethod(std::string, "get_date_format").data();
-	CachedTimespanFormat = ScriptMethod(std::string, "get_timespan_format").data();
+	ScriptMethods = std::make_unique<TBCalendarScriptMethods>();
+	ScriptMethods->Resolve(*CalendarObject);
+
+	CachedBrokenDateLength = ScriptMethod(int32, GetBrokenDateLength);
+	CachedDateFormat = ScriptMethod(std::string, GetDateFormat).data();
+	CachedTimespanFormat = ScriptMethod(std::string, GetTimespanFormat).data();
+
+	if (!TBBrokenDate::CanHold(CachedBrokenDateLength))
+	{
+		TBLog::Error("Calendar script '%0' reports broken dates of length %1, but at most %2 components are supported.",
+			ScriptName, CachedBrokenDateLength, MAX_BROKEN_DATE_LENGTH);
+		return false;
+	}
+
+	CompileDateFormat();
+
+	// Started before probing for a cycle, so that the probe gets to use it too.
+	const int32 interpreterCount = TBSettings::Get().GetValue<int32>(TBSettingsFile::System, "Calendar", "ScriptInterpreters");
+	InterpreterPool = TBScriptInterpreterPool::Create(ScriptName, interpreterCount);
+	if (InterpreterPool)
+	{
+		TBLog::Log("Calendar script '%0' loaded into %1 additional interpreters.", ScriptName, InterpreterPool->GetInterpreterCount());
+	}
+	else
+	{
+		const int32 processCount = TBSettings::Get().GetValue<int32>(TBSettingsFile::System, "Calendar", "WorkerProcesses");
+		const int32 timeoutMs = TBSettings::Get().GetValue<int32>(TBSettingsFile::System, "Calendar", "WorkerProcessTimeoutMs");
+		ProcessPool = TBCalendarProcessPool::Create(ScriptName, processCount, timeoutMs);
+		if (ProcessPool)
+		{
+			TBLog::Log("Calendar script '%0' loaded into %1 worker processes.", ScriptName, ProcessPool->GetProcessCount());
+		}
+	}
+
+	if (NativeRules && CachedBrokenDateLength != NativeRules->GetBrokenDateLength())
+	{
+		TBLog::Warning("Calendar script '%0' reports broken dates of length %1, which its native rules can't produce.  Native rules disabled.",
+			ScriptName, CachedBrokenDateLength);
+	}
+	else if (NativeRules)
+	{
+		if (CheckNativeRules())
+		{
+			NativeBackend = NativeRules.get();
+		}
+	}
+	else
+	{
+		ProbePeriodicity();
+		if (!NativeBackend)
+		{
+			BuildYearIndex();
+		}
+	}
 
 	return true;
 }
 
+bool TBCalendarSystem::CheckNativeRules()
+{
+	const int64 checkDays = TBSettings::Get().GetValue<int64>(TBSettingsFile::System, "Calendar", "NativeRulesCheckDays");
+	if (checkDays <= 0)
+	{
+		return true;
+	}
+
+	// NativeBackend isn't set yet, so these go through the script.
+	std::vector<TBDate> days;
+	days.reserve(checkDays);
+	for (int64 checkIndex = 0; checkIndex < checkDays; checkIndex++)
+	{
+		days.emplace_back((checkIndex - checkDays / 2) * NATIVE_RULES_CHECK_STRIDE);
+	}
+	std::vector<int64> scriptBrokenDates;
+	std::vector<TBDate> scriptDays;
+	try
+	{
+		BreakDates(days, scriptBrokenDates);
+		CombineDates(scriptBrokenDates, scriptDays);
+	}
+	catch (const std::exception& exception)
+	{
+		TBLog::Warning("Could not check the native rules of calendar script '%0': %1  Native rules disabled.", ScriptName, exception.what());
+		return false;
+	}
+	// Nobody asked for any of these.
+	ResetResultCaches();
+
+	// Only called once the script's broken date length is known to match the rules'.
+	std::array<int64, TBNativeCalendar::BrokenDateLength> nativeComponents;
+	if (scriptBrokenDates.size() != days.size() * nativeComponents.size() || scriptDays.size() != days.size())
+	{
+		TBLog::Warning("Calendar script '%0' returned malformed dates while its native rules were checked.  Native rules disabled.", ScriptName);
+		return false;
+	}
+	for (size_t dayIndex = 0; dayIndex < days.size(); dayIndex++)
+	{
+		std::span<const int64> scriptComponents = std::span<const int64>(scriptBrokenDates).subspan(dayIndex * nativeComponents.size(), nativeComponents.size());
+		int64 nativeDay = 0;
+		const bool nativeBroke = NativeRules->BreakDate(days[dayIndex].GetDays(), nativeComponents);
+		const bool nativeCombined = NativeRules->CombineDate(scriptComponents, nativeDay);
+		if (!nativeBroke || !std::ranges::equal(scriptComponents, nativeComponents) || !nativeCombined || nativeDay != scriptDays[dayIndex].GetDays())
+		{
+			TBLog::Warning("Native rules of calendar script '%0' don't match the script around day %1.  Native rules disabled.",
+				ScriptName, days[dayIndex].GetDays());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void TBCalendarSystem::ProbePeriodicity()
+{
+	const TBSettings& settings = TBSettings::Get();
+	const int64 maxCycleDays = settings.GetValue<int64>(TBSettingsFile::System, "Calendar", "PeriodicMaxCycleDays");
+	const int64 verifyDays = settings.GetValue<int64>(TBSettingsFile::System, "Calendar", "PeriodicVerifyDays");
+	if (maxCycleDays <= 0)
+	{
+		return;
+	}
+
+	// Probing and verifying a cycle takes a lot of script calls, so the result is saved for as long as the script
+	// stays the same.
+	const QByteArray scriptHash = HashScriptFile();
+	const QString probePath = GetCacheFilePath("cycle");
+	const bool probeLoaded = !scriptHash.isEmpty()
+		&& TBPeriodicCalendar::Load(probePath, scriptHash, maxCycleDays, verifyDays, CachedBrokenDateLength, PeriodicTable);
+
+	if (!probeLoaded)
+	{
+		// Probing goes through the script like any other call, so a script that misbehaves just leaves us without a table.
+		bool probeFinished = false;
+		try
+		{
+			PeriodicTable = TBPeriodicCalendar::Build(*this, maxCycleDays, verifyDays);
+			probeFinished = true;
+		}
+		catch (const std::exception& exception)
+		{
+			TBLog::Warning("Could not probe calendar script '%0' for a cycle: %1", ScriptName, exception.what());
+			PeriodicTable.reset();
+		}
+
+		// A probe that failed part way might go differently next time, so only a finished one is kept.
+		if (probeFinished && !scriptHash.isEmpty()
+			&& !TBPeriodicCalendar::Save(probePath, scriptHash, maxCycleDays, verifyDays, CachedBrokenDateLength, PeriodicTable.get()))
+		{
+			TBLog::Warning("Could not save the cycle probe for calendar script '%0' to %1.", ScriptName, probePath);
+		}
+	}
+
+	if (PeriodicTable)
+	{
+		TBLog::Log("Calendar script '%0' repeats every %1 days (%2 years).  Breaking and combining dates natively.",
+			ScriptName, PeriodicTable->GetCycleDays(), PeriodicTable->GetCycleYears());
+		NativeBackend = PeriodicTable.get();
+	}
+
+	// Anything the probe cached is still correct, but it's a big block of sequential days nobody asked for.
+	ResetResultCaches();
+}
+
+void TBCalendarSystem::BuildYearIndex()
+{
+	const TBSettings& settings = TBSettings::Get();
+	const int64 minYear = settings.GetValue<int64>(TBSettingsFile::System, "Calendar", "YearIndexMinYear");
+	const int64 maxYear = settings.GetValue<int64>(TBSettingsFile::System, "Calendar", "YearIndexMaxYear");
+	if (minYear > maxYear || CachedBrokenDateLength < 2)
+	{
+		return;
+	}
+
+	const QByteArray scriptHash = HashScriptFile();
+	const QString indexPath = GetCacheFilePath("yearindex");
+
+	if (!scriptHash.isEmpty())
+	{
+		YearIndex = TBYearIndexCalendar::Load(indexPath, scriptHash, minYear, maxYear, CachedBrokenDateLength);
+	}
+
+	if (!YearIndex)
+	{
+		try
+		{
+			YearIndex = TBYearIndexCalendar::Build(*this, minYear, maxYear);
+		}
+		catch (const std::exception& exception)
+		{
+			TBLog::Warning("Could not index years of calendar script '%0': %1", ScriptName, exception.what());
+			YearIndex.reset();
+		}
+
+		if (YearIndex && !scriptHash.isEmpty() && !YearIndex->Save(indexPath, scriptHash))
+		{
+			TBLog::Warning("Could not save the year index for calendar script '%0' to %1.", ScriptName, indexPath);
+		}
+		// Building went through the caches like any other batch.
+		ResetResultCaches();
+	}
+
+	if (YearIndex)
+	{
+		TBLog::Log("Calendar script '%0' indexed over years %1 to %2 (%3 periods).  Breaking and combining those dates natively.",
+			ScriptName, minYear, maxYear, YearIndex->GetPeriodCount());
+		NativeBackend = YearIndex.get();
+	}
+}
+
+QByteArray TBCalendarSystem::HashScriptFile() const
+{
+	// Scripts it imports aren't part of the hash.
+	try
+	{
+		QFile scriptFile(QString::fromStdString(CalendarScript->attr("__file__").cast<std::string>()));
+		if (scriptFile.open(QIODevice::ReadOnly))
+		{
+			return QCryptographicHash::hash(scriptFile.readAll(), QCryptographicHash::Sha256);
+		}
+	}
+	catch (const std::exception& exception)
+	{
+		TBLog::Warning("Could not find the file for calendar script '%0': %1", ScriptName, exception.what());
+	}
+	return QByteArray();
+}
+
+QString TBCalendarSystem::GetCacheFilePath(const QString& extension) const
+{
+	QDir cacheDir = TBUserFiles::GetBasePath();
+	cacheDir.mkpath("cache");
+	cacheDir.cd("cache");
+	return cacheDir.filePath(QString("%0.%1").arg(ScriptName, extension));
+}
+
+void TBCalendarSystem::CompileDateFormat()
+{
+	if (!ScriptMethods->GetFormatTables.IsValid())
+	{
+		return;
+	}
+
+	// The script can give a richer template than get_date_format() along with its tables, since the plain one can't
+	// name anything.
+	QString format = CachedDateFormat;
+	QHash<QString, TBNameTable> tables;
+	try
+	{
+		py::dict exported = LongScriptMethod(py::dict, GetFormatTables);
+		if (exported.contains("date_format"))
+		{
+			format = QString::fromStdString(exported["date_format"].cast<std::string>());
+		}
+		if (exported.contains("tables"))
+		{
+			for (const auto& [tableName, tableValue] : exported["tables"].cast<py::dict>())
+			{
+				const py::dict tableObject = tableValue.cast<py::dict>();
+				TBNameTable table;
+				for (const std::string& name : tableObject["names"].cast<std::vector<std::string>>())
+				{
+					table.Names.append(QString::fromStdString(name));
+				}
+				table.FirstValue = tableObject.contains("first") ? tableObject["first"].cast<int64>() : 0;
+				table.IsCycle = tableObject.contains("cycle_start");
+				table.CycleStartDay = table.IsCycle ? tableObject["cycle_start"].cast<int64>() : 0;
+				tables.insert(QString::fromStdString(tableName.cast<std::string>()), table);
+			}
+		}
+	}
+	catch (const std::exception& exception)
+	{
+		TBLog::Warning("Could not read format tables from calendar script '%0': %1", ScriptName, exception.what());
+		return;
+	}
+
+	QString error;
+	FormatProgram = TBDateFormatProgram::Compile(format, tables, CachedBrokenDateLength, error);
+	if (!FormatProgram)
+	{
+		TBLog::Warning("Calendar script '%0' has a date format that can't be used natively (%1): %2", ScriptName, format, error);
+	}
+}
+
+void TBCalendarSystem::ResetResultCaches()
+{
+	const TBSettings& settings = TBSettings::Get();
+	const int32 cacheCapacity = settings.GetValue<int32>(TBSettingsFile::System, "Calendar", "ResultCacheCapacity");
+	const int32 cacheShards = settings.GetValue<int32>(TBSettingsFile::System, "Calendar", "ResultCacheShards");
+	DayResultCache.Reset(cacheCapacity, cacheShards);
+	BrokenDateResultCache.Reset(cacheCapacity, cacheShards);
+	TickGenerator.Clear();
+}
+
 QString TBCalendarSystem::FormatDate(TBDate date) const
 {
-	return ScriptMethod(std::string, "format_date", date.GetDays()).data();
+	if (FormatProgram)
+	{
+		TBBrokenDate brokenDate;
+		BreakDate(date, brokenDate);
+		QString formatted;
+		if (FormatProgram->Format(date.GetDays(), std::span<const int64>(brokenDate.constData(), brokenDate.size()), formatted))
+		{
+			return formatted;
+		}
+	}
+
+	return CachedScriptResult<QString>(DayResultCache, { TBCachedCalendarCall::FormatDate, date.GetDays() }, [&]() -> QString
+	{
+		TBScopedGil gil;
+		return ScriptMethod(std::string, FormatDate, date.GetDays()).data();
+	});
 }
 
 QString TBCalendarSystem::FormatDate(const TBBrokenDate& date) const
 {
-	std::vector<int64> dateVector(date.begin(), date.end());
-	return ScriptMethod(std::string, "format_broken_date", dateVector).data();
+	// Partial and invalid dates are up to the script.
+	if (FormatProgram && date.length() == CachedBrokenDateLength && ValidateBrokenDate(date))
+	{
+		const int64 day = FormatProgram->UsesDayNumber() ? CombineDate(date).GetDays() : 0;
+		QString formatted;
+		if (FormatProgram->Format(day, std::span<const int64>(date.constData(), date.size()), formatted))
+		{
+			return formatted;
+		}
+	}
+
+	return CachedScriptResult<QString>(BrokenDateResultCache, { TBCachedCalendarCall::FormatBrokenDate, date }, [&]() -> QString
+	{
+		TBScopedGil gil;
+		return ScriptMethod(std::string, FormatBrokenDate, date).data();
+	});
 }
 
 QString TBCalendarSystem::FormatDateSpan(TBDate startDate, TBDate endDate) const
 {
-	return ScriptMethod(std::string, "format_date_span", startDate.GetDays(), endDate.GetDays()).data();
+	TBScopedGil gil;
+	return ScriptMethod(std::string, FormatDateSpan, startDate.GetDays(), endDate.GetDays()).data();
 }
 
 QString TBCalendarSystem::FormatTimespan(const TBBrokenTimespan& span) const
 {
-	std::vector<int64> spanVector(span.begin(), span.end());
-	return ScriptMethod(std::string, "format_timespan", spanVector).data();
+	TBScopedGil gil;
+	return ScriptMethod(std::string, FormatTimespan, span).data();
 }
 
 void TBCalendarSystem::BreakDate(TBDate date, TBBrokenDate& outBrokenDate) const
 {
-	std::vector<int64> result = ScriptMethod(std::vector<int64>, "break_date", date.GetDays());
-	outBrokenDate = TBBrokenTimespan(result.begin(), result.end());
+	if (NativeBackend)
+	{
+		outBrokenDate.resize(NativeBackend->GetBrokenDateLength());
+		if (NativeBackend->BreakDate(date.GetDays(), std::span<int64>(outBrokenDate.data(), outBrokenDate.size())))
+		{
+			return;
+		}
+	}
+
+	outBrokenDate = CachedScriptResult<TBBrokenDate>(DayResultCache, { TBCachedCalendarCall::BreakDate, date.GetDays() }, [&]() -> TBBrokenDate
+	{
+		TBScopedGil gil;
+		return ScriptMethod(TBBrokenDate, BreakDate, date.GetDays());
+	});
 }
 
 void TBCalendarSystem::BreakDateSpan(TBDate startDate, TBDate endDate, TBBrokenTimespan& outBrokenSpan) const
 {
-	std::vector<int64> result = ScriptMethod(std::vector<int64>, "break_date_span", startDate.GetDays(), endDate.GetDays());
-	outBrokenSpan = TBBrokenTimespan(result.begin(), result.end());
+	TBScopedGil gil;
+	outBrokenSpan = ScriptMethod(TBBrokenTimespan, BreakDateSpan, startDate.GetDays(), endDate.GetDays());
 }
 
 TBDate TBCalendarSystem::CombineDate(const TBBrokenDate& brokenDate) const
 {
-	std::vector<int64> dateVector(brokenDate.begin(), brokenDate.end());
-	return ScriptMethod(int64, "combine_date", dateVector);
+	// Dates the native backend rejects still go to the script, so that invalid input fails the same way either way.
+	int64 nativeDay = 0;
+	if (NativeBackend && NativeBackend->CombineDate(std::span<const int64>(brokenDate.constData(), brokenDate.size()), nativeDay))
+	{
+		return nativeDay;
+	}
+
+	return CachedScriptResult<int64>(BrokenDateResultCache, { TBCachedCalendarCall::CombineDate, brokenDate }, [&]() -> int64
+	{
+		TBScopedGil gil;
+		return ScriptMethod(int64, CombineDate, brokenDate);
+	});
 }
 
 TBDate TBCalendarSystem::MoveDate(TBDate startDate, const TBBrokenTimespan& deltaTime) const
 {
-	std::vector<int64> deltaVector(deltaTime.begin(), deltaTime.end());
-	return TBDate(ScriptMethod(int64, "move_date", startDate.GetDays(), deltaVector));
+	int64 nativeDay = 0;
+	if (NativeBackend && NativeBackend->MoveDate(startDate.GetDays(), std::span<const int64>(deltaTime.constData(), deltaTime.size()), nativeDay))
+	{
+		return nativeDay;
+	}
+
+	TBScopedGil gil;
+	return TBDate(ScriptMethod(int64, MoveDate, startDate.GetDays(), deltaTime));
 }
 
 bool TBCalendarSystem::ValidateBrokenDate(const TBBrokenDate& brokenDate) const
 {
-	std::vector<int64> dateVector(brokenDate.begin(), brokenDate.end());
-	return ScriptMethod(bool, "validate_date", dateVector);
+	bool nativeValid = false;
+	if (NativeBackend && NativeBackend->ValidateBrokenDate(std::span<const int64>(brokenDate.constData(), brokenDate.size()), nativeValid))
+	{
+		return nativeValid;
+	}
+
+	return CachedScriptResult<bool>(BrokenDateResultCache, { TBCachedCalendarCall::ValidateBrokenDate, brokenDate }, [&]() -> bool
+	{
+		TBScopedGil gil;
+		return ScriptMethod(bool, ValidateDate, brokenDate);
+	});
+}
+
+TBScriptResult<QString> TBCalendarSystem::TryFormatDate(TBDate date) const
+{
+	if (FormatProgram)
+	{
+		TBScriptResult<TBBrokenDate> brokenDate = TryBreakDate(date);
+		if (!brokenDate)
+		{
+			return brokenDate.error();
+		}
+		QString formatted;
+		if (FormatProgram->Format(date.GetDays(), std::span<const int64>(brokenDate->constData(), brokenDate->size()), formatted))
+		{
+			return formatted;
+		}
+	}
+
+	return TryCachedScriptResult<QString>(DayResultCache, { TBCachedCalendarCall::FormatDate, date.GetDays() }, [&]() -> TBScriptResult<QString>
+	{
+		TBScopedGil gil;
+		TBScriptResult<std::string> formatted = TryScriptMethod(std::string, FormatDate, date.GetDays());
+		if (!formatted)
+		{
+			return formatted.error();
+		}
+		return QString::fromStdString(*formatted);
+	});
+}
+
+TBScriptResult<TBBrokenDate> TBCalendarSystem::TryBreakDate(TBDate date) const
+{
+	if (NativeBackend)
+	{
+		TBBrokenDate brokenDate;
+		brokenDate.resize(NativeBackend->GetBrokenDateLength());
+		if (NativeBackend->BreakDate(date.GetDays(), std::span<int64>(brokenDate.data(), brokenDate.size())))
+		{
+			return brokenDate;
+		}
+	}
+
+	return TryCachedScriptResult<TBBrokenDate>(DayResultCache, { TBCachedCalendarCall::BreakDate, date.GetDays() }, [&]() -> TBScriptResult<TBBrokenDate>
+	{
+		TBScopedGil gil;
+		return TryScriptMethod(TBBrokenDate, BreakDate, date.GetDays());
+	});
+}
+
+TBScriptResult<TBDate> TBCalendarSystem::TryCombineDate(const TBBrokenDate& brokenDate) const
+{
+	int64 nativeDay = 0;
+	if (NativeBackend && NativeBackend->CombineDate(std::span<const int64>(brokenDate.constData(), brokenDate.size()), nativeDay))
+	{
+		return TBDate(nativeDay);
+	}
+
+	TBScriptResult<int64> day = TryCachedScriptResult<int64>(BrokenDateResultCache, { TBCachedCalendarCall::CombineDate, brokenDate }, [&]() -> TBScriptResult<int64>
+	{
+		TBScopedGil gil;
+		return TryScriptMethod(int64, CombineDate, brokenDate);
+	});
+	if (!day)
+	{
+		return day.error();
+	}
+	return TBDate(*day);
+}
+
+TBScriptResult<TBDate> TBCalendarSystem::TryMoveDate(TBDate startDate, const TBBrokenTimespan& deltaTime) const
+{
+	int64 nativeDay = 0;
+	if (NativeBackend && NativeBackend->MoveDate(startDate.GetDays(), std::span<const int64>(deltaTime.constData(), deltaTime.size()), nativeDay))
+	{
+		return TBDate(nativeDay);
+	}
+
+	TBScopedGil gil;
+	TBScriptResult<int64> day = TryScriptMethod(int64, MoveDate, startDate.GetDays(), deltaTime);
+	if (!day)
+	{
+		return day.error();
+	}
+	return TBDate(*day);
+}
+
+TBScriptResult<bool> TBCalendarSystem::TryValidateBrokenDate(const TBBrokenDate& brokenDate) const
+{
+	bool nativeValid = false;
+	if (NativeBackend && NativeBackend->ValidateBrokenDate(std::span<const int64>(brokenDate.constData(), brokenDate.size()), nativeValid))
+	{
+		return nativeValid;
+	}
+
+	return TryCachedScriptResult<bool>(BrokenDateResultCache, { TBCachedCalendarCall::ValidateBrokenDate, brokenDate }, [&]() -> TBScriptResult<bool>
+	{
+		TBScopedGil gil;
+		return TryScriptMethod(bool, ValidateDate, brokenDate);
+	});
+}
+
+void TBCalendarSystem::BreakDates(std::span<const TBDate> dates, std::vector<int64>& outFlatBrokenDates) const
+{
+	outFlatBrokenDates.clear();
+	if (dates.empty())
+	{
+		return;
+	}
+
+	const size_t expectedLength = dates.size() * CachedBrokenDateLength;
+
+	if (NativeBackend)
+	{
+		outFlatBrokenDates.resize(expectedLength);
+		std::span<int64> outComponents(outFlatBrokenDates);
+		TBBrokenDate brokenDate;
+		for (size_t dateIndex = 0; dateIndex < dates.size(); dateIndex++)
+		{
+			std::span<int64> dateComponents = outComponents.subspan(dateIndex * CachedBrokenDateLength, CachedBrokenDateLength);
+			if (!NativeBackend->BreakDate(dates[dateIndex].GetDays(), dateComponents))
+			{
+				BreakDate(dates[dateIndex], brokenDate);
+				if (brokenDate.length() != CachedBrokenDateLength)
+				{
+					outFlatBrokenDates.clear();
+					break;
+				}
+				std::copy(brokenDate.begin(), brokenDate.end(), dateComponents.begin());
+			}
+		}
+	}
+	else if (InterpreterPool && InterpreterPool->ShouldSplit(dates.size()))
+	{
+		std::span<const int64> days(reinterpret_cast<const int64*>(dates.data()), dates.size());
+		InterpreterPool->BreakDates(days, CachedBrokenDateLength, outFlatBrokenDates);
+	}
+	else if (ProcessPool && ProcessPool->ShouldSplit(dates.size()))
+	{
+		std::span<const int64> days(reinterpret_cast<const int64*>(dates.data()), dates.size());
+		ProcessPool->BreakDates(days, CachedBrokenDateLength, outFlatBrokenDates);
+	}
+	else if (ScriptMethods->BreakDates.IsValid())
+	{
+		std::span<const int64> days(reinterpret_cast<const int64*>(dates.data()), dates.size());
+		TBScopedGil gil;
+		py::object result = LongScriptMethod(py::object, BreakDates, Int64SpanToMemoryView(days));
+		PythonObjectToInt64Vector(result, outFlatBrokenDates);
+	}
+	else
+	{
+		outFlatBrokenDates.reserve(expectedLength);
+		TBBrokenDate brokenDate;
+		for (TBDate date : dates)
+		{
+			BreakDate(date, brokenDate);
+			if (brokenDate.length() != CachedBrokenDateLength)
+			{
+				// Caught by the size check below.
+				break;
+			}
+			outFlatBrokenDates.insert(outFlatBrokenDates.end(), brokenDate.begin(), brokenDate.end());
+		}
+	}
+
+	if (outFlatBrokenDates.size() != expectedLength)
+	{
+		TBLog::Error("%0: Calendar script '%1' returned %2 values for %3 dates; expected %4.", __FUNCTION__, ScriptName,
+			static_cast<int64>(outFlatBrokenDates.size()), static_cast<int64>(dates.size()), static_cast<int64>(expectedLength));
+		throw std::runtime_error("Calendar script returned a malformed batch of broken dates.");
+	}
+}
+
+void TBCalendarSystem::CombineDates(std::span<const int64> flatBrokenDates, std::vector<TBDate>& outDates) const
+{
+	outDates.clear();
+	if (flatBrokenDates.empty())
+	{
+		return;
+	}
+
+	if (CachedBrokenDateLength <= 0 || flatBrokenDates.size() % CachedBrokenDateLength != 0)
+	{
+		TBLog::Error("%0: Flattened broken dates (%1 values) are not a multiple of the broken date length (%2).", __FUNCTION__,
+			static_cast<int64>(flatBrokenDates.size()), CachedBrokenDateLength);
+		throw std::invalid_argument("Flattened broken dates do not match the calendar's broken date length.");
+	}
+
+	const size_t dateCount = flatBrokenDates.size() / CachedBrokenDateLength;
+
+	if (InterpreterPool && InterpreterPool->ShouldSplit(dateCount) && !NativeBackend)
+	{
+		std::vector<int64> days;
+		InterpreterPool->CombineDates(flatBrokenDates, CachedBrokenDateLength, days);
+		outDates.assign(days.begin(), days.end());
+	}
+	else if (ProcessPool && ProcessPool->ShouldSplit(dateCount) && !NativeBackend)
+	{
+		std::vector<int64> days;
+		ProcessPool->CombineDates(flatBrokenDates, CachedBrokenDateLength, days);
+		outDates.assign(days.begin(), days.end());
+	}
+	else if (ScriptMethods->CombineDates.IsValid() && !NativeBackend)
+	{
+		std::vector<int64> days;
+		TBScopedGil gil;
+		py::object result = LongScriptMethod(py::object, CombineDates, Int64SpanToMemoryView(flatBrokenDates));
+		PythonObjectToInt64Vector(result, days);
+		if (days.size() != dateCount)
+		{
+			TBLog::Error("%0: Calendar script '%1' returned %2 days for %3 dates.", __FUNCTION__, ScriptName,
+				static_cast<int64>(days.size()), static_cast<int64>(dateCount));
+			throw std::runtime_error("Calendar script returned a malformed batch of combined dates.");
+		}
+		outDates.assign(days.begin(), days.end());
+	}
+	else
+	{
+		outDates.reserve(dateCount);
+		for (size_t offset = 0; offset < flatBrokenDates.size(); offset += CachedBrokenDateLength)
+		{
+			std::span<const int64> components = flatBrokenDates.subspan(offset, CachedBrokenDateLength);
+			int64 nativeDay = 0;
+			if (NativeBackend && NativeBackend->CombineDate(components, nativeDay))
+			{
+				outDates.push_back(nativeDay);
+			}
+			else
+			{
+				outDates.push_back(CombineDate(TBBrokenDate(components.begin(), components.end())));
+			}
+		}
+	}
+}
+
+void TBCalendarSystem::FormatDates(std::span<const TBDate> dates, QStringList& outFormattedDates) const
+{
+	outFormattedDates.clear();
+	if (dates.empty())
+	{
+		return;
+	}
+
+	outFormattedDates.reserve(dates.size());
+
+	if (FormatProgram)
+	{
+		std::vector<int64> flatBrokenDates;
+		BreakDates(dates, flatBrokenDates);
+		std::span<const int64> allComponents(flatBrokenDates);
+		for (size_t dateIndex = 0; dateIndex < dates.size(); dateIndex++)
+		{
+			QString formatted;
+			if (!FormatProgram->Format(dates[dateIndex].GetDays(), allComponents.subspan(dateIndex * CachedBrokenDateLength, CachedBrokenDateLength), formatted))
+			{
+				formatted = FormatDate(dates[dateIndex]);
+			}
+			outFormattedDates.append(std::move(formatted));
+		}
+	}
+	else if (InterpreterPool && InterpreterPool->ShouldSplit(dates.size()))
+	{
+		std::span<const int64> days(reinterpret_cast<const int64*>(dates.data()), dates.size());
+		std::vector<std::string> result;
+		InterpreterPool->FormatDates(days, result);
+		for (const std::string& formattedDate : result)
+		{
+			outFormattedDates.append(QString::fromStdString(formattedDate));
+		}
+	}
+	else if (ProcessPool && ProcessPool->ShouldSplit(dates.size()))
+	{
+		std::span<const int64> days(reinterpret_cast<const int64*>(dates.data()), dates.size());
+		std::vector<std::string> result;
+		ProcessPool->FormatDates(days, result);
+		for (const std::string& formattedDate : result)
+		{
+			outFormattedDates.append(QString::fromStdString(formattedDate));
+		}
+	}
+	else if (ScriptMethods->FormatDates.IsValid())
+	{
+		std::span<const int64> days(reinterpret_cast<const int64*>(dates.data()), dates.size());
+		TBScopedGil gil;
+		std::vector<std::string> result = LongScriptMethod(std::vector<std::string>, FormatDates, Int64SpanToMemoryView(days));
+		if (result.size() != dates.size())
+		{
+			TBLog::Error("%0: Calendar script '%1' returned %2 strings for %3 dates.", __FUNCTION__, ScriptName,
+				static_cast<int64>(result.size()), static_cast<int64>(dates.size()));
+			throw std::runtime_error("Calendar script returned a malformed batch of formatted dates.");
+		}
+		for (const std::string& formattedDate : result)
+		{
+			outFormattedDates.append(QString::fromStdString(formattedDate));
+		}
+	}
+	else
+	{
+		for (TBDate date : dates)
+		{
+			outFormattedDates.append(FormatDate(date));
+		}
+	}
+}
+
+/*
+	Asynchronous calls
+*/
+
+// Works through a batch on the calendar executor, one chunk per step.  runChunk converts a chunk of the input and
+// appends it to the result.
+template<typename ResultType, typename InputType, typename ChunkFunction>
+static QFuture<ResultType> RunBatchAsync(const TBCalendarSystem* owner, TBCalendarPriority priority, std::vector<InputType>&& inputs,
+	size_t valuesPerItem, ChunkFunction runChunk)
+{
+	struct BatchState
+	{
+		std::vector<InputType> Inputs;
+		ResultType Result;
+		size_t NextValue = 0;
+	};
+	std::shared_ptr<BatchState> state = std::make_shared<BatchState>();
+	state->Inputs = std::move(inputs);
+
+	return TBCalendarExecutor::Get().Submit<ResultType>(owner, priority, [state, valuesPerItem, runChunk](QPromise<ResultType>& promise)
+	{
+		if (state->NextValue == 0)
+		{
+			promise.setProgressRange(0, static_cast<int>(state->Inputs.size() / valuesPerItem));
+		}
+
+		const size_t chunkValues = std::min(TBCalendarSystem::AsyncChunkItems * valuesPerItem, state->Inputs.size() - state->NextValue);
+		runChunk(std::span<const InputType>(state->Inputs).subspan(state->NextValue, chunkValues), state->Result);
+		state->NextValue += chunkValues;
+		promise.setProgressValue(static_cast<int>(state->NextValue / valuesPerItem));
+
+		if (state->NextValue < state->Inputs.size())
+		{
+			return false;
+		}
+		promise.addResult(std::move(state->Result));
+		return true;
+	});
+}
+
+QFuture<TBBrokenDate> TBCalendarSystem::BreakDateAsync(TBDate date, TBCalendarPriority priority) const
+{
+	return TBCalendarExecutor::Get().Submit<TBBrokenDate>(this, priority, [this, date](QPromise<TBBrokenDate>& promise)
+	{
+		TBBrokenDate brokenDate;
+		BreakDate(date, brokenDate);
+		promise.addResult(brokenDate);
+		return true;
+	});
+}
+
+QFuture<TBDate> TBCalendarSystem::CombineDateAsync(const TBBrokenDate& brokenDate, TBCalendarPriority priority) const
+{
+	return TBCalendarExecutor::Get().Submit<TBDate>(this, priority, [this, brokenDate](QPromise<TBDate>& promise)
+	{
+		promise.addResult(CombineDate(brokenDate));
+		return true;
+	});
+}
+
+QFuture<QString> TBCalendarSystem::FormatDateAsync(TBDate date, TBCalendarPriority priority) const
+{
+	return TBCalendarExecutor::Get().Submit<QString>(this, priority, [this, date](QPromise<QString>& promise)
+	{
+		promise.addResult(FormatDate(date));
+		return true;
+	});
+}
+
+QFuture<std::vector<int64>> TBCalendarSystem::BreakDatesAsync(std::vector<TBDate> dates, TBCalendarPriority priority) const
+{
+	return RunBatchAsync<std::vector<int64>>(this, priority, std::move(dates), 1,
+		[this](std::span<const TBDate> chunk, std::vector<int64>& result)
+		{
+			std::vector<int64> chunkResult;
+			BreakDates(chunk, chunkResult);
+			result.insert(result.end(), chunkResult.begin(), chunkResult.end());
+		});
+}
+
+QFuture<std::vector<TBDate>> TBCalendarSystem::CombineDatesAsync(std::vector<int64> flatBrokenDates, TBCalendarPriority priority) const
+{
+	// Chunks have to hold whole dates.  A bad length still gets through to CombineDates(), which reports it.
+	const size_t valuesPerItem = static_cast<size_t>(std::max<int32>(CachedBrokenDateLength, 1));
+	return RunBatchAsync<std::vector<TBDate>>(this, priority, std::move(flatBrokenDates), valuesPerItem,
+		[this](std::span<const int64> chunk, std::vector<TBDate>& result)
+		{
+			std::vector<TBDate> chunkResult;
+			CombineDates(chunk, chunkResult);
+			result.insert(result.end(), chunkResult.begin(), chunkResult.end());
+		});
+}
+
+QFuture<QStringList> TBCalendarSystem::FormatDatesAsync(std::vector<TBDate> dates, TBCalendarPriority priority) const
+{
+	return RunBatchAsync<QStringList>(this, priority, std::move(dates), 1,
+		[this](std::span<const TBDate> chunk, QStringList& result)
+		{
+			QStringList chunkResult;
+			FormatDates(chunk, chunkResult);
+			result.append(chunkResult);
+		});
+}
+
+void TBCalendarSystem::GetUnitBoundaries(TBDate startDate, TBDate endDate, TBTickUnit unit, std::vector<TBDate>& outBoundaries) const
+{
+	TickGenerator.GetBoundaries(*this, startDate, endDate, unit, outBoundaries);
 }
 
 int32 TBCalendarSystem::GetBrokenDateLength() const
@@ -170,4 +1197,20 @@ QString TBCalendarSystem::GetDateFormat() const
 QString TBCalendarSystem::GetTimespanFormat() const
 {
 	return CachedTimespanFormat;
+}
+
+void TBCalendarSystem::BypassFastPaths()
+{
+	NativeBackend = nullptr;
+	FormatProgram.reset();
+	DayResultCache.Reset(0, 0);
+	BrokenDateResultCache.Reset(0, 0);
+	TickGenerator.Clear();
+}
+
+TBCacheStats TBCalendarSystem::GetCacheStats() const
+{
+	const TBCacheStats dayStats = DayResultCache.GetStats();
+	const TBCacheStats brokenDateStats = BrokenDateResultCache.GetStats();
+	return { dayStats.Hits + brokenDateStats.Hits, dayStats.Misses + brokenDateStats.Misses };
 }
\ No newline at end of file
@@ -20,11 +20,24 @@
 #include "CommonTypes.h"
 #include "JsonableObject.h"
 #include "Time.h"
+#include "CalendarCache.h"
+#include "CalendarExecutor.h"
+#include "ScriptResult.h"
+#include "ScriptWatchdog.h"
+#include "TickGenerator.h"
 
+#include <QtCore/QByteArray>
 #include <QtCore/QString>
+#include <QtCore/QVariant>
+#include <QtCore/QStringList>
 #include <QtCore/QList>
+#include <QtCore/QFuture>
+#include <QtCore/QUuid>
 
+#include <atomic>
 #include <memory>
+#include <span>
+#include <vector>
 
 // Forward-declaring
 namespace pybind11
@@ -33,19 +46,42 @@ namespace pybind11
 	class object;
 }
 
+class TBCalendarProcessPool;
+class TBDateFormatProgram;
+class TBNativeCalendar;
+class TBNativeDateBackend;
+class TBPeriodicCalendar;
+class TBScriptInterpreterPool;
+class TBYearIndexCalendar;
+struct TBCalendarScriptMethods;
+
 class TBCalendarSystem : public JsonableObject
 {
 public:
 	TBCalendarSystem();
+	~TBCalendarSystem();
 
 	virtual bool LoadFromJson(const QJsonObject& jsonObject) override;
 	virtual void PopulateJson(QJsonObject& jsonObject) const override;
 
+	QUuid GetID() const { return CalendarID; }
 	QString GetName() const { return Name; }
 	QString GetDescription() const { return Description; }
-
-	bool InitializeScript();
-
+	QString GetScriptName() const { return ScriptName; }
+
+	// Can be called again to reload the script after it changes, which cancels pending async work and empties the
+	// caches.  Callers have to make sure nothing else is using the calendar meanwhile.  reloadModule re-imports the
+	// script module even if this calendar hasn't imported it before, so that a new instance picks up a changed file.
+	bool InitializeScript(bool reloadModule = false);
+	// Different every time any calendar's script is (re-)initialized.  Anything computed from this calendar and kept
+	// around can compare this against the value it was computed under, to tell whether it's out of date.
+	uint64 GetScriptGeneration() const { return ScriptGeneration; }
+	// Set by the calendar registry once a reload has put a new instance in this one's place.  This one keeps working
+	// for whoever still holds it, but they should fetch the calendar from the registry again.
+	bool IsReplaced() const { return Replaced; }
+	void MarkReplaced() { Replaced = true; }
+
+	// These can be called from any thread, and only take the GIL when the script is needed.
 	QString FormatDate(TBDate date) const;
 	QString FormatDate(const TBBrokenDate& date) const;
 	QString FormatDateSpan(TBDate startDate, TBDate endDate) const;
@@ -56,20 +92,115 @@ public:
 	TBDate MoveDate(TBDate startDate, const TBBrokenTimespan& deltaTime) const;
 	bool ValidateBrokenDate(const TBBrokenDate& testDate) const;
 
+	// Non-throwing variants of the above, for bulk work where failures are expected (like checking imported dates).
+	// Script errors come back in the result instead of being logged and thrown, and their messages are only
+	// formatted if asked for.
+	TBScriptResult<QString> TryFormatDate(TBDate date) const;
+	TBScriptResult<TBBrokenDate> TryBreakDate(TBDate date) const;
+	TBScriptResult<TBDate> TryCombineDate(const TBBrokenDate& brokenDate) const;
+	TBScriptResult<TBDate> TryMoveDate(TBDate startDate, const TBBrokenTimespan& deltaTime) const;
+	TBScriptResult<bool> TryValidateBrokenDate(const TBBrokenDate& testDate) const;
+
+	// Batch variants of the above.  Each makes a single call into the script if it provides the matching batch
+	// function (break_dates, combine_dates, format_dates), and otherwise loops over the scalar functions.
+	// Large batches are split across the script interpreter pool when there is one, or the worker process pool.
+	// Broken dates are passed around flattened, GetBrokenDateLength() values per date.
+	void BreakDates(std::span<const TBDate> dates, std::vector<int64>& outFlatBrokenDates) const;
+	void CombineDates(std::span<const int64> flatBrokenDates, std::vector<TBDate>& outDates) const;
+	void FormatDates(std::span<const TBDate> dates, QStringList& outFormattedDates) const;
+
+	// Asynchronous variants, run on the calendar executor thread.  Batches go through in chunks of AsyncChunkItems, so
+	// canceling the future stops them at the next chunk and higher priority requests don't wait for the whole batch.
+	// Exceptions from the script rethrow from the future's result().  Pending work is canceled when the script is
+	// reinitialized or the calendar system is destroyed.  Don't block on these futures while holding the GIL.
+	static constexpr size_t AsyncChunkItems = 4096;
+	QFuture<TBBrokenDate> BreakDateAsync(TBDate date, TBCalendarPriority priority = TBCalendarPriority::Normal) const;
+	QFuture<TBDate> CombineDateAsync(const TBBrokenDate& brokenDate, TBCalendarPriority priority = TBCalendarPriority::Normal) const;
+	QFuture<QString> FormatDateAsync(TBDate date, TBCalendarPriority priority = TBCalendarPriority::Normal) const;
+	QFuture<std::vector<int64>> BreakDatesAsync(std::vector<TBDate> dates, TBCalendarPriority priority = TBCalendarPriority::Normal) const;
+	QFuture<std::vector<TBDate>> CombineDatesAsync(std::vector<int64> flatBrokenDates, TBCalendarPriority priority = TBCalendarPriority::Normal) const;
+	QFuture<QStringList> FormatDatesAsync(std::vector<TBDate> dates, TBCalendarPriority priority = TBCalendarPriority::Normal) const;
+
+	// Replaces outBoundaries with the day of every unit boundary in [startDate, endDate), in order, for drawing axis
+	// ticks.  Takes a couple of batch calls rather than one per tick, and each unit remembers the range it last
+	// covered, so panning at one zoom level only works out the newly exposed days.
+	void GetUnitBoundaries(TBDate startDate, TBDate endDate, TBTickUnit unit, std::vector<TBDate>& outBoundaries) const;
+
 	int32 GetBrokenDateLength() const;
 	QString GetDateFormat() const;
 	QString GetTimespanFormat() const;
 
+	// Combined hit/miss counts for the per-date result caches since the script was last initialized.
+	TBCacheStats GetCacheStats() const;
+
+	// Whether single-date calls try native rules, or the native date format, before the script.
+	bool HasNativeBackend() const { return NativeBackend != nullptr; }
+	bool HasFormatProgram() const { return FormatProgram != nullptr; }
+	// For benchmarking the script itself.  Sends every call straight to the script, past the native rules, the native
+	// date format and the result caches, until the script is initialized again.  Nothing else can be using the
+	// calendar meanwhile.
+	void BypassFastPaths();
+
+	// Open while the script keeps running past its time budget.  Closed again by reinitializing the script.
+	TBScriptCircuitBreaker& GetCircuitBreaker() const { return CircuitBreaker; }
+
 private:
+	// Spot-checks the native rules against the script, since nothing else makes sure they describe the same calendar.
+	bool CheckNativeRules();
+	// Looks for a repeating cycle in the script's dates, and answers from a table of one cycle if there is one.  The
+	// probe's result is saved, and reused until the script changes.
+	void ProbePeriodicity();
+	// Indexes where each month of the configured years begins, loading the index from the cache if the script hasn't
+	// changed since it was saved.
+	void BuildYearIndex();
+	// Tables built from the script are only good for the exact script they came from, so they're saved along with
+	// this.  Empty if the script's file can't be read.
+	QByteArray HashScriptFile() const;
+	// Where a table built from the script is saved, in the user cache folder.
+	QString GetCacheFilePath(const QString& extension) const;
+	void ResetResultCaches();
+	// Builds FormatProgram if the script exports name tables through get_format_tables().
+	void CompileDateFormat();
+
+	// Timelines and eras refer to calendars by this.  Descriptors without an "id" get one derived from the script name.
+	QUuid CalendarID;
 	QString Name;
 	QString ScriptName;
 	QString Description;
 
 	std::unique_ptr<pybind11::module_> CalendarScript;
 	std::unique_ptr<pybind11::object> CalendarObject;
+	std::unique_ptr<TBCalendarScriptMethods> ScriptMethods;
+	// Extra interpreters for large batch calls, if the system config asks for them.
+	std::unique_ptr<TBScriptInterpreterPool> InterpreterPool;
+	// Worker processes for large batch calls, used instead when there are no extra interpreters.
+	std::unique_ptr<TBCalendarProcessPool> ProcessPool;
+	// Formats full dates without calling the script, when the script allows it.
+	std::unique_ptr<TBDateFormatProgram> FormatProgram;
+
+	// Optional native rules from the calendar's JSON.  When present, breaking, combining, moving and validating dates
+	// are done natively and the script is only used for formatting.
+	std::unique_ptr<TBNativeCalendar> NativeRules;
+	// Built by InitializeScript() for calendars without native rules whose dates turn out to repeat.
+	std::unique_ptr<TBPeriodicCalendar> PeriodicTable;
+	// Built by InitializeScript() for calendars without native rules that don't repeat either.
+	std::unique_ptr<TBYearIndexCalendar> YearIndex;
+	// Whichever of the above is in use, if any.  Calls it can't answer go to the script.
+	const TBNativeDateBackend* NativeBackend;
 
 	// These values won't change during script execution, so we cache them right after initializing the script
 	int32 CachedBrokenDateLength;
 	QString CachedDateFormat;
 	QString CachedTimespanFormat;
+	std::atomic<uint64> ScriptGeneration;
+	std::atomic<bool> Replaced;
+
+	// Memoized script results, keyed by day number or by broken date.  Only calls that actually go to the script are
+	// cached; native rules are cheaper than a lookup.  Capacity comes from the system config and the caches are
+	// emptied whenever the script is (re-)initialized.
+	mutable TBShardedCache<TBDayCacheKey, QVariant> DayResultCache;
+	mutable TBShardedCache<TBBrokenDateCacheKey, QVariant> BrokenDateResultCache;
+	// Axis tick boundaries, cached per unit.  Emptied along with the result caches.
+	mutable TBTickGenerator TickGenerator;
+	mutable TBScriptCircuitBreaker CircuitBreaker;
 };
\ No newline at end of file
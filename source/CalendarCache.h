@@ -0,0 +1,174 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (CalendarCache.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+#include "Time.h"
+
+#include <QtCore/QCache>
+#include <QtCore/QHashFunctions>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+struct TBCacheStats
+{
+	uint64 Hits;
+	uint64 Misses;
+};
+
+/*
+	Bounded memoization cache, split into independently locked shards so that concurrent lookups rarely contend.
+	Each shard is a QCache, so eviction is least-recently-used within a shard.
+
+	Lookups share a lock on the set of shards, which Reset() takes for itself while it swaps in a new set.
+*/
+template<typename KeyType, typename ValueType>
+class TBShardedCache
+{
+public:
+	TBShardedCache() : ShardsMutex(), Shards(), Hits(0), Misses(0) {}
+
+	// Throws away all entries and counters.  A capacity of zero disables the cache.
+	void Reset(int32 capacity, int32 shardCount)
+	{
+		// Built before taking the lock, so that lookups only wait for the swap.  The old shards are freed after it.
+		std::vector<std::unique_ptr<Shard>> newShards;
+		if (capacity > 0 && shardCount > 0)
+		{
+			shardCount = std::min(shardCount, capacity);
+			const int32 shardCapacity = (capacity + shardCount - 1) / shardCount;
+			newShards.reserve(shardCount);
+			for (int32 shardIndex = 0; shardIndex < shardCount; shardIndex++)
+			{
+				std::unique_ptr<Shard>& shard = newShards.emplace_back(std::make_unique<Shard>());
+				shard->Entries.setMaxCost(shardCapacity);
+			}
+		}
+
+		std::unique_lock lock(ShardsMutex);
+		Shards.swap(newShards);
+		Hits = 0;
+		Misses = 0;
+	}
+
+	bool Find(const KeyType& key, ValueType& outValue)
+	{
+		std::shared_lock shardsLock(ShardsMutex);
+		if (Shards.empty())
+		{
+			return false;
+		}
+
+		Shard& shard = GetShard(key);
+		{
+			std::scoped_lock lock(shard.Mutex);
+			if (const ValueType* cachedValue = shard.Entries.object(key))
+			{
+				outValue = *cachedValue;
+				Hits++;
+				return true;
+			}
+		}
+
+		Misses++;
+		return false;
+	}
+
+	void Insert(const KeyType& key, const ValueType& value)
+	{
+		std::shared_lock shardsLock(ShardsMutex);
+		if (Shards.empty())
+		{
+			return;
+		}
+
+		Shard& shard = GetShard(key);
+		std::scoped_lock lock(shard.Mutex);
+		shard.Entries.insert(key, new ValueType(value));
+	}
+
+	bool IsEnabled() const
+	{
+		std::shared_lock shardsLock(ShardsMutex);
+		return !Shards.empty();
+	}
+
+	TBCacheStats GetStats() const { return { Hits, Misses }; }
+
+private:
+	struct Shard
+	{
+		std::mutex Mutex;
+		QCache<KeyType, ValueType> Entries;
+	};
+
+	Shard& GetShard(const KeyType& key)
+	{
+		return *Shards[qHash(key) % Shards.size()];
+	}
+
+	mutable std::shared_mutex ShardsMutex;
+	// Shards hold a mutex, so they can't be moved around by the vector.
+	std::vector<std::unique_ptr<Shard>> Shards;
+	std::atomic<uint64> Hits;
+	std::atomic<uint64> Misses;
+};
+
+/*
+	Keys for TBCalendarSystem's result caches.  Results from different script functions share a cache, so the function
+	is part of the key.
+*/
+enum class TBCachedCalendarCall : uint8
+{
+	FormatDate,
+	FormatBrokenDate,
+	BreakDate,
+	CombineDate,
+	ValidateBrokenDate
+};
+
+struct TBDayCacheKey
+{
+	TBCachedCalendarCall Call;
+	int64 Day;
+
+	bool operator==(const TBDayCacheKey& other) const { return Call == other.Call && Day == other.Day; }
+};
+
+struct TBBrokenDateCacheKey
+{
+	TBCachedCalendarCall Call;
+	TBBrokenDate Date;
+
+	bool operator==(const TBBrokenDateCacheKey& other) const { return Call == other.Call && Date == other.Date; }
+};
+
+inline size_t qHash(const TBDayCacheKey& key, size_t seed = 0)
+{
+	return qHashMulti(seed, static_cast<uint8>(key.Call), key.Day);
+}
+
+inline size_t qHash(const TBBrokenDateCacheKey& key, size_t seed = 0)
+{
+	return qHashMulti(seed, static_cast<uint8>(key.Call), key.Date);
+}
\ No newline at end of file
@@ -0,0 +1,141 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (CalendarConverter.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "CalendarConverter.h"
+#include "Calendar.h"
+
+#include <algorithm>
+#include <utility>
+
+TBCalendarConverter::TBCalendarConverter(std::shared_ptr<const TBCalendarSystem> sourceCalendar, std::shared_ptr<const TBCalendarSystem> targetCalendar) :
+	SourceCalendar(std::move(sourceCalendar)),
+	TargetCalendar(std::move(targetCalendar)),
+	SourceGeneration(SourceCalendar->GetScriptGeneration()),
+	TargetGeneration(TargetCalendar->GetScriptGeneration()),
+	AnchorMutex(),
+	Anchors()
+{}
+
+bool TBCalendarConverter::IsCurrent() const
+{
+	return SourceCalendar->GetScriptGeneration() == SourceGeneration && TargetCalendar->GetScriptGeneration() == TargetGeneration
+		&& !SourceCalendar->IsReplaced() && !TargetCalendar->IsReplaced();
+}
+
+TBBrokenDate TBCalendarConverter::ConvertDate(const TBBrokenDate& sourceDate) const
+{
+	if (IsCurrent())
+	{
+		std::scoped_lock lock(AnchorMutex);
+		auto anchor = Anchors.constFind(sourceDate);
+		if (anchor != Anchors.constEnd())
+		{
+			return anchor.value();
+		}
+	}
+
+	if (SourceCalendar == TargetCalendar)
+	{
+		return sourceDate;
+	}
+
+	TBBrokenDate targetDate;
+	TargetCalendar->BreakDate(SourceCalendar->CombineDate(sourceDate), targetDate);
+	return targetDate;
+}
+
+void TBCalendarConverter::ConvertDates(std::span<const TBBrokenDate> sourceDates, std::vector<TBBrokenDate>& outTargetDates) const
+{
+	outTargetDates.assign(sourceDates.size(), TBBrokenDate());
+	if (SourceCalendar == TargetCalendar)
+	{
+		std::copy(sourceDates.begin(), sourceDates.end(), outTargetDates.begin());
+		return;
+	}
+
+	// Everything that isn't an anchor, split by whether it can go into a combine batch.
+	const int32 sourceLength = SourceCalendar->GetBrokenDateLength();
+	std::vector<size_t> batchIndices;
+	std::vector<int64> flatSourceDates;
+	std::vector<size_t> partialIndices;
+	{
+		const bool useAnchors = IsCurrent();
+		std::scoped_lock lock(AnchorMutex);
+		for (size_t dateIndex = 0; dateIndex < sourceDates.size(); dateIndex++)
+		{
+			const TBBrokenDate& sourceDate = sourceDates[dateIndex];
+			auto anchor = useAnchors ? Anchors.constFind(sourceDate) : Anchors.constEnd();
+			if (anchor != Anchors.constEnd())
+			{
+				outTargetDates[dateIndex] = anchor.value();
+			}
+			else if (sourceDate.length() == sourceLength)
+			{
+				batchIndices.push_back(dateIndex);
+				flatSourceDates.insert(flatSourceDates.end(), sourceDate.begin(), sourceDate.end());
+			}
+			else
+			{
+				partialIndices.push_back(dateIndex);
+			}
+		}
+	}
+
+	std::vector<TBDate> days;
+	SourceCalendar->CombineDates(flatSourceDates, days);
+	for (size_t dateIndex : partialIndices)
+	{
+		batchIndices.push_back(dateIndex);
+		days.push_back(SourceCalendar->CombineDate(sourceDates[dateIndex]));
+	}
+
+	std::vector<TBBrokenDate> targetDates;
+	ConvertDays(days, targetDates);
+	for (size_t dayIndex = 0; dayIndex < batchIndices.size(); dayIndex++)
+	{
+		outTargetDates[batchIndices[dayIndex]] = targetDates[dayIndex];
+	}
+}
+
+void TBCalendarConverter::ConvertDays(std::span<const TBDate> days, std::vector<TBBrokenDate>& outTargetDates) const
+{
+	std::vector<int64> flatTargetDates;
+	TargetCalendar->BreakDates(days, flatTargetDates);
+
+	const size_t targetLength = TargetCalendar->GetBrokenDateLength();
+	outTargetDates.resize(days.size());
+	for (size_t dayIndex = 0; dayIndex < days.size(); dayIndex++)
+	{
+		const int64* components = flatTargetDates.data() + dayIndex * targetLength;
+		outTargetDates[dayIndex] = TBBrokenDate(components, components + targetLength);
+	}
+}
+
+void TBCalendarConverter::AddAnchor(const TBBrokenDate& sourceDate)
+{
+	// Converted outside the lock, since it may call into a script.
+	const TBBrokenDate targetDate = ConvertDate(sourceDate);
+
+	std::scoped_lock lock(AnchorMutex);
+	Anchors.insert(sourceDate, targetDate);
+}
+
+int64 TBCalendarConverter::GetAnchorCount() const
+{
+	std::scoped_lock lock(AnchorMutex);
+	return Anchors.size();
+}
\ No newline at end of file
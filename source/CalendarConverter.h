@@ -0,0 +1,70 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (CalendarConverter.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+#include "Time.h"
+
+#include <QtCore/QHash>
+
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+class TBCalendarSystem;
+
+/*
+	Converts broken dates from one calendar system into another.  Every calendar counts the same days, so a date is
+	combined into its day number in the source calendar and broken again in the target.  Bulk conversions do that as
+	one combine batch and one break batch, rather than a couple of script calls per date.
+
+	Dates that lots of things refer to, like the bounds of an era, can be added as anchors.  Anchors are converted once
+	and looked up from then on, until either calendar's script is reloaded.
+*/
+class TBCalendarConverter
+{
+public:
+	TBCalendarConverter(std::shared_ptr<const TBCalendarSystem> sourceCalendar, std::shared_ptr<const TBCalendarSystem> targetCalendar);
+
+	const TBCalendarSystem& GetSourceCalendar() const { return *SourceCalendar; }
+	const TBCalendarSystem& GetTargetCalendar() const { return *TargetCalendar; }
+	// False once either calendar has been reloaded or replaced in the registry since the converter was made.
+	// Conversions still work, but skip the anchors, so owners should make a new converter.
+	bool IsCurrent() const;
+
+	// Partial dates are allowed, and are combined one at a time since they can't go in a batch.  Throws if either
+	// calendar's script fails, the same as the calendar calls do.
+	TBBrokenDate ConvertDate(const TBBrokenDate& sourceDate) const;
+	void ConvertDates(std::span<const TBBrokenDate> sourceDates, std::vector<TBBrokenDate>& outTargetDates) const;
+	// Day numbers are already shared by every calendar, so this is just a break in the target calendar.
+	void ConvertDays(std::span<const TBDate> days, std::vector<TBBrokenDate>& outTargetDates) const;
+
+	// Converts sourceDate now and keeps the result.  Safe to call while other threads are converting.
+	void AddAnchor(const TBBrokenDate& sourceDate);
+	int64 GetAnchorCount() const;
+
+private:
+	std::shared_ptr<const TBCalendarSystem> SourceCalendar;
+	std::shared_ptr<const TBCalendarSystem> TargetCalendar;
+	uint64 SourceGeneration;
+	uint64 TargetGeneration;
+
+	mutable std::mutex AnchorMutex;
+	QHash<TBBrokenDate, TBBrokenDate> Anchors;
+};
\ No newline at end of file
@@ -0,0 +1,186 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (CalendarExecutor.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PyBind.h"		// This has to come first to not conflict with Qt defines.
+#include "CalendarExecutor.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+TBCalendarExecutor* TBCalendarExecutor::singleton = nullptr;
+
+TBCalendarExecutor::TBCalendarExecutor() :
+	Thread(),
+	QueueMutex(),
+	QueueCondition(),
+	StepFinishedCondition(),
+	Queues(),
+	RunningOwner(nullptr),
+	Stopping(false)
+{
+	Thread = std::thread(&TBCalendarExecutor::ThreadMain, this);
+}
+
+TBCalendarExecutor::~TBCalendarExecutor()
+{
+	{
+		std::unique_lock lock(QueueMutex);
+		Stopping = true;
+		CancelQueued(nullptr);
+		WaitForRunning(lock, nullptr);
+	}
+	QueueCondition.notify_all();
+	Thread.join();
+}
+
+void TBCalendarExecutor::Initialize()
+{
+	if (singleton != nullptr)
+	{
+		throw std::runtime_error("TBCalendarExecutor singleton already initialized!");
+	}
+	else
+	{
+		singleton = new TBCalendarExecutor();
+	}
+}
+
+void TBCalendarExecutor::Cleanup()
+{
+	if (singleton != nullptr)
+	{
+		delete singleton;
+		singleton = nullptr;
+	}
+}
+
+void TBCalendarExecutor::Enqueue(Task&& task)
+{
+	{
+		std::scoped_lock lock(QueueMutex);
+		if (Stopping)
+		{
+			task.Cancel();
+			return;
+		}
+		Queues[static_cast<size_t>(task.Priority)].push_back(std::move(task));
+	}
+	QueueCondition.notify_one();
+}
+
+void TBCalendarExecutor::CancelOwner(const void* owner)
+{
+	// A task can't wait for itself.
+	if (std::this_thread::get_id() == Thread.get_id())
+	{
+		return;
+	}
+
+	// A step that was running may put its task back in the queue when it finishes, so keep going until nothing for
+	// owner is queued or running.
+	std::unique_lock lock(QueueMutex);
+	while (true)
+	{
+		CancelQueued(owner);
+		if (RunningOwner != owner)
+		{
+			break;
+		}
+		WaitForRunning(lock, owner);
+	}
+}
+
+void TBCalendarExecutor::CancelQueued(const void* owner)
+{
+	for (std::deque<Task>& queue : Queues)
+	{
+		std::erase_if(queue, [owner](Task& task)
+		{
+			if (owner != nullptr && task.Owner != owner)
+			{
+				return false;
+			}
+			task.Cancel();
+			return true;
+		});
+	}
+}
+
+void TBCalendarExecutor::WaitForRunning(std::unique_lock<std::mutex>& lock, const void* owner)
+{
+	auto isClear = [this, owner]() { return RunningOwner == nullptr || (owner != nullptr && RunningOwner != owner); };
+	if (isClear())
+	{
+		return;
+	}
+
+	TBScopedGilRelease releaseGil;
+	StepFinishedCondition.wait(lock, isClear);
+	if (releaseGil.IsReleased())
+	{
+		// Retaking the GIL while holding QueueMutex could deadlock against a step that's waiting to enqueue.
+		lock.unlock();
+		releaseGil.Restore();
+		lock.lock();
+	}
+}
+
+void TBCalendarExecutor::ThreadMain()
+{
+	std::unique_lock lock(QueueMutex);
+	while (true)
+	{
+		QueueCondition.wait(lock, [this]()
+		{
+			return Stopping || std::any_of(Queues.begin(), Queues.end(), [](const std::deque<Task>& queue) { return !queue.empty(); });
+		});
+		if (Stopping)
+		{
+			break;
+		}
+
+		// Highest priority first.
+		auto nextQueue = std::find_if(Queues.rbegin(), Queues.rend(), [](const std::deque<Task>& queue) { return !queue.empty(); });
+		Task task = std::move(nextQueue->front());
+		nextQueue->pop_front();
+
+		if (task.IsCanceled())
+		{
+			task.Cancel();
+			continue;
+		}
+
+		RunningOwner = task.Owner;
+		lock.unlock();
+		const bool finished = task.Step();
+		lock.lock();
+		RunningOwner = nullptr;
+
+		if (!finished)
+		{
+			if (Stopping)
+			{
+				task.Cancel();
+			}
+			else
+			{
+				Queues[static_cast<size_t>(task.Priority)].push_back(std::move(task));
+			}
+		}
+		StepFinishedCondition.notify_all();
+	}
+}
\ No newline at end of file
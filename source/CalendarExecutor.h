@@ -0,0 +1,146 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (CalendarExecutor.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+
+#include <QtCore/QFuture>
+#include <QtCore/QPromise>
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Higher priorities always run first.  Within a priority, tasks run in the order they were submitted.
+enum class TBCalendarPriority : uint8
+{
+	Background,
+	Normal,
+	Visible,
+
+	Count
+};
+
+/*
+	Single thread that runs calendar work off the GUI thread.  The GIL is only taken for the parts of a task that
+	actually call into a script, so tasks answered natively never wait on Python.
+
+	Tasks are run one step at a time, and a task that isn't finished after a step goes to the back of its priority's
+	queue.  That way a long batch only holds up a newly submitted, higher priority task for a single step.  Canceling
+	a task's future drops it before its next step.
+*/
+class TBCalendarExecutor
+{
+private:
+	static TBCalendarExecutor* singleton;
+
+	// Restrict these to private to enforce singleton-ness
+	TBCalendarExecutor();
+	TBCalendarExecutor(const TBCalendarExecutor& other) = delete;
+	TBCalendarExecutor& operator=(const TBCalendarExecutor& other) = delete;
+	~TBCalendarExecutor();
+
+public:
+	// Static initialization and access
+	static void Initialize();
+	static bool IsInitialized() { return singleton != nullptr; }
+	static TBCalendarExecutor& Get() { return *singleton; }
+	// Cancels everything still queued and waits for the running step to finish.
+	static void Cleanup();
+
+	// Queues a task.  step is called on the executor thread until it returns true, and should add its result to the
+	// promise before doing so.  An exception thrown from step finishes the task, and rethrows from the future's result().
+	// owner identifies whoever the task works on, for CancelOwner().
+	template<typename T>
+	QFuture<T> Submit(const void* owner, TBCalendarPriority priority, std::function<bool(QPromise<T>&)> step);
+
+	// Cancels every task for owner and waits for any step of one that's running.  Call before owner goes away.
+	void CancelOwner(const void* owner);
+
+private:
+	struct Task
+	{
+		const void* Owner;
+		TBCalendarPriority Priority;
+		// Returns true once the task is finished.
+		std::function<bool()> Step;
+		std::function<bool()> IsCanceled;
+		// Finishes the task's future as canceled without running it any further.
+		std::function<void()> Cancel;
+	};
+
+	void Enqueue(Task&& task);
+	void ThreadMain();
+	// Cancels queued tasks for owner, or for everyone if owner is null.  QueueMutex must be held.
+	void CancelQueued(const void* owner);
+	// Blocks until the running step (if any) isn't for owner.  Gives up the GIL while waiting, since the step may need it.
+	void WaitForRunning(std::unique_lock<std::mutex>& lock, const void* owner);
+
+	std::thread Thread;
+	std::mutex QueueMutex;
+	std::condition_variable QueueCondition;
+	std::condition_variable StepFinishedCondition;
+	std::array<std::deque<Task>, static_cast<size_t>(TBCalendarPriority::Count)> Queues;
+	// Owner of the task whose step is running right now, or null.
+	const void* RunningOwner;
+	bool Stopping;
+};
+
+template<typename T>
+QFuture<T> TBCalendarExecutor::Submit(const void* owner, TBCalendarPriority priority, std::function<bool(QPromise<T>&)> step)
+{
+	std::shared_ptr<QPromise<T>> promise = std::make_shared<QPromise<T>>();
+	QFuture<T> future = promise->future();
+	promise->start();
+
+	Task task;
+	task.Owner = owner;
+	task.Priority = priority;
+	task.Step = [promise, step = std::move(step)]()
+	{
+		bool finished = true;
+		try
+		{
+			finished = step(*promise);
+		}
+		catch (...)
+		{
+			promise->setException(std::current_exception());
+		}
+
+		if (finished)
+		{
+			promise->finish();
+		}
+		return finished;
+	};
+	task.IsCanceled = [promise]() { return promise->isCanceled(); };
+	task.Cancel = [promise]()
+	{
+		promise->future().cancel();
+		promise->finish();
+	};
+
+	Enqueue(std::move(task));
+	return future;
+}
\ No newline at end of file
@@ -0,0 +1,563 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (CalendarProcessPool.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "CalendarProcessPool.h"
+#include "CalendarScriptRunner.h"
+#include "Logging.h"
+
+#include <QtCore/QCommandLineOption>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QProcess>
+#include <QtCore/QSharedMemory>
+#include <QtNetwork/QLocalServer>
+#include <QtNetwork/QLocalSocket>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <utility>
+
+// Each worker gets this many slots, so that it has its next chunk waiting as soon as it finishes one.
+static constexpr int32 SLOTS_PER_WORKER = 4;
+// Largest chunk put in a single slot.
+static constexpr size_t SLOT_MAX_ITEMS = 4096;
+// Inputs and results share a slot's data area.  This fits a full chunk of maximum-length broken dates both ways,
+// with plenty left over for formatted strings.
+static constexpr size_t SLOT_DATA_BYTES = 512 * 1024;
+// Sent by a worker once its script has loaded.
+static constexpr char WORKER_READY = 'R';
+// How long a new worker gets to connect back to the pool.
+static constexpr int32 WORKER_CONNECT_TIMEOUT_MS = 30000;
+
+static const QString WORKER_OPTION = "calendar-worker";
+static const QString WORKER_SERVER_OPTION = "calendar-worker-server";
+
+enum class TBCalendarProcessPool::Operation : uint32
+{
+	BreakDates,
+	CombineDates,
+	FormatDates
+};
+
+/*
+	One entry in a worker's ring, in shared memory.  The pool fills in the request and the input, then hands the slot
+	over by sending its index; the worker fills in the results and sends the index back.  Only one side touches a
+	slot at a time.
+*/
+struct TBCalendarProcessPool::Slot
+{
+	// Request
+	Operation SlotOperation;
+	uint32 ItemCount;
+	int32 BrokenDateLength;
+
+	// Response.  ProcessedCount can be less than ItemCount if the results didn't all fit.
+	uint32 Failed;
+	uint32 ProcessedCount;
+	uint32 ResultBytes;
+
+	// Input first, then results (or an error message).
+	alignas(8) uint8 Data[SLOT_DATA_BYTES];
+
+	size_t GetInputBytes() const
+	{
+		const size_t valuesPerItem = (SlotOperation == Operation::CombineDates) ? BrokenDateLength : 1;
+		return ItemCount * valuesPerItem * sizeof(int64);
+	}
+
+	const int64* GetInput() const { return reinterpret_cast<const int64*>(Data); }
+	int64* GetInput() { return reinterpret_cast<int64*>(Data); }
+	const uint8* GetResults() const { return Data + GetInputBytes(); }
+	uint8* GetResults() { return Data + GetInputBytes(); }
+	size_t GetResultCapacity() const { return SLOT_DATA_BYTES - GetInputBytes(); }
+};
+
+struct TBCalendarProcessPool::Worker
+{
+	QProcess Process;
+	QSharedMemory Memory;
+	std::unique_ptr<QLocalSocket> Connection;
+
+	// Chunks go into NextSlot and come back in the order they were sent, so the oldest in flight is InFlight.size()
+	// slots behind it.  Each entry is the chunk's first item and item count.
+	int32 NextSlot = 0;
+	std::deque<std::pair<size_t, size_t>> InFlight;
+
+	Slot* GetSlots() { return static_cast<Slot*>(Memory.data()); }
+	int32 GetOldestSlot() const { return (NextSlot - static_cast<int32>(InFlight.size()) + SLOTS_PER_WORKER) % SLOTS_PER_WORKER; }
+	bool IsRunning() const { return Connection && Process.state() == QProcess::Running; }
+};
+
+// Local sockets in blocking mode only send when asked to.
+static void FlushConnection(QLocalSocket& connection, int32 timeoutMs)
+{
+	connection.flush();
+	while (connection.bytesToWrite() > 0 && connection.waitForBytesWritten(timeoutMs))
+	{
+	}
+}
+
+/*
+	TBCalendarProcessPool
+*/
+TBCalendarProcessPool::TBCalendarProcessPool(const QString& moduleName, int32 timeoutMs) :
+	ModuleName(moduleName),
+	TimeoutMs(timeoutMs),
+	OwnerThread(std::this_thread::get_id()),
+	Workers()
+{}
+
+TBCalendarProcessPool::~TBCalendarProcessPool()
+{
+	for (std::unique_ptr<Worker>& worker : Workers)
+	{
+		StopWorker(*worker);
+	}
+}
+
+std::unique_ptr<TBCalendarProcessPool> TBCalendarProcessPool::Create(const QString& moduleName, int32 processCount, int32 timeoutMs)
+{
+	if (processCount <= 0)
+	{
+		return nullptr;
+	}
+
+	std::unique_ptr<TBCalendarProcessPool> pool(new TBCalendarProcessPool(moduleName, timeoutMs));
+	for (int32 workerIndex = 0; workerIndex < processCount; workerIndex++)
+	{
+		Worker& worker = *pool->Workers.emplace_back(std::make_unique<Worker>());
+		if (!pool->StartWorker(worker))
+		{
+			return nullptr;
+		}
+	}
+
+	return pool;
+}
+
+bool TBCalendarProcessPool::StartWorker(Worker& worker)
+{
+	StopWorker(worker);
+
+	// Shared memory keys and socket names only need to be unique on this machine.
+	static std::atomic<int32> nextWorkerId = 0;
+	const QString serverName = QString("TimelineBuilder-%0-calendar-%1").arg(QCoreApplication::applicationPid()).arg(nextWorkerId++);
+
+	worker.Memory.setKey(serverName);
+	if (!worker.Memory.create(static_cast<qsizetype>(sizeof(Slot) * SLOTS_PER_WORKER)))
+	{
+		TBLog::Error("Could not create shared memory for a calendar worker: %0", worker.Memory.errorString());
+		return false;
+	}
+
+	QLocalServer server;
+	if (!server.listen(serverName))
+	{
+		TBLog::Error("Could not listen for a calendar worker: %0", server.errorString());
+		StopWorker(worker);
+		return false;
+	}
+
+	worker.Process.setProgram(QCoreApplication::applicationFilePath());
+	worker.Process.setArguments({ "--" + WORKER_OPTION, ModuleName, "--" + WORKER_SERVER_OPTION, serverName });
+	// Workers log through the same console we do.
+	worker.Process.setProcessChannelMode(QProcess::ForwardedChannels);
+	worker.Process.start();
+
+	if (!worker.Process.waitForStarted(WORKER_CONNECT_TIMEOUT_MS) || !server.waitForNewConnection(WORKER_CONNECT_TIMEOUT_MS))
+	{
+		TBLog::Error("Calendar worker process for '%0' did not start.", ModuleName);
+		StopWorker(worker);
+		return false;
+	}
+
+	// The connection belongs to the server until we take it, and the server goes away at the end of this function.
+	worker.Connection.reset(server.nextPendingConnection());
+	worker.Connection->setParent(nullptr);
+
+	char ready = 0;
+	if (!worker.Connection->waitForReadyRead(WORKER_CONNECT_TIMEOUT_MS) || !worker.Connection->getChar(&ready) || ready != WORKER_READY)
+	{
+		TBLog::Error("Calendar worker process for '%0' could not load the script.", ModuleName);
+		StopWorker(worker);
+		return false;
+	}
+
+	return true;
+}
+
+void TBCalendarProcessPool::StopWorker(Worker& worker)
+{
+	// Dropping the connection tells the worker to exit.  Anything that doesn't is killed.
+	if (worker.Connection)
+	{
+		worker.Connection->disconnectFromServer();
+		worker.Connection.reset();
+	}
+
+	if (worker.Process.state() != QProcess::NotRunning && !worker.Process.waitForFinished(TimeoutMs))
+	{
+		worker.Process.kill();
+		worker.Process.waitForFinished();
+	}
+
+	if (worker.Memory.isAttached())
+	{
+		worker.Memory.detach();
+	}
+
+	worker.NextSlot = 0;
+	worker.InFlight.clear();
+}
+
+void TBCalendarProcessPool::RunChunked(Operation operation, int32 brokenDateLength, size_t itemCount, const WriteInputFunction& writeInput,
+	const ReadOutputFunction& readOutput)
+{
+	// Workers lost to a crash or a hang in an earlier call get restarted here.
+	for (std::unique_ptr<Worker>& worker : Workers)
+	{
+		if (!worker->IsRunning() && !StartWorker(*worker))
+		{
+			throw std::runtime_error("Could not restart a calendar worker process.");
+		}
+	}
+
+	// Enough chunks to give every worker something, but no more than a slot holds.
+	const size_t chunkItems = std::clamp<size_t>((itemCount + Workers.size() - 1) / Workers.size(), MinChunkItems, SLOT_MAX_ITEMS);
+	std::deque<std::pair<size_t, size_t>> pendingChunks;
+	for (size_t firstItem = 0; firstItem < itemCount; firstItem += chunkItems)
+	{
+		pendingChunks.emplace_back(firstItem, std::min(chunkItems, itemCount - firstItem));
+	}
+
+	auto anyInFlight = [this]()
+	{
+		return std::any_of(Workers.begin(), Workers.end(), [](const std::unique_ptr<Worker>& worker) { return !worker->InFlight.empty(); });
+	};
+
+	// After an error nothing new is sent, but whatever is already in flight is still collected so that the rings
+	// are empty for the next call.
+	std::string error;
+	size_t nextWorkerToCollect = 0;
+	while ((error.empty() && !pendingChunks.empty()) || anyInFlight())
+	{
+		for (std::unique_ptr<Worker>& workerPointer : Workers)
+		{
+			Worker& worker = *workerPointer;
+			while (error.empty() && !pendingChunks.empty() && worker.InFlight.size() < SLOTS_PER_WORKER)
+			{
+				const auto [firstItem, chunkCount] = pendingChunks.front();
+				pendingChunks.pop_front();
+
+				Slot& slot = worker.GetSlots()[worker.NextSlot];
+				slot.SlotOperation = operation;
+				slot.ItemCount = static_cast<uint32>(chunkCount);
+				slot.BrokenDateLength = brokenDateLength;
+				slot.Failed = 0;
+				slot.ProcessedCount = 0;
+				slot.ResultBytes = 0;
+				writeInput(slot, firstItem, chunkCount);
+
+				worker.Connection->putChar(static_cast<char>(worker.NextSlot));
+				FlushConnection(*worker.Connection, TimeoutMs);
+				worker.InFlight.emplace_back(firstItem, chunkCount);
+				worker.NextSlot = (worker.NextSlot + 1) % SLOTS_PER_WORKER;
+			}
+		}
+
+		// Collect the oldest result from the next worker with anything in flight.
+		while (Workers[nextWorkerToCollect]->InFlight.empty())
+		{
+			nextWorkerToCollect = (nextWorkerToCollect + 1) % Workers.size();
+		}
+		Worker& worker = *Workers[nextWorkerToCollect];
+		nextWorkerToCollect = (nextWorkerToCollect + 1) % Workers.size();
+
+		char returnedSlot = 0;
+		const bool responded = (worker.Connection->bytesAvailable() > 0 || worker.Connection->waitForReadyRead(TimeoutMs))
+			&& worker.Connection->getChar(&returnedSlot);
+		if (!responded || returnedSlot != worker.GetOldestSlot())
+		{
+			const bool exited = worker.Process.state() != QProcess::Running;
+			if (error.empty())
+			{
+				error = exited ? "Calendar worker process exited unexpectedly." : "Calendar worker process stopped responding.";
+			}
+			worker.Process.kill();
+			StopWorker(worker);
+			continue;
+		}
+
+		const Slot& slot = worker.GetSlots()[returnedSlot];
+		const auto [firstItem, chunkCount] = worker.InFlight.front();
+		worker.InFlight.pop_front();
+
+		if (slot.Failed)
+		{
+			if (error.empty())
+			{
+				error.assign(reinterpret_cast<const char*>(slot.GetResults()), slot.ResultBytes);
+			}
+		}
+		else if (slot.ProcessedCount == 0 || slot.ProcessedCount > chunkCount)
+		{
+			if (error.empty())
+			{
+				error = "Calendar worker process returned no usable results for a chunk.";
+			}
+		}
+		else if (error.empty())
+		{
+			readOutput(slot, firstItem, slot.ProcessedCount);
+			if (slot.ProcessedCount < chunkCount)
+			{
+				pendingChunks.emplace_front(firstItem + slot.ProcessedCount, chunkCount - slot.ProcessedCount);
+			}
+		}
+	}
+
+	if (!error.empty())
+	{
+		TBLog::Error("Calendar worker error for '%0': %1", ModuleName, QString::fromStdString(error));
+		throw std::runtime_error(error);
+	}
+}
+
+void TBCalendarProcessPool::BreakDates(std::span<const int64> days, int32 brokenDateLength, std::vector<int64>& outFlatBrokenDates)
+{
+	outFlatBrokenDates.assign(days.size() * brokenDateLength, 0);
+	RunChunked(Operation::BreakDates, brokenDateLength, days.size(),
+		[&](Slot& slot, size_t firstItem, size_t itemCount)
+		{
+			std::copy_n(days.begin() + firstItem, itemCount, slot.GetInput());
+		},
+		[&](const Slot& slot, size_t firstItem, size_t processedCount)
+		{
+			const int64* results = reinterpret_cast<const int64*>(slot.GetResults());
+			std::copy_n(results, processedCount * brokenDateLength, outFlatBrokenDates.begin() + firstItem * brokenDateLength);
+		});
+}
+
+void TBCalendarProcessPool::CombineDates(std::span<const int64> flatBrokenDates, int32 brokenDateLength, std::vector<int64>& outDays)
+{
+	const size_t dateCount = flatBrokenDates.size() / brokenDateLength;
+	outDays.assign(dateCount, 0);
+	RunChunked(Operation::CombineDates, brokenDateLength, dateCount,
+		[&](Slot& slot, size_t firstItem, size_t itemCount)
+		{
+			std::copy_n(flatBrokenDates.begin() + firstItem * brokenDateLength, itemCount * brokenDateLength, slot.GetInput());
+		},
+		[&](const Slot& slot, size_t firstItem, size_t processedCount)
+		{
+			const int64* results = reinterpret_cast<const int64*>(slot.GetResults());
+			std::copy_n(results, processedCount, outDays.begin() + firstItem);
+		});
+}
+
+void TBCalendarProcessPool::FormatDates(std::span<const int64> days, std::vector<std::string>& outFormattedDates)
+{
+	outFormattedDates.assign(days.size(), std::string());
+	RunChunked(Operation::FormatDates, 0, days.size(),
+		[&](Slot& slot, size_t firstItem, size_t itemCount)
+		{
+			std::copy_n(days.begin() + firstItem, itemCount, slot.GetInput());
+		},
+		[&](const Slot& slot, size_t firstItem, size_t processedCount)
+		{
+			// An offset per item (plus one past the end), then the UTF-8 text.
+			const uint32* offsets = reinterpret_cast<const uint32*>(slot.GetResults());
+			const char* text = reinterpret_cast<const char*>(slot.GetResults() + (slot.ItemCount + 1) * sizeof(uint32));
+			for (size_t itemIndex = 0; itemIndex < processedCount; itemIndex++)
+			{
+				outFormattedDates[firstItem + itemIndex].assign(text + offsets[itemIndex], offsets[itemIndex + 1] - offsets[itemIndex]);
+			}
+		});
+}
+
+/*
+	Worker process side
+*/
+// Reads the worker options off the command line.  Returns false if this isn't a worker.
+static bool ParseWorkerOptions(const QCoreApplication& app, QString& outModuleName, QString& outServerName)
+{
+	const QCommandLineOption workerOption(WORKER_OPTION, "Runs as a calendar worker process for the given script.", "module");
+	const QCommandLineOption serverOption(WORKER_SERVER_OPTION, "Name of the calendar worker pool to connect to.", "server");
+
+	// parse() rather than process(), since the rest of the command line belongs to other parts of the app.
+	QCommandLineParser parser;
+	parser.addOption(workerOption);
+	parser.addOption(serverOption);
+	parser.parse(app.arguments());
+	if (!parser.isSet(workerOption))
+	{
+		return false;
+	}
+
+	outModuleName = parser.value(workerOption);
+	outServerName = parser.value(serverOption);
+	return true;
+}
+
+bool TBCalendarProcessPool::IsWorkerRequested(const QCoreApplication& app)
+{
+	QString moduleName;
+	QString serverName;
+	return ParseWorkerOptions(app, moduleName, serverName);
+}
+
+bool TBCalendarProcessPool::RunWorkerIfRequested(const QCoreApplication& app, int& outExitCode)
+{
+	QString moduleName;
+	QString serverName;
+	if (!ParseWorkerOptions(app, moduleName, serverName))
+	{
+		return false;
+	}
+
+	outExitCode = RunWorker(moduleName, serverName);
+	return true;
+}
+
+int TBCalendarProcessPool::RunWorker(const QString& moduleName, const QString& serverName)
+{
+	QSharedMemory memory;
+	memory.setKey(serverName);
+	if (!memory.attach())
+	{
+		TBLog::Error("Calendar worker could not attach to shared memory: %0", memory.errorString());
+		return 1;
+	}
+	Slot* slots = static_cast<Slot*>(memory.data());
+
+	QLocalSocket connection;
+	connection.connectToServer(serverName);
+	if (!connection.waitForConnected(WORKER_CONNECT_TIMEOUT_MS))
+	{
+		TBLog::Error("Calendar worker could not connect to its pool: %0", connection.errorString());
+		return 1;
+	}
+
+	// This process's own main interpreter runs the script, so there's no module path to hand over.
+	TBCalendarScriptRunner runner;
+	const std::string importError = runner.ImportCalendar(moduleName.toStdString(), {});
+	if (!importError.empty())
+	{
+		TBLog::Error("Calendar worker could not load '%0': %1", moduleName, QString::fromStdString(importError));
+		runner.Release();
+		return 1;
+	}
+
+	connection.putChar(WORKER_READY);
+	FlushConnection(connection, WORKER_CONNECT_TIMEOUT_MS);
+
+	// Runs until the pool drops the connection.
+	while (connection.bytesAvailable() > 0 || connection.waitForReadyRead(-1))
+	{
+		char slotIndex = 0;
+		while (connection.getChar(&slotIndex))
+		{
+			if (slotIndex < 0 || slotIndex >= SLOTS_PER_WORKER)
+			{
+				TBLog::Error("Calendar worker was sent an invalid slot (%0).", static_cast<int32>(slotIndex));
+				runner.Release();
+				return 1;
+			}
+
+			ProcessSlot(runner, slots[slotIndex]);
+			connection.putChar(slotIndex);
+		}
+		FlushConnection(connection, WORKER_CONNECT_TIMEOUT_MS);
+	}
+
+	runner.Release();
+	return 0;
+}
+
+void TBCalendarProcessPool::ProcessSlot(TBCalendarScriptRunner& runner, Slot& slot)
+{
+	uint8* results = slot.GetResults();
+	const size_t resultCapacity = slot.GetResultCapacity();
+	std::string error;
+	size_t processedCount = 0;
+	size_t resultBytes = 0;
+
+	switch (slot.SlotOperation)
+	{
+	case Operation::BreakDates:
+	{
+		std::vector<int64> flatBrokenDates;
+		error = runner.BreakDates(std::span<const int64>(slot.GetInput(), slot.ItemCount), slot.BrokenDateLength, flatBrokenDates);
+		processedCount = std::min<size_t>(slot.ItemCount, resultCapacity / (slot.BrokenDateLength * sizeof(int64)));
+		resultBytes = processedCount * slot.BrokenDateLength * sizeof(int64);
+		if (error.empty())
+		{
+			std::memcpy(results, flatBrokenDates.data(), resultBytes);
+		}
+		break;
+	}
+	case Operation::CombineDates:
+	{
+		std::vector<int64> days;
+		error = runner.CombineDates(std::span<const int64>(slot.GetInput(), slot.ItemCount * slot.BrokenDateLength), slot.BrokenDateLength, days);
+		processedCount = std::min<size_t>(slot.ItemCount, resultCapacity / sizeof(int64));
+		resultBytes = processedCount * sizeof(int64);
+		if (error.empty())
+		{
+			std::memcpy(results, days.data(), resultBytes);
+		}
+		break;
+	}
+	case Operation::FormatDates:
+	{
+		std::vector<std::string> formattedDates;
+		error = runner.FormatDates(std::span<const int64>(slot.GetInput(), slot.ItemCount), formattedDates);
+
+		uint32* offsets = reinterpret_cast<uint32*>(results);
+		const size_t textStart = (slot.ItemCount + 1) * sizeof(uint32);
+		size_t textBytes = 0;
+		offsets[0] = 0;
+		for (const std::string& formattedDate : formattedDates)
+		{
+			if (!error.empty() || textStart + textBytes + formattedDate.size() > resultCapacity)
+			{
+				break;
+			}
+			std::memcpy(results + textStart + textBytes, formattedDate.data(), formattedDate.size());
+			textBytes += formattedDate.size();
+			offsets[++processedCount] = static_cast<uint32>(textBytes);
+		}
+		resultBytes = textStart + textBytes;
+		break;
+	}
+	default:
+		error = "Unknown calendar worker operation.";
+		break;
+	}
+
+	if (!error.empty())
+	{
+		resultBytes = std::min(error.size(), resultCapacity);
+		std::memcpy(results, error.data(), resultBytes);
+		processedCount = 0;
+	}
+
+	slot.Failed = error.empty() ? 0 : 1;
+	slot.ProcessedCount = static_cast<uint32>(processedCount);
+	slot.ResultBytes = static_cast<uint32>(resultBytes);
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (CalendarProcessPool.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QString>
+
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TBCalendarScriptRunner;
+
+/*
+	Worker processes that each run their own Python interpreter with a calendar script loaded.  Large batch calls
+	are cut into chunks and handed to the workers through shared memory: each worker has a ring of fixed-size slots,
+	and a local socket carries slot numbers back and forth.  A script that hangs or crashes only takes its worker
+	down; the batch fails with an exception and the worker is restarted on the next call.
+
+	This is for scripts that can't run in subinterpreters (see TBScriptInterpreterPool).  Workers are this same
+	executable, started with --calendar-worker; main() hands those over to RunWorkerIfRequested().
+
+	Workers are driven through Qt sockets and processes, which belong to the thread that created the pool.  Calls from
+	any other thread are turned away by ShouldSplit(), and run in-process instead.
+*/
+class TBCalendarProcessPool
+{
+public:
+	// Batches are split into chunks of at least this many items.
+	static constexpr size_t MinChunkItems = 256;
+
+	// Starts processCount workers for the script moduleName.  Calls to a worker that take longer than timeoutMs
+	// count as a hang.  Returns null if any worker fails to start.
+	static std::unique_ptr<TBCalendarProcessPool> Create(const QString& moduleName, int32 processCount, int32 timeoutMs);
+
+	// Whether this process was started as a calendar worker.  Only needs the command line, so it can be checked before
+	// logging and settings are set up.
+	static bool IsWorkerRequested(const QCoreApplication& app);
+	// Runs this process as a calendar worker if its command line asks for it.  Returns false if it doesn't; otherwise
+	// returns true once the pool that started it goes away, with outExitCode set.
+	static bool RunWorkerIfRequested(const QCoreApplication& app, int& outExitCode);
+
+	~TBCalendarProcessPool();
+
+	int32 GetProcessCount() const { return static_cast<int32>(Workers.size()); }
+	// Whether a batch is big enough to be worth sending to the workers rather than running in this process.
+	bool ShouldSplit(size_t itemCount) const
+	{
+		return !Workers.empty() && itemCount >= 2 * MinChunkItems && std::this_thread::get_id() == OwnerThread;
+	}
+
+	// Batch calls, mirroring the ones on TBCalendarSystem.  These throw std::runtime_error if the script fails or a
+	// worker crashes or times out.
+	void BreakDates(std::span<const int64> days, int32 brokenDateLength, std::vector<int64>& outFlatBrokenDates);
+	void CombineDates(std::span<const int64> flatBrokenDates, int32 brokenDateLength, std::vector<int64>& outDays);
+	void FormatDates(std::span<const int64> days, std::vector<std::string>& outFormattedDates);
+
+private:
+	struct Worker;
+	struct Slot;
+	enum class Operation : uint32;
+
+	// Fills a slot's input for items [firstItem, firstItem + itemCount).
+	typedef std::function<void(Slot&, size_t firstItem, size_t itemCount)> WriteInputFunction;
+	// Reads a slot's results for the first processedCount items starting at firstItem.
+	typedef std::function<void(const Slot&, size_t firstItem, size_t processedCount)> ReadOutputFunction;
+
+	TBCalendarProcessPool(const QString& moduleName, int32 timeoutMs);
+
+	bool StartWorker(Worker& worker);
+	void StopWorker(Worker& worker);
+
+	// Worker process side
+	static int RunWorker(const QString& moduleName, const QString& serverName);
+	static void ProcessSlot(TBCalendarScriptRunner& runner, Slot& slot);
+
+	// Feeds itemCount items through the workers' slot rings in chunks, re-sending whatever a worker couldn't fit.
+	void RunChunked(Operation operation, int32 brokenDateLength, size_t itemCount, const WriteInputFunction& writeInput,
+		const ReadOutputFunction& readOutput);
+
+	QString ModuleName;
+	int32 TimeoutMs;
+	std::thread::id OwnerThread;
+	std::vector<std::unique_ptr<Worker>> Workers;
+};
\ No newline at end of file
@@ -0,0 +1,360 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (CalendarRegistry.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PyBind.h"		// This has to come first to not conflict with Qt defines.
+#include "CalendarRegistry.h"
+#include "Calendar.h"
+#include "JsonFiles.h"
+#include "Logging.h"
+#include "Settings.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QFileSystemWatcher>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QTimer>
+
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// How long to wait after the last change to a file before reloading it.
+static constexpr int32 RELOAD_DELAY_MS = 250;
+
+TBCalendarRegistry* TBCalendarRegistry::singleton = nullptr;
+
+TBCalendarRegistry::TBCalendarRegistry() :
+	DescriptorDirectory(),
+	EntriesMutex(),
+	Entries(),
+	Watcher(),
+	ReloadTimer(),
+	ChangedFiles()
+{}
+
+TBCalendarRegistry::~TBCalendarRegistry()
+{}
+
+void TBCalendarRegistry::Initialize(const QString& descriptorDirectory)
+{
+	if (singleton != nullptr)
+	{
+		throw std::runtime_error("TBCalendarRegistry singleton already initialized!");
+	}
+	else
+	{
+		singleton = new TBCalendarRegistry();
+		singleton->DescriptorDirectory = descriptorDirectory;
+		singleton->ScanDescriptors();
+		if (TBSettings::Get().GetValue<bool>(TBSettingsFile::System, "Calendar", "WatchScripts"))
+		{
+			singleton->StartWatching();
+		}
+	}
+}
+
+void TBCalendarRegistry::Cleanup()
+{
+	if (singleton != nullptr)
+	{
+		delete singleton;
+		singleton = nullptr;
+	}
+}
+
+void TBCalendarRegistry::ScanDescriptors()
+{
+	const QDir directory(DescriptorDirectory);
+	for (const QString& fileName : directory.entryList({ "*.json" }, QDir::Files, QDir::Name))
+	{
+		AddDescriptor(directory.filePath(fileName));
+	}
+
+	std::scoped_lock lock(EntriesMutex);
+	TBLog::Log("Found %0 calendar systems in '%1'.", static_cast<int64>(Entries.size()), DescriptorDirectory);
+}
+
+bool TBCalendarRegistry::AddDescriptor(const QString& descriptorPath)
+{
+	TBJsonFile jsonFile(descriptorPath, QIODevice::ReadOnly);
+	QJsonDocument* calendarData = nullptr;
+	if (jsonFile.GetJsonDocument(calendarData) != EJsonFileResult::Success)
+	{
+		TBLog::Warning("Could not read calendar system file (%0).  Skipping it.", descriptorPath);
+		return false;
+	}
+
+	std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+	entry->DescriptorPath = descriptorPath;
+	entry->Calendar = std::make_shared<TBCalendarSystem>();
+	entry->Calendar->LoadFromJson(calendarData->object());
+	if (!entry->Calendar->IsValid())
+	{
+		TBLog::Warning("Calendar system file (%0) is missing required data.  Skipping it.", descriptorPath);
+		return false;
+	}
+
+	const QUuid calendarID = entry->Calendar->GetID();
+	std::scoped_lock lock(EntriesMutex);
+	if (Entries.contains(calendarID))
+	{
+		TBLog::Warning("Calendar system file (%0) has the same ID as %1.  Skipping it.", descriptorPath, Entries.value(calendarID)->DescriptorPath);
+		return false;
+	}
+	Entries.insert(calendarID, entry);
+	return true;
+}
+
+std::shared_ptr<TBCalendarRegistry::Entry> TBCalendarRegistry::FindEntry(const QUuid& calendarID) const
+{
+	std::scoped_lock lock(EntriesMutex);
+	return Entries.value(calendarID);
+}
+
+std::unique_lock<std::mutex> TBCalendarRegistry::LockEntry(Entry& entry)
+{
+	// Whoever is initializing this calendar needs the GIL, so don't hold onto it while waiting for them.
+	std::unique_lock lock(entry.InitializeMutex, std::try_to_lock);
+	if (!lock.owns_lock())
+	{
+		TBScopedGilRelease releaseGil;
+		lock.lock();
+	}
+	return lock;
+}
+
+std::shared_ptr<const TBCalendarSystem> TBCalendarRegistry::GetCalendarSystem(const QUuid& calendarID)
+{
+	std::shared_ptr<Entry> entry = FindEntry(calendarID);
+	if (!entry)
+	{
+		return nullptr;
+	}
+
+	std::unique_lock lock = LockEntry(*entry);
+	if (entry->State == EntryState::Unloaded)
+	{
+		TBLog::Log("Initializing calendar system '%0' on first use.", entry->Calendar->GetName());
+		entry->State = InitializeCalendar(*entry->Calendar, false, entry->DescriptorPath) ? EntryState::Ready : EntryState::Failed;
+	}
+
+	return entry->State == EntryState::Ready ? entry->Calendar : nullptr;
+}
+
+QList<QUuid> TBCalendarRegistry::GetCalendarIDs() const
+{
+	std::scoped_lock lock(EntriesMutex);
+	return Entries.keys();
+}
+
+QString TBCalendarRegistry::GetCalendarName(const QUuid& calendarID) const
+{
+	std::scoped_lock lock(EntriesMutex);
+	const std::shared_ptr<Entry> entry = Entries.value(calendarID);
+	return entry ? entry->Calendar->GetName() : QString();
+}
+
+QUuid TBCalendarRegistry::FindCalendarByScript(const QString& scriptName) const
+{
+	std::scoped_lock lock(EntriesMutex);
+	for (auto entry = Entries.constBegin(); entry != Entries.constEnd(); ++entry)
+	{
+		if (entry.value()->Calendar->GetScriptName() == scriptName)
+		{
+			return entry.key();
+		}
+	}
+	return QUuid();
+}
+
+void TBCalendarRegistry::StartWatching()
+{
+	Watcher = std::make_unique<QFileSystemWatcher>();
+	ReloadTimer = std::make_unique<QTimer>();
+	ReloadTimer->setSingleShot(true);
+	ReloadTimer->setInterval(RELOAD_DELAY_MS);
+
+	QObject::connect(Watcher.get(), &QFileSystemWatcher::fileChanged, [this](const QString& path) { OnFileChanged(path); });
+	// New descriptors show up as a change to the directory.
+	QObject::connect(Watcher.get(), &QFileSystemWatcher::directoryChanged, [this](const QString& path) { OnFileChanged(path); });
+	QObject::connect(ReloadTimer.get(), &QTimer::timeout, [this]() { ReloadChangedFiles(); });
+
+	const QDir directory(DescriptorDirectory);
+	QStringList paths({ directory.path() });
+	for (const QString& fileName : directory.entryList({ "*.json", "*.py" }, QDir::Files, QDir::Name))
+	{
+		paths.append(directory.filePath(fileName));
+	}
+	Watcher->addPaths(paths);
+}
+
+void TBCalendarRegistry::OnFileChanged(const QString& path)
+{
+	ChangedFiles.insert(path);
+	ReloadTimer->start();
+}
+
+void TBCalendarRegistry::ReloadChangedFiles()
+{
+	const QSet<QString> changedPaths = std::exchange(ChangedFiles, QSet<QString>());
+	QStringList changedFiles;
+	for (const QString& path : changedPaths)
+	{
+		if (QFileInfo(path).isDir())
+		{
+			// New files, and files that an editor saved by replacing them (which the watcher loses track of).
+			const QDir directory(path);
+			const QStringList watchedFiles = Watcher->files();
+			for (const QString& fileName : directory.entryList({ "*.json", "*.py" }, QDir::Files, QDir::Name))
+			{
+				const QString filePath = directory.filePath(fileName);
+				if (!watchedFiles.contains(filePath))
+				{
+					Watcher->addPath(filePath);
+					changedFiles.append(filePath);
+				}
+			}
+		}
+		else if (!changedFiles.contains(path))
+		{
+			changedFiles.append(path);
+		}
+	}
+
+	for (const QString& path : changedFiles)
+	{
+		if (QFileInfo::exists(path) && !Watcher->files().contains(path))
+		{
+			Watcher->addPath(path);
+		}
+
+		if (path.endsWith(".json"))
+		{
+			ReloadDescriptor(path);
+		}
+		else if (path.endsWith(".py"))
+		{
+			ReloadScript(QFileInfo(path).completeBaseName());
+		}
+	}
+}
+
+void TBCalendarRegistry::ReloadDescriptor(const QString& descriptorPath)
+{
+	std::shared_ptr<Entry> entry;
+	{
+		std::scoped_lock lock(EntriesMutex);
+		for (const std::shared_ptr<Entry>& candidate : Entries)
+		{
+			if (candidate->DescriptorPath == descriptorPath)
+			{
+				entry = candidate;
+				break;
+			}
+		}
+	}
+	if (!entry)
+	{
+		// A new file, or one that was skipped for being broken and has now been fixed.
+		if (AddDescriptor(descriptorPath))
+		{
+			TBLog::Log("Found new calendar system file (%0).", descriptorPath);
+		}
+		return;
+	}
+
+	ReplaceCalendar(*entry);
+}
+
+void TBCalendarRegistry::ReloadScript(const QString& scriptName)
+{
+	std::vector<std::shared_ptr<Entry>> scriptEntries;
+	{
+		std::scoped_lock lock(EntriesMutex);
+		for (const std::shared_ptr<Entry>& entry : Entries)
+		{
+			if (entry->Calendar->GetScriptName() == scriptName)
+			{
+				scriptEntries.push_back(entry);
+			}
+		}
+	}
+
+	for (const std::shared_ptr<Entry>& entry : scriptEntries)
+	{
+		ReplaceCalendar(*entry);
+	}
+}
+
+void TBCalendarRegistry::ReplaceCalendar(Entry& entry)
+{
+	TBJsonFile jsonFile(entry.DescriptorPath, QIODevice::ReadOnly);
+	QJsonDocument* calendarData = nullptr;
+	if (jsonFile.GetJsonDocument(calendarData) != EJsonFileResult::Success)
+	{
+		TBLog::Warning("Could not read changed calendar system file (%0).  Keeping the calendar as it was.", entry.DescriptorPath);
+		return;
+	}
+
+	// The current instance may be in use on other threads, so the changes go into a new one.
+	std::shared_ptr<TBCalendarSystem> changedCalendar = std::make_shared<TBCalendarSystem>();
+	changedCalendar->LoadFromJson(calendarData->object());
+
+	std::unique_lock lock = LockEntry(entry);
+	if (!changedCalendar->IsValid() || changedCalendar->GetID() != entry.Calendar->GetID())
+	{
+		TBLog::Warning("Changed calendar system file (%0) is missing data or has a new ID, which needs a restart.  Keeping the calendar as it was.",
+			entry.DescriptorPath);
+		return;
+	}
+
+	// Calendars nobody has used yet will import the new version when they're first asked for.
+	if (entry.State != EntryState::Unloaded)
+	{
+		TBLog::Log("Calendar system '%0' changed on disk.  Reloading it.", changedCalendar->GetName());
+		if (!InitializeCalendar(*changedCalendar, true, entry.DescriptorPath))
+		{
+			TBLog::Warning("Changed calendar system '%0' failed to initialize.  Keeping the calendar as it was.", changedCalendar->GetName());
+			return;
+		}
+		entry.State = EntryState::Ready;
+	}
+
+	std::shared_ptr<TBCalendarSystem> replacedCalendar;
+	{
+		std::scoped_lock entriesLock(EntriesMutex);
+		replacedCalendar = std::exchange(entry.Calendar, changedCalendar);
+	}
+	replacedCalendar->MarkReplaced();
+}
+
+bool TBCalendarRegistry::InitializeCalendar(TBCalendarSystem& calendar, bool reloadModule, const QString& descriptorPath)
+{
+	try
+	{
+		if (calendar.InitializeScript(reloadModule))
+		{
+			return true;
+		}
+		TBLog::Error("Could not initialize calendar system '%0' (%1).", calendar.GetName(), descriptorPath);
+	}
+	catch (const std::exception& exception)
+	{
+		TBLog::Error("Could not initialize calendar system '%0' (%1): %2", calendar.GetName(), descriptorPath, exception.what());
+	}
+	return false;
+}
\ No newline at end of file
@@ -0,0 +1,122 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (CalendarRegistry.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+
+#include <QtCore/QList>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QUuid>
+
+#include <memory>
+#include <mutex>
+
+class QFileSystemWatcher;
+class QTimer;
+class TBCalendarSystem;
+
+/*
+	Every calendar system TimelineBuilder knows about, by ID.  Descriptors are read up front, but a calendar's script
+	is only imported the first time someone asks for that calendar.  After that, everyone asking gets the same
+	instance, and so shares its interpreters, worker processes and result caches.
+
+	If the system config allows it, calendar scripts and descriptors are watched for changes.  A changed calendar is
+	loaded into a new instance that takes the old one's place.  Whoever still holds the old instance can keep using
+	it, but it reports itself as replaced, and the new one has its own script generation, so that anything derived
+	from the old one knows to fetch the calendar again and recompute.  Other calendars aren't touched.
+*/
+class TBCalendarRegistry
+{
+private:
+	static TBCalendarRegistry* singleton;
+
+	// Restrict these to private to enforce singleton-ness
+	TBCalendarRegistry();
+	TBCalendarRegistry(const TBCalendarRegistry& other) = delete;
+	TBCalendarRegistry& operator=(const TBCalendarRegistry& other) = delete;
+	~TBCalendarRegistry();
+
+public:
+	// Static initialization and access.  Initialize() reads every *.json descriptor in descriptorDirectory.  Call it
+	// from the GUI thread, since file changes are handled there.
+	static void Initialize(const QString& descriptorDirectory);
+	static bool IsInitialized() { return singleton != nullptr; }
+	static TBCalendarRegistry& Get() { return *singleton; }
+	// Releases the registry's references.  Calendars still held elsewhere live until those go away.
+	static void Cleanup();
+
+	// Returns the initialized calendar, importing its script on first use.  Returns null for an unknown ID, or a
+	// calendar whose script fails to initialize (which isn't retried until the script changes).  Safe to call from
+	// any thread.
+	std::shared_ptr<const TBCalendarSystem> GetCalendarSystem(const QUuid& calendarID);
+
+	// These only look at descriptors, and never import anything.
+	QList<QUuid> GetCalendarIDs() const;
+	QString GetCalendarName(const QUuid& calendarID) const;
+	// Null if no calendar uses this script.
+	QUuid FindCalendarByScript(const QString& scriptName) const;
+
+private:
+	enum class EntryState : uint8
+	{
+		Unloaded,
+		Ready,
+		Failed
+	};
+
+	struct Entry
+	{
+		QString DescriptorPath;
+		// Loaded from the descriptor at startup, and initialized in place on first use.  Replaced, never changed, once
+		// it has been handed out.  Read it under EntriesMutex, unless InitializeMutex is held.
+		std::shared_ptr<TBCalendarSystem> Calendar;
+		EntryState State = EntryState::Unloaded;
+		std::mutex InitializeMutex;
+	};
+
+	void ScanDescriptors();
+	// Returns false if the file can't be used.  EntriesMutex must not be held.
+	bool AddDescriptor(const QString& descriptorPath);
+	std::shared_ptr<Entry> FindEntry(const QUuid& calendarID) const;
+	// Locks an entry's InitializeMutex, giving up the GIL while waiting for it.
+	static std::unique_lock<std::mutex> LockEntry(Entry& entry);
+
+	void StartWatching();
+	void OnFileChanged(const QString& path);
+	void ReloadChangedFiles();
+	void ReloadDescriptor(const QString& descriptorPath);
+	void ReloadScript(const QString& scriptName);
+	// Loads the entry's descriptor into a new calendar and puts it in the old one's place.  If the entry has been
+	// used, the new calendar is initialized straight away, re-importing its script, and if that fails the old calendar
+	// and its state are kept.
+	void ReplaceCalendar(Entry& entry);
+	// Logs and returns false if the script fails to initialize, including by throwing.
+	static bool InitializeCalendar(TBCalendarSystem& calendar, bool reloadModule, const QString& descriptorPath);
+
+	QString DescriptorDirectory;
+
+	// Entries are only added after startup, never removed, so an entry stays valid once found.
+	mutable std::mutex EntriesMutex;
+	TBMap<QUuid, std::shared_ptr<Entry>> Entries;
+
+	std::unique_ptr<QFileSystemWatcher> Watcher;
+	// Editors often write a file several times per save, so changes are collected for a moment before reloading.
+	std::unique_ptr<QTimer> ReloadTimer;
+	QSet<QString> ChangedFiles;
+};
\ No newline at end of file
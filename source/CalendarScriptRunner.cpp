@@ -0,0 +1,374 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (CalendarScriptRunner.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PyBind.h"		// This has to come first to not conflict with Qt defines.
+#include "CalendarScriptRunner.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iterator>
+
+// Indexed by TBRunnerFunction.
+static const char* const RUNNER_FUNCTION_NAMES[] =
+{
+	"break_date",
+	"combine_date",
+	"format_date",
+	"break_dates",
+	"combine_dates",
+	"format_dates"
+};
+
+/*
+	Python helpers.  All of these need the current interpreter's GIL, and report failure by returning null/false with
+	a Python exception set.
+*/
+
+// Takes the pending Python exception and turns it into a message, since the exception can't leave its interpreter.
+static std::string TakePythonError()
+{
+	PyObject* type = nullptr;
+	PyObject* value = nullptr;
+	PyObject* traceback = nullptr;
+	PyErr_Fetch(&type, &value, &traceback);
+
+	std::string message = "Unknown Python error";
+	if (value != nullptr)
+	{
+		if (PyObject* text = PyObject_Str(value))
+		{
+			if (const char* utf8 = PyUnicode_AsUTF8(text))
+			{
+				message = utf8;
+			}
+			Py_DECREF(text);
+		}
+	}
+
+	PyErr_Clear();
+	Py_XDECREF(type);
+	Py_XDECREF(value);
+	Py_XDECREF(traceback);
+	return message;
+}
+
+static PyObject* CallWithInt64(PyObject* function, int64 value)
+{
+	PyObject* argument = PyLong_FromLongLong(value);
+	PyObject* result = argument ? PyObject_CallOneArg(function, argument) : nullptr;
+	Py_XDECREF(argument);
+	return result;
+}
+
+static PyObject* CallWithInt64List(PyObject* function, std::span<const int64> values)
+{
+	PyObject* argument = PyList_New(static_cast<Py_ssize_t>(values.size()));
+	for (size_t index = 0; argument != nullptr && index < values.size(); index++)
+	{
+		PyObject* item = PyLong_FromLongLong(values[index]);
+		if (item == nullptr)
+		{
+			Py_CLEAR(argument);
+			break;
+		}
+		PyList_SET_ITEM(argument, static_cast<Py_ssize_t>(index), item);
+	}
+
+	PyObject* result = argument ? PyObject_CallOneArg(function, argument) : nullptr;
+	Py_XDECREF(argument);
+	return result;
+}
+
+// Same as Int64SpanToMemoryView() on the main interpreter: a read-only memoryview of int64 over the caller's data.
+static PyObject* CallWithInt64View(PyObject* function, std::span<const int64> values)
+{
+	PyObject* byteView = PyMemoryView_FromMemory(const_cast<char*>(reinterpret_cast<const char*>(values.data())),
+		static_cast<Py_ssize_t>(values.size_bytes()), PyBUF_READ);
+	PyObject* int64View = byteView ? PyObject_CallMethod(byteView, "cast", "s", "q") : nullptr;
+	PyObject* result = int64View ? PyObject_CallOneArg(function, int64View) : nullptr;
+	Py_XDECREF(int64View);
+	Py_XDECREF(byteView);
+	return result;
+}
+
+// Contiguous int64 buffers are copied straight out; anything else is read as a sequence of ints.
+static bool AppendInt64s(PyObject* source, std::vector<int64>& outValues)
+{
+	if (PyObject_CheckBuffer(source))
+	{
+		Py_buffer buffer;
+		if (PyObject_GetBuffer(source, &buffer, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) == 0)
+		{
+			const bool isInt64 = buffer.itemsize == sizeof(int64) && buffer.format != nullptr
+				&& (std::strcmp(buffer.format, "q") == 0 || std::strcmp(buffer.format, "l") == 0);
+			if (isInt64)
+			{
+				const int64* data = static_cast<const int64*>(buffer.buf);
+				outValues.insert(outValues.end(), data, data + buffer.len / sizeof(int64));
+			}
+			PyBuffer_Release(&buffer);
+			if (isInt64)
+			{
+				return true;
+			}
+		}
+		else
+		{
+			PyErr_Clear();
+		}
+	}
+
+	PyObject* sequence = PySequence_Fast(source, "Expected a sequence of integers");
+	if (sequence == nullptr)
+	{
+		return false;
+	}
+
+	const Py_ssize_t length = PySequence_Fast_GET_SIZE(sequence);
+	PyObject** items = PySequence_Fast_ITEMS(sequence);
+	for (Py_ssize_t index = 0; index < length; index++)
+	{
+		const long long value = PyLong_AsLongLong(items[index]);
+		if (value == -1 && PyErr_Occurred())
+		{
+			Py_DECREF(sequence);
+			return false;
+		}
+		outValues.push_back(value);
+	}
+
+	Py_DECREF(sequence);
+	return true;
+}
+
+static bool AppendString(PyObject* source, std::vector<std::string>& outValues)
+{
+	Py_ssize_t length = 0;
+	const char* utf8 = PyUnicode_AsUTF8AndSize(source, &length);
+	if (utf8 == nullptr)
+	{
+		return false;
+	}
+
+	outValues.emplace_back(utf8, static_cast<size_t>(length));
+	return true;
+}
+
+static bool AppendStrings(PyObject* source, std::vector<std::string>& outValues)
+{
+	PyObject* sequence = PySequence_Fast(source, "Expected a sequence of strings");
+	if (sequence == nullptr)
+	{
+		return false;
+	}
+
+	const Py_ssize_t length = PySequence_Fast_GET_SIZE(sequence);
+	PyObject** items = PySequence_Fast_ITEMS(sequence);
+	bool converted = true;
+	for (Py_ssize_t index = 0; converted && index < length; index++)
+	{
+		converted = AppendString(items[index], outValues);
+	}
+
+	Py_DECREF(sequence);
+	return converted;
+}
+
+/*
+	TBCalendarScriptRunner
+*/
+TBCalendarScriptRunner::TBCalendarScriptRunner() :
+	Functions()
+{}
+
+TBCalendarScriptRunner::~TBCalendarScriptRunner()
+{
+	// Release() has to have been called while the interpreter was still alive.
+	assert(std::none_of(std::begin(Functions), std::end(Functions), [](PyObject* function) { return function != nullptr; }));
+}
+
+void TBCalendarScriptRunner::Release()
+{
+	for (PyObject*& function : Functions)
+	{
+		Py_CLEAR(function);
+	}
+}
+
+PyObject* TBCalendarScriptRunner::GetFunction(TBRunnerFunction function) const
+{
+	return Functions[static_cast<size_t>(function)];
+}
+
+std::string TBCalendarScriptRunner::ImportCalendar(const std::string& moduleName, const std::vector<std::string>& modulePath)
+{
+	// Interpreters other than the main one start with the default module path, so callers can hand over the main one's.
+	PyObject* sysPath = modulePath.empty() ? nullptr : PySys_GetObject("path");
+	if (sysPath != nullptr)
+	{
+		PyList_SetSlice(sysPath, 0, PyList_GET_SIZE(sysPath), nullptr);
+		for (const std::string& pathEntry : modulePath)
+		{
+			PyObject* entry = PyUnicode_FromStringAndSize(pathEntry.data(), static_cast<Py_ssize_t>(pathEntry.size()));
+			if (entry == nullptr || PyList_Append(sysPath, entry) != 0)
+			{
+				Py_XDECREF(entry);
+				return TakePythonError();
+			}
+			Py_DECREF(entry);
+		}
+	}
+
+	PyObject* module = PyImport_ImportModule(moduleName.c_str());
+	if (module == nullptr)
+	{
+		return TakePythonError();
+	}
+
+	// Functions are resolved on whatever init_calendar() returns, same as on the main interpreter.
+	PyObject* calendar = PyObject_CallMethod(module, "init_calendar", nullptr);
+	Py_DECREF(module);
+	if (calendar == nullptr)
+	{
+		return TakePythonError();
+	}
+
+	for (size_t functionIndex = 0; functionIndex < static_cast<size_t>(TBRunnerFunction::Count); functionIndex++)
+	{
+		if (PyObject_HasAttrString(calendar, RUNNER_FUNCTION_NAMES[functionIndex]))
+		{
+			Functions[functionIndex] = PyObject_GetAttrString(calendar, RUNNER_FUNCTION_NAMES[functionIndex]);
+		}
+	}
+	Py_DECREF(calendar);
+
+	if (!GetFunction(TBRunnerFunction::BreakDate) || !GetFunction(TBRunnerFunction::CombineDate) || !GetFunction(TBRunnerFunction::FormatDate))
+	{
+		return "Calendar script is missing break_date, combine_date or format_date";
+	}
+	return {};
+}
+
+std::string TBCalendarScriptRunner::BreakDates(std::span<const int64> days, int32 brokenDateLength, std::vector<int64>& outFlatBrokenDates)
+{
+	outFlatBrokenDates.reserve(days.size() * brokenDateLength);
+	if (PyObject* batchFunction = GetFunction(TBRunnerFunction::BreakDates))
+	{
+		PyObject* result = CallWithInt64View(batchFunction, days);
+		const bool converted = result && AppendInt64s(result, outFlatBrokenDates);
+		Py_XDECREF(result);
+		if (!converted)
+		{
+			return TakePythonError();
+		}
+	}
+	else
+	{
+		for (int64 day : days)
+		{
+			const size_t previousSize = outFlatBrokenDates.size();
+			PyObject* result = CallWithInt64(GetFunction(TBRunnerFunction::BreakDate), day);
+			const bool converted = result && AppendInt64s(result, outFlatBrokenDates);
+			Py_XDECREF(result);
+			if (!converted)
+			{
+				return TakePythonError();
+			}
+			if (outFlatBrokenDates.size() - previousSize != static_cast<size_t>(brokenDateLength))
+			{
+				return "break_date returned a broken date of the wrong length";
+			}
+		}
+	}
+
+	if (outFlatBrokenDates.size() != days.size() * brokenDateLength)
+	{
+		return "break_dates returned the wrong number of values";
+	}
+	return {};
+}
+
+std::string TBCalendarScriptRunner::CombineDates(std::span<const int64> flatBrokenDates, int32 brokenDateLength, std::vector<int64>& outDays)
+{
+	const size_t dateCount = flatBrokenDates.size() / brokenDateLength;
+	outDays.reserve(dateCount);
+	if (PyObject* batchFunction = GetFunction(TBRunnerFunction::CombineDates))
+	{
+		PyObject* result = CallWithInt64View(batchFunction, flatBrokenDates);
+		const bool converted = result && AppendInt64s(result, outDays);
+		Py_XDECREF(result);
+		if (!converted)
+		{
+			return TakePythonError();
+		}
+	}
+	else
+	{
+		for (size_t offset = 0; offset < flatBrokenDates.size(); offset += brokenDateLength)
+		{
+			PyObject* result = CallWithInt64List(GetFunction(TBRunnerFunction::CombineDate), flatBrokenDates.subspan(offset, brokenDateLength));
+			const long long day = result ? PyLong_AsLongLong(result) : -1;
+			Py_XDECREF(result);
+			if (day == -1 && PyErr_Occurred())
+			{
+				return TakePythonError();
+			}
+			outDays.push_back(day);
+		}
+	}
+
+	if (outDays.size() != dateCount)
+	{
+		return "combine_dates returned the wrong number of days";
+	}
+	return {};
+}
+
+std::string TBCalendarScriptRunner::FormatDates(std::span<const int64> days, std::vector<std::string>& outFormattedDates)
+{
+	outFormattedDates.reserve(days.size());
+	if (PyObject* batchFunction = GetFunction(TBRunnerFunction::FormatDates))
+	{
+		PyObject* result = CallWithInt64View(batchFunction, days);
+		const bool converted = result && AppendStrings(result, outFormattedDates);
+		Py_XDECREF(result);
+		if (!converted)
+		{
+			return TakePythonError();
+		}
+	}
+	else
+	{
+		for (int64 day : days)
+		{
+			PyObject* result = CallWithInt64(GetFunction(TBRunnerFunction::FormatDate), day);
+			const bool converted = result && AppendString(result, outFormattedDates);
+			Py_XDECREF(result);
+			if (!converted)
+			{
+				return TakePythonError();
+			}
+		}
+	}
+
+	if (outFormattedDates.size() != days.size())
+	{
+		return "format_dates returned the wrong number of strings";
+	}
+	return {};
+}
\ No newline at end of file
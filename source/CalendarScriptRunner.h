@@ -0,0 +1,72 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (CalendarScriptRunner.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+
+#include <span>
+#include <string>
+#include <vector>
+
+// Forward-declaring, so that this header doesn't drag in Python.h
+typedef struct _object PyObject;
+
+// The script functions a runner resolves.  Batch functions are optional, as on the main interpreter.
+enum class TBRunnerFunction : uint8
+{
+	BreakDate,
+	CombineDate,
+	FormatDate,
+	BreakDates,
+	CombineDates,
+	FormatDates,
+	Count
+};
+
+/*
+	Batch calendar calls against a calendar script, made through the Python C API in whatever interpreter is current.
+	This is the part of TBCalendarSystem's script handling that runs outside the main interpreter: in subinterpreters
+	(TBScriptInterpreterPool) and in worker processes (TBCalendarProcessPool).
+
+	Every method needs the GIL of the interpreter the calendar was imported into.  Errors come back as a message
+	rather than an exception, since Python exceptions can't leave their interpreter.
+*/
+class TBCalendarScriptRunner
+{
+public:
+	TBCalendarScriptRunner();
+	~TBCalendarScriptRunner();
+
+	TBCalendarScriptRunner(const TBCalendarScriptRunner&) = delete;
+	TBCalendarScriptRunner& operator=(const TBCalendarScriptRunner&) = delete;
+
+	// Imports moduleName, calls its init_calendar() and resolves the calendar functions.  If modulePath isn't empty,
+	// it replaces sys.path first.  Returns an error message, or an empty string on success.
+	std::string ImportCalendar(const std::string& moduleName, const std::vector<std::string>& modulePath);
+	// Drops the references to the script.  Must be called before the interpreter goes away.
+	void Release();
+
+	std::string BreakDates(std::span<const int64> days, int32 brokenDateLength, std::vector<int64>& outFlatBrokenDates);
+	std::string CombineDates(std::span<const int64> flatBrokenDates, int32 brokenDateLength, std::vector<int64>& outDays);
+	std::string FormatDates(std::span<const int64> days, std::vector<std::string>& outFormattedDates);
+
+private:
+	PyObject* GetFunction(TBRunnerFunction function) const;
+
+	PyObject* Functions[static_cast<size_t>(TBRunnerFunction::Count)];
+};
\ No newline at end of file
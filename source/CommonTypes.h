@@ -19,7 +19,10 @@
 
 #include <cstdint>
 
-#if TB_MAP_IS_HASH
+#if TB_MAP_IS_FLAT
+#include <QtCore/QHash>
+#include <type_traits>
+#elif TB_MAP_IS_HASH
 #include <QtCore/QHash>
 #else
 #include <QtCore/QMap>
@@ -40,9 +43,18 @@ typedef float float32;
 typedef double float64;
 
 /*
-	Project-wide selection as to what the default map container type should be
+	Project-wide selection as to what the default map container type should be.  TB_MAP_IS_FLAT uses TBUuidMap (see
+	UuidMap.h) for maps keyed by QUuid, and QHash for the rest.  No configuration sets it yet; TBUuidMap is only used
+	directly by the map benchmark until it's measured well enough to become the default.
 */
-#if TB_MAP_IS_HASH
+#if TB_MAP_IS_FLAT
+class QUuid;
+template<typename ValueType>
+class TBUuidMap;
+
+template<typename KeyType, typename ValueType>
+using TBMap = std::conditional_t<std::is_same_v<KeyType, QUuid>, TBUuidMap<ValueType>, QHash<KeyType, ValueType>>;
+#elif TB_MAP_IS_HASH
 template<typename KeyType, typename ValueType>
 using TBMap = QHash<KeyType, ValueType>;
 #else
@@ -101,4 +113,17 @@ ENUM_CLASS(TBEventType, uint8,
 	Cosmic,
 	Religious,
 	Innovation
-)
\ No newline at end of file
+)
+
+/*
+	Dense index the timeline gives each of its events when it loads, so that links between events can be followed by
+	indexing arrays instead of looking up UUIDs.  Only means anything to the timeline that assigned it, and only until
+	it loads again.
+*/
+typedef uint32 TBEventHandle;
+const TBEventHandle NO_EVENT_HANDLE = UINT32_MAX;
+
+#if TB_MAP_IS_FLAT
+// Needs the integer types above, so it comes in last.
+#include "UuidMap.h"
+#endif
\ No newline at end of file
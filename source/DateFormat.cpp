@@ -0,0 +1,215 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (DateFormat.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "DateFormat.h"
+#include "Time.h"
+
+#include <iterator>
+
+// Writes a number in decimal without going through a temporary string.
+static void AppendNumber(QString& text, int64 value)
+{
+	char16_t digits[24];
+	int32 start = static_cast<int32>(std::size(digits));
+	// Work with the negative value, since the most negative int64 has no positive counterpart.
+	int64 remaining = value < 0 ? value : -value;
+	do
+	{
+		digits[--start] = static_cast<char16_t>(u'0' - remaining % 10);
+		remaining /= 10;
+	} while (remaining != 0);
+
+	if (value < 0)
+	{
+		digits[--start] = u'-';
+	}
+	text.append(reinterpret_cast<const QChar*>(digits + start), static_cast<qsizetype>(std::size(digits)) - start);
+}
+
+TBDateFormatProgram::TBDateFormatProgram() :
+	Steps(),
+	Literals(),
+	Tables(),
+	ExpectedLength(0),
+	DayNumberUsed(false)
+{}
+
+std::unique_ptr<TBDateFormatProgram> TBDateFormatProgram::Compile(const QString& format, const QHash<QString, TBNameTable>& tables,
+	int32 brokenDateLength, QString& outError)
+{
+	std::unique_ptr<TBDateFormatProgram> program(new TBDateFormatProgram());
+	QHash<QString, int32> tableIndices;
+	QString literal;
+
+	auto flushLiteral = [&]()
+	{
+		if (!literal.isEmpty())
+		{
+			program->Steps.push_back({ StepType::Literal, static_cast<int32>(program->Literals.size()), -1 });
+			program->ExpectedLength += literal.size();
+			program->Literals.append(literal);
+			literal.clear();
+		}
+	};
+
+	// Reads "{name}" at position, and returns the index of that table in the program.
+	auto readTable = [&](qsizetype& position, bool wantCycle) -> int32
+	{
+		const qsizetype closing = format.indexOf('}', position);
+		if (closing < 0)
+		{
+			outError = QString("Unterminated table name at position %0.").arg(position);
+			return -1;
+		}
+
+		const QString tableName = format.mid(position + 1, closing - position - 1);
+		position = closing + 1;
+		auto table = tables.constFind(tableName);
+		if (table == tables.constEnd())
+		{
+			outError = QString("Unknown name table '%0'.").arg(tableName);
+			return -1;
+		}
+		if (table->IsCycle != wantCycle || table->Names.isEmpty())
+		{
+			outError = QString("Name table '%0' can't be used %1.").arg(tableName, wantCycle ? "for days" : "for a component");
+			return -1;
+		}
+
+		if (!tableIndices.contains(tableName))
+		{
+			tableIndices.insert(tableName, static_cast<int32>(program->Tables.size()));
+			program->Tables.push_back(*table);
+		}
+		return tableIndices.value(tableName);
+	};
+
+	qsizetype position = 0;
+	while (position < format.size())
+	{
+		const QChar character = format[position];
+		if (character != '%')
+		{
+			literal.append(character);
+			position++;
+			continue;
+		}
+
+		position++;
+		if (position < format.size() && format[position] == '%')
+		{
+			literal.append('%');
+			position++;
+		}
+		else if (position < format.size() && format[position] == '{')
+		{
+			flushLiteral();
+			const int32 table = readTable(position, true);
+			if (table < 0)
+			{
+				return nullptr;
+			}
+			program->Steps.push_back({ StepType::CycleName, 0, table });
+			program->DayNumberUsed = true;
+			program->ExpectedLength += 8;
+		}
+		else if (position < format.size() && format[position].isDigit())
+		{
+			// One or two digits, same as QString::arg().
+			int32 component = format[position++].digitValue();
+			if (position < format.size() && format[position].isDigit())
+			{
+				component = component * 10 + format[position++].digitValue();
+			}
+			if (component >= brokenDateLength)
+			{
+				outError = QString("Placeholder %%0 is past the end of a %1-component date.").arg(component).arg(brokenDateLength);
+				return nullptr;
+			}
+
+			flushLiteral();
+			if (position < format.size() && format[position] == '{')
+			{
+				const int32 table = readTable(position, false);
+				if (table < 0)
+				{
+					return nullptr;
+				}
+				program->Steps.push_back({ StepType::ComponentName, component, table });
+			}
+			else
+			{
+				program->Steps.push_back({ StepType::Component, component, -1 });
+			}
+			program->ExpectedLength += 8;
+		}
+		else
+		{
+			outError = QString("Unrecognized placeholder at position %0.").arg(position - 1);
+			return nullptr;
+		}
+	}
+	flushLiteral();
+
+	return program;
+}
+
+bool TBDateFormatProgram::Format(int64 day, std::span<const int64> components, QString& outText) const
+{
+	outText.clear();
+	outText.reserve(ExpectedLength);
+
+	for (const Step& step : Steps)
+	{
+		switch (step.Type)
+		{
+		case StepType::Literal:
+			outText.append(Literals[step.Argument]);
+			break;
+		case StepType::Component:
+			if (static_cast<size_t>(step.Argument) >= components.size())
+			{
+				return false;
+			}
+			AppendNumber(outText, components[step.Argument]);
+			break;
+		case StepType::ComponentName:
+		{
+			if (static_cast<size_t>(step.Argument) >= components.size())
+			{
+				return false;
+			}
+			const TBNameTable& table = Tables[step.Table];
+			const int64 nameIndex = components[step.Argument] - table.FirstValue;
+			if (nameIndex < 0 || nameIndex >= table.Names.size())
+			{
+				return false;
+			}
+			outText.append(table.Names[nameIndex]);
+			break;
+		}
+		case StepType::CycleName:
+		{
+			const TBNameTable& table = Tables[step.Table];
+			outText.append(table.Names[FloorMod(day - table.CycleStartDay, table.Names.size())]);
+			break;
+		}
+		}
+	}
+
+	return true;
+}
\ No newline at end of file
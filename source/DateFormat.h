@@ -0,0 +1,92 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (DateFormat.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include <memory>
+#include <span>
+#include <vector>
+
+/*
+	Names a calendar script hands over once, so that dates can be formatted without calling it.  A table either names
+	the values of a broken date component (months), or names days in a repeating cycle (weekdays).
+*/
+struct TBNameTable
+{
+	QStringList Names;
+	// Component tables: the value that gets Names[0].
+	int64 FirstValue = 0;
+	// Cycle tables repeat every Names.size() days, starting with Names[0] on CycleStartDay.
+	bool IsCycle = false;
+	int64 CycleStartDay = 0;
+};
+
+/*
+	A date format template compiled into a list of steps that write straight into the output string.
+
+	Templates use the same %N placeholders as get_date_format(), for broken date component N, plus:
+	- %N{table}: component N, looked up in a component table
+	- %{table}: the day's name in a cycle table
+	- %%: a literal percent sign
+*/
+class TBDateFormatProgram
+{
+public:
+	// Returns null and sets outError if the template doesn't make sense for these tables and broken date length.
+	static std::unique_ptr<TBDateFormatProgram> Compile(const QString& format, const QHash<QString, TBNameTable>& tables,
+		int32 brokenDateLength, QString& outError);
+
+	// Whether Format() needs the day number as well as the broken date.
+	bool UsesDayNumber() const { return DayNumberUsed; }
+
+	// Replaces outText with the formatted date.  Returns false if a value has no name in its table, in which case
+	// the caller should ask the script instead.
+	bool Format(int64 day, std::span<const int64> components, QString& outText) const;
+
+private:
+	enum class StepType : uint8
+	{
+		Literal,
+		Component,
+		ComponentName,
+		CycleName
+	};
+
+	struct Step
+	{
+		StepType Type;
+		// Component index, or literal index for Literal steps.
+		int32 Argument;
+		// Index into Tables for name lookups.
+		int32 Table;
+	};
+
+	TBDateFormatProgram();
+
+	std::vector<Step> Steps;
+	QStringList Literals;
+	std::vector<TBNameTable> Tables;
+	// Rough output length, so that Format() usually only allocates once.
+	qsizetype ExpectedLength;
+	bool DayNumberUsed;
+};
\ No newline at end of file
@@ -16,6 +16,7 @@
 */
 
 #include "Era.h"
+#include "Calendar.h"
 
 TBEra::TBEra() : JsonableObject(),
 	Name(),
@@ -23,6 +24,9 @@ TBEra::TBEra() : JsonableObject(),
 	BoundsType(TBPeriodBounds::_INVALIDVALUE_),
 	StartDate(),
 	EndDate(),
+	StartDay(),
+	EndDay(),
+	DaysResolved(false),
 	CalendarOverride(),
 	EraID()
 {}
@@ -36,6 +40,8 @@ bool TBEra::LoadFromJson(const QJsonObject& jsonObject)
 	BoundsType = JsonToEnum(jsonObject, "bounds_type", TBPeriodBounds);
 	JsonArrayToBrokenDate(jsonObject, "start_date", StartDate);
 	JsonArrayToBrokenDate(jsonObject, "end_date", EndDate);
+	// Day numbers need the calendar, so the timeline resolves them for all its eras at once.
+	DaysResolved = false;
 	CalendarOverride = JsonToUuid(jsonObject, "calendar_override");
 	EraID = JsonToUuid(jsonObject, "id");
 
@@ -51,4 +57,25 @@ void TBEra::PopulateJson(QJsonObject& jsonObject) const
 	BrokenDateToJsonArray(jsonObject, "end_date", EndDate);
 	jsonObject.insert("calendar_override", UuidToJson(CalendarOverride));
 	jsonObject.insert("id", UuidToJson(EraID));
+}
+
+void TBEra::SetDates(const TBBrokenDate& startDate, const TBBrokenDate& endDate, const TBCalendarSystem& calendar)
+{
+	StartDate = startDate;
+	EndDate = endDate;
+	SetResolvedDays(CombinePeriodDate(calendar, StartDate), CombinePeriodDate(calendar, EndDate));
+}
+
+void TBEra::SetResolvedDays(std::optional<TBDate> startDay, std::optional<TBDate> endDay)
+{
+	const TBResolvedDays resolvedDays = ResolvePeriodDays(BoundsType, !EndDate.isEmpty(), startDay, endDay);
+	StartDay = resolvedDays.StartDay;
+	EndDay = resolvedDays.EndDay;
+	DaysResolved = resolvedDays.Resolved;
+}
+
+bool TBEra::ContainsDay(TBDate day) const
+{
+	const TBActiveDays activeDays = GetActiveDays();
+	return DaysResolved && day.GetDays() >= activeDays.First && day.GetDays() <= activeDays.Last;
 }
\ No newline at end of file
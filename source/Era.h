@@ -23,6 +23,10 @@
 #include <QtCore/QUuid>
 #include <QtCore/QString>
 
+#include <optional>
+
+class TBCalendarSystem;
+
 class TBEra : public JsonableObject
 {
 public:
@@ -31,6 +35,27 @@ public:
 	virtual bool LoadFromJson(const QJsonObject& jsonObject) override;
 	virtual void PopulateJson(QJsonObject& jsonObject) const override;
 
+	QUuid GetID() const { return EraID; }
+	// These are in the timeline's default calendar.
+	const TBBrokenDate& GetStartDate() const { return StartDate; }
+	const TBBrokenDate& GetEndDate() const { return EndDate; }
+	// Resolves the new dates through calendar right away, so that the day numbers always match them.
+	void SetDates(const TBBrokenDate& startDate, const TBBrokenDate& endDate, const TBCalendarSystem& calendar);
+
+	// Day numbers of the start and end dates, kept by the timeline so that comparisons don't need the calendar.  Only
+	// meaningful if HasResolvedDays().
+	bool HasResolvedDays() const { return DaysResolved; }
+	TBDate GetStartDay() const { return StartDay; }
+	TBDate GetEndDay() const { return EndDay; }
+	TBPeriodBounds GetBoundsType() const { return BoundsType; }
+	TBActiveDays GetActiveDays() const { return ::GetActiveDays(BoundsType, StartDay, EndDay); }
+	// Null for dates that didn't combine.  The era is only resolved if every date its bounds need did.
+	void SetResolvedDays(std::optional<TBDate> startDay, std::optional<TBDate> endDay);
+	// Whether the era is active on day.  Never calls into the calendar, and is false for unresolved eras.
+	bool ContainsDay(TBDate day) const;
+	// Null if the era uses the timeline's default calendar.
+	QUuid GetCalendarOverride() const { return CalendarOverride; }
+
 private:
 	// Member variables
 	QString Name;
@@ -40,6 +65,9 @@ private:
 	// The start and end dates are in the base calendar system for the timeline
 	TBBrokenDate StartDate;
 	TBBrokenDate EndDate;
+	TBDate StartDay;
+	TBDate EndDay;
+	bool DaysResolved;
 
 	// Null UUID if we don't override the base calendar system for the timeline
 	QUuid CalendarOverride;
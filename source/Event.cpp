@@ -16,6 +16,9 @@
 */
 
 #include "Event.h"
+#include "Calendar.h"
+
+#include <tuple>
 
 TBEvent::TBEvent() : JsonableObject(),
 	Name(),
@@ -23,10 +26,12 @@ TBEvent::TBEvent() : JsonableObject(),
 	BoundsType(TBPeriodBounds::_INVALIDVALUE_),
 	StartDate(),
 	EndDate(),
+	StartDay(),
+	EndDay(),
+	DaysResolved(false),
 	Significance(TBSignificance::_INVALIDVALUE_),
 	EventID(),
-	ParentID(),
-	PrerequisiteEvents()
+	Handle(NO_EVENT_HANDLE)
 {}
 
 bool TBEvent::LoadFromJson(const QJsonObject& jsonObject)
@@ -38,10 +43,11 @@ bool TBEvent::LoadFromJson(const QJsonObject& jsonObject)
 	BoundsType = JsonToEnum(jsonObject, "bounds_type", TBPeriodBounds);
 	JsonArrayToBrokenDate(jsonObject, "start_date", StartDate);
 	JsonArrayToBrokenDate(jsonObject, "end_date", EndDate);
+	// Day numbers need the calendar, so the timeline resolves them for all its events at once.
+	DaysResolved = false;
 	Significance = JsonToEnum(jsonObject, "significance", TBSignificance);
 	EventID = JsonToUuid(jsonObject, "id");
-	ParentID = JsonToUuid(jsonObject, "parent_id");
-	JsonArrayToUuidList(jsonObject, "prereqs", PrerequisiteEvents);
+	Handle = NO_EVENT_HANDLE;
 
 	return LoadSuccessful;
 }
@@ -55,8 +61,6 @@ void TBEvent::PopulateJson(QJsonObject& jsonObject) const
 	BrokenDateToJsonArray(jsonObject, "end_date", EndDate);
 	jsonObject.insert("significance", EnumToJson(Significance));
 	jsonObject.insert("id", UuidToJson(EventID));
-	jsonObject.insert("parent_id", UuidToJson(ParentID));
-	UuidListToJsonArray(jsonObject, "prereqs", PrerequisiteEvents);
 }
 
 bool TBEvent::operator==(const TBEvent& other) const
@@ -67,4 +71,30 @@ bool TBEvent::operator==(const TBEvent& other) const
 bool TBEvent::operator!=(const TBEvent& other) const
 {
 	return EventID != other.EventID;
+}
+
+void TBEvent::SetDates(const TBBrokenDate& startDate, const TBBrokenDate& endDate, const TBCalendarSystem& calendar)
+{
+	StartDate = startDate;
+	EndDate = endDate;
+	SetResolvedDays(CombinePeriodDate(calendar, StartDate), CombinePeriodDate(calendar, EndDate));
+}
+
+void TBEvent::SetResolvedDays(std::optional<TBDate> startDay, std::optional<TBDate> endDay)
+{
+	const TBResolvedDays resolvedDays = ResolvePeriodDays(BoundsType, !EndDate.isEmpty(), startDay, endDay);
+	StartDay = resolvedDays.StartDay;
+	EndDay = resolvedDays.EndDay;
+	DaysResolved = resolvedDays.Resolved;
+}
+
+bool TBEvent::StartsBefore(const TBEvent& other) const
+{
+	if (DaysResolved != other.DaysResolved)
+	{
+		return DaysResolved;
+	}
+	const TBActiveDays activeDays = GetActiveDays();
+	const TBActiveDays otherActiveDays = other.GetActiveDays();
+	return std::tie(activeDays.First, activeDays.Last, EventID) < std::tie(otherActiveDays.First, otherActiveDays.Last, other.EventID);
 }
\ No newline at end of file
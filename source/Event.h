@@ -23,6 +23,10 @@
 #include <QtCore/QUuid>
 #include <QtCore/QString>
 
+#include <optional>
+
+class TBCalendarSystem;
+
 class TBEvent : public JsonableObject
 {
 public:
@@ -31,9 +35,36 @@ public:
 	virtual bool LoadFromJson(const QJsonObject& jsonObject) override;
 	virtual void PopulateJson(QJsonObject& jsonObject) const override;
 
+	QUuid GetID() const { return EventID; }
+	const QString& GetName() const { return Name; }
+	const QString& GetDescription() const { return Description; }
+	TBSignificance GetSignificance() const { return Significance; }
+
+	// Assigned by the timeline when it loads.  The timeline also keeps the event's parent and prerequisites, by
+	// handle, and reads and writes them along with the event's other fields.
+	TBEventHandle GetHandle() const { return Handle; }
+	void SetHandle(TBEventHandle handle) { Handle = handle; }
+	// These are in the timeline's default calendar.
+	const TBBrokenDate& GetStartDate() const { return StartDate; }
+	const TBBrokenDate& GetEndDate() const { return EndDate; }
+	// Resolves the new dates through calendar right away, so that the day numbers always match them.
+	void SetDates(const TBBrokenDate& startDate, const TBBrokenDate& endDate, const TBCalendarSystem& calendar);
+
+	// Day numbers of the start and end dates, kept by the timeline so that comparisons don't need the calendar.  Only
+	// meaningful if HasResolvedDays().
+	bool HasResolvedDays() const { return DaysResolved; }
+	TBDate GetStartDay() const { return StartDay; }
+	TBDate GetEndDay() const { return EndDay; }
+	TBPeriodBounds GetBoundsType() const { return BoundsType; }
+	TBActiveDays GetActiveDays() const { return ::GetActiveDays(BoundsType, StartDay, EndDay); }
+	// Null for dates that didn't combine.  The event is only resolved if every date its bounds need did.
+	void SetResolvedDays(std::optional<TBDate> startDay, std::optional<TBDate> endDay);
+
 	// Sorting
 	bool operator==(const TBEvent& other) const;
 	bool operator!=(const TBEvent& other) const;
+	// By first active day, then last active day, then ID, with unresolved events last.  Never calls into the calendar.
+	bool StartsBefore(const TBEvent& other) const;
 
 private:
 	// Member variables
@@ -42,12 +73,10 @@ private:
 	TBPeriodBounds BoundsType;
 	TBBrokenDate StartDate;
 	TBBrokenDate EndDate;
+	TBDate StartDay;
+	TBDate EndDay;
+	bool DaysResolved;
 	TBSignificance Significance;
 	QUuid EventID;
-
-	// Can be null UUID if no parent event
-	QUuid ParentID;
-
-	// For events that have imprecise dates
-	QList<QUuid> PrerequisiteEvents;
+	TBEventHandle Handle;
 };
\ No newline at end of file
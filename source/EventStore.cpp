@@ -0,0 +1,125 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (EventStore.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "EventStore.h"
+#include "Event.h"
+
+#include <limits>
+
+TBEventStore::TBEventStore() :
+	FirstActiveDays(),
+	LastActiveDays(),
+	Significances(),
+	BoundsTypes(),
+	Parents(),
+	Names(),
+	Descriptions()
+{}
+
+void TBEventStore::Rebuild(std::span<const TBEvent* const> events, std::span<const TBEventHandle> parents)
+{
+	Clear();
+	const size_t rowCount = events.size();
+	FirstActiveDays.resize(rowCount);
+	LastActiveDays.resize(rowCount);
+	Significances.resize(rowCount);
+	BoundsTypes.resize(rowCount);
+	// The timeline has already linked parents by handle, so they're taken as they are.
+	Parents.assign(parents.begin(), parents.end());
+	Parents.resize(rowCount, NO_EVENT_HANDLE);
+	Names.resize(rowCount);
+	Descriptions.resize(rowCount);
+
+	for (TBEventHandle handle = 0; handle < rowCount; ++handle)
+	{
+		SetRow(handle, *events[handle]);
+	}
+}
+
+void TBEventStore::Update(const TBEvent& event)
+{
+	if (event.GetHandle() < FirstActiveDays.size())
+	{
+		SetRow(event.GetHandle(), event);
+	}
+}
+
+void TBEventStore::Clear()
+{
+	FirstActiveDays.clear();
+	LastActiveDays.clear();
+	Significances.clear();
+	BoundsTypes.clear();
+	Parents.clear();
+	Names.clear();
+	Descriptions.clear();
+}
+
+int64 TBEventStore::CountOverlapping(int64 firstDay, int64 lastDay) const
+{
+	// No branches in the loop, so the compiler can vectorize it.
+	const int64* firstActiveDays = FirstActiveDays.data();
+	const int64* lastActiveDays = LastActiveDays.data();
+	const size_t rowCount = FirstActiveDays.size();
+	int64 count = 0;
+	for (size_t row = 0; row < rowCount; ++row)
+	{
+		count += static_cast<int64>((firstActiveDays[row] <= lastDay) & (lastActiveDays[row] >= firstDay));
+	}
+	return count;
+}
+
+void TBEventStore::FindOverlapping(int64 firstDay, int64 lastDay, TBSignificance minimumSignificance, std::vector<TBEventHandle>& outHandles) const
+{
+	const int64* firstActiveDays = FirstActiveDays.data();
+	const int64* lastActiveDays = LastActiveDays.data();
+	const TBSignificance* significances = Significances.data();
+	// Invalid significance is 0, which wraps around to the top when one is taken off and so is never kept.
+	const uint8 significanceLimit = static_cast<uint8>(minimumSignificance);
+	const TBEventHandle rowCount = static_cast<TBEventHandle>(FirstActiveDays.size());
+
+	// Every handle is written out and only the matches are kept, rather than branching on each one.
+	size_t found = outHandles.size();
+	outHandles.resize(found + rowCount);
+	TBEventHandle* out = outHandles.data();
+	for (TBEventHandle handle = 0; handle < rowCount; ++handle)
+	{
+		const uint8 significanceRank = static_cast<uint8>(static_cast<uint8>(significances[handle]) - 1);
+		out[found] = handle;
+		found += static_cast<size_t>((firstActiveDays[handle] <= lastDay) & (lastActiveDays[handle] >= firstDay) & (significanceRank < significanceLimit));
+	}
+	outHandles.resize(found);
+}
+
+void TBEventStore::SetRow(TBEventHandle handle, const TBEvent& event)
+{
+	if (event.HasResolvedDays())
+	{
+		const TBActiveDays activeDays = event.GetActiveDays();
+		FirstActiveDays[handle] = activeDays.First;
+		LastActiveDays[handle] = activeDays.Last;
+	}
+	else
+	{
+		FirstActiveDays[handle] = std::numeric_limits<int64>::max();
+		LastActiveDays[handle] = std::numeric_limits<int64>::min();
+	}
+	Significances[handle] = event.GetSignificance();
+	BoundsTypes[handle] = event.GetBoundsType();
+	Names[handle] = event.GetName();
+	Descriptions[handle] = event.GetDescription();
+}
\ No newline at end of file
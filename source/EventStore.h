@@ -0,0 +1,78 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (EventStore.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+#include "Time.h"
+
+#include <QtCore/QString>
+
+#include <span>
+#include <vector>
+
+class TBEvent;
+
+/*
+	The fields of a timeline's events that filtering and layout look at, one contiguous column each, so that a pass
+	over millions of events only reads the columns it needs.  Each event's row is its handle, so rows stay put until
+	the timeline is loaded again.  Names and descriptions are kept in their own columns, which scans never touch.
+
+	Events whose days aren't resolved get a first active day after their last, so range scans never match them and
+	don't need to check.
+
+	The timeline keeps this in step with its TBEvents, which are still what gets edited and saved.
+*/
+class TBEventStore
+{
+public:
+	TBEventStore();
+
+	// Replaces everything.  events and parents are both indexed by handle, as the timeline keeps them.
+	void Rebuild(std::span<const TBEvent* const> events, std::span<const TBEventHandle> parents);
+	// Updates the row of an event that was in the last rebuild.
+	void Update(const TBEvent& event);
+	void Clear();
+
+	int32 GetRowCount() const { return static_cast<int32>(FirstActiveDays.size()); }
+
+	// Columns, indexed by handle.
+	std::span<const int64> GetFirstActiveDays() const { return FirstActiveDays; }
+	std::span<const int64> GetLastActiveDays() const { return LastActiveDays; }
+	std::span<const TBSignificance> GetSignificances() const { return Significances; }
+	std::span<const TBPeriodBounds> GetBoundsTypes() const { return BoundsTypes; }
+	// NO_EVENT_HANDLE for events without a parent in the timeline.
+	std::span<const TBEventHandle> GetParents() const { return Parents; }
+	std::span<const QString> GetNames() const { return Names; }
+	std::span<const QString> GetDescriptions() const { return Descriptions; }
+
+	// Scans.  Handles are found in order.  Significance counts down from Monumental, so minimumSignificance keeps
+	// events at least that significant.
+	int64 CountOverlapping(int64 firstDay, int64 lastDay) const;
+	void FindOverlapping(int64 firstDay, int64 lastDay, TBSignificance minimumSignificance, std::vector<TBEventHandle>& outHandles) const;
+
+private:
+	void SetRow(TBEventHandle handle, const TBEvent& event);
+
+	std::vector<int64> FirstActiveDays;
+	std::vector<int64> LastActiveDays;
+	std::vector<TBSignificance> Significances;
+	std::vector<TBPeriodBounds> BoundsTypes;
+	std::vector<TBEventHandle> Parents;
+	std::vector<QString> Names;
+	std::vector<QString> Descriptions;
+};
\ No newline at end of file
@@ -0,0 +1,149 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (InlineList.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+
+#include <QtCore/QHashFunctions>
+
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+/*
+	List with a fixed maximum length, stored entirely inside the object.  Copying one never allocates, which matters
+	for small values that exist in large numbers (every event carries two broken dates).
+
+	The interface follows the parts of QList that those values actually use.  Growing past Capacity throws
+	std::length_error; code reading lists from outside (JSON, scripts) should check CanHold() first.
+*/
+template<typename T, int32 Capacity>
+class TBInlineList
+{
+	static_assert(Capacity > 0, "TBInlineList needs room for at least one element.");
+	static_assert(std::is_trivially_copyable_v<T>, "TBInlineList only holds trivially copyable types.");
+
+public:
+	typedef T value_type;
+	typedef T* iterator;
+	typedef const T* const_iterator;
+	typedef qsizetype size_type;
+
+	static constexpr int32 MaxLength = Capacity;
+
+	TBInlineList() : Elements(), Length(0) {}
+
+	TBInlineList(qsizetype count, const T& value) : TBInlineList()
+	{
+		resize(count, value);
+	}
+
+	TBInlineList(std::initializer_list<T> values) : TBInlineList(values.begin(), values.end()) {}
+
+	template<std::input_iterator Iterator>
+	TBInlineList(Iterator first, Iterator last) : TBInlineList()
+	{
+		for (; first != last; ++first)
+		{
+			append(*first);
+		}
+	}
+
+	static constexpr bool CanHold(qsizetype count) { return count >= 0 && count <= Capacity; }
+
+	qsizetype size() const { return Length; }
+	qsizetype length() const { return Length; }
+	qsizetype count() const { return Length; }
+	bool isEmpty() const { return Length == 0; }
+	bool empty() const { return Length == 0; }
+
+	T* data() { return Elements; }
+	const T* data() const { return Elements; }
+	const T* constData() const { return Elements; }
+
+	iterator begin() { return Elements; }
+	iterator end() { return Elements + Length; }
+	const_iterator begin() const { return Elements; }
+	const_iterator end() const { return Elements + Length; }
+	const_iterator cbegin() const { return Elements; }
+	const_iterator cend() const { return Elements + Length; }
+
+	T& operator[](qsizetype index) { return Elements[index]; }
+	const T& operator[](qsizetype index) const { return Elements[index]; }
+	const T& at(qsizetype index) const { return Elements[index]; }
+	T& front() { return Elements[0]; }
+	const T& front() const { return Elements[0]; }
+	T& back() { return Elements[Length - 1]; }
+	const T& back() const { return Elements[Length - 1]; }
+	T& first() { return front(); }
+	const T& first() const { return front(); }
+	T& last() { return back(); }
+	const T& last() const { return back(); }
+
+	void append(const T& value)
+	{
+		CheckLength(Length + 1);
+		Elements[Length++] = value;
+	}
+	void push_back(const T& value) { append(value); }
+	void emplaceBack(const T& value) { append(value); }
+
+	// New elements are value-initialized, same as QList.
+	void resize(qsizetype newLength) { resize(newLength, T()); }
+	void resize(qsizetype newLength, const T& value)
+	{
+		CheckLength(newLength);
+		std::fill(Elements + std::min<qsizetype>(Length, newLength), Elements + newLength, value);
+		Length = static_cast<int32>(newLength);
+	}
+
+	// Storage is fixed, so this only checks that the list could ever get that long.
+	void reserve(qsizetype newLength) { CheckLength(newLength); }
+	void clear() { Length = 0; }
+
+	bool operator==(const TBInlineList& other) const
+	{
+		return std::equal(begin(), end(), other.begin(), other.end());
+	}
+
+	// Lexicographic, same as QList.
+	bool operator<(const TBInlineList& other) const
+	{
+		return std::lexicographical_compare(begin(), end(), other.begin(), other.end());
+	}
+
+private:
+	static void CheckLength(qsizetype newLength)
+	{
+		if (!CanHold(newLength))
+		{
+			throw std::length_error("TBInlineList capacity exceeded.");
+		}
+	}
+
+	T Elements[Capacity];
+	int32 Length;
+};
+
+template<typename T, int32 Capacity>
+size_t qHash(const TBInlineList<T, Capacity>& list, size_t seed = 0)
+{
+	return qHashRange(list.begin(), list.end(), seed);
+}
\ No newline at end of file
@@ -0,0 +1,235 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (IntervalIndex.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "IntervalIndex.h"
+
+#include <algorithm>
+
+template<typename IDType>
+TBIntervalIndex<IDType>::TBIntervalIndex() :
+	Nodes(),
+	FreeNodes(),
+	Root(NO_NODE),
+	Ranges(),
+	PriorityGenerator()
+{}
+
+template<typename IDType>
+void TBIntervalIndex<IDType>::Insert(const IDType& id, TBActiveDays activeDays)
+{
+	Remove(id);
+
+	int32 nodeIndex = NO_NODE;
+	if (!FreeNodes.empty())
+	{
+		nodeIndex = FreeNodes.back();
+		FreeNodes.pop_back();
+	}
+	else
+	{
+		nodeIndex = static_cast<int32>(Nodes.size());
+		Nodes.emplace_back();
+	}
+
+	Node& node = Nodes[nodeIndex];
+	node.First = activeDays.First;
+	node.Last = activeDays.Last;
+	node.SubtreeLast = activeDays.Last;
+	node.ID = id;
+	node.Priority = static_cast<uint32>(PriorityGenerator());
+	node.Left = NO_NODE;
+	node.Right = NO_NODE;
+
+	int32 leftIndex = NO_NODE;
+	int32 rightIndex = NO_NODE;
+	SplitNodes(Root, node, leftIndex, rightIndex);
+	Root = MergeNodes(MergeNodes(leftIndex, nodeIndex), rightIndex);
+	Ranges.insert(id, activeDays);
+}
+
+template<typename IDType>
+bool TBIntervalIndex<IDType>::Remove(const IDType& id)
+{
+	auto range = Ranges.find(id);
+	if (range == Ranges.end())
+	{
+		return false;
+	}
+
+	Root = RemoveNode(Root, range->First, range->Last, id);
+	Ranges.erase(range);
+	return true;
+}
+
+template<typename IDType>
+void TBIntervalIndex<IDType>::Clear()
+{
+	Nodes.clear();
+	FreeNodes.clear();
+	Root = NO_NODE;
+	Ranges.clear();
+}
+
+template<typename IDType>
+void TBIntervalIndex<IDType>::FindOverlapping(int64 firstDay, int64 lastDay, std::vector<IDType>& outIDs) const
+{
+	if (firstDay <= lastDay)
+	{
+		CollectOverlapping(Root, firstDay, lastDay, outIDs);
+	}
+}
+
+template<typename IDType>
+bool TBIntervalIndex<IDType>::NodeLess(const Node& node, int64 first, int64 last, const IDType& id) const
+{
+	if (node.First != first)
+	{
+		return node.First < first;
+	}
+	if (node.Last != last)
+	{
+		return node.Last < last;
+	}
+	return node.ID < id;
+}
+
+template<typename IDType>
+void TBIntervalIndex<IDType>::UpdateSubtreeLast(int32 nodeIndex)
+{
+	Node& node = Nodes[nodeIndex];
+	node.SubtreeLast = node.Last;
+	if (node.Left != NO_NODE)
+	{
+		node.SubtreeLast = std::max(node.SubtreeLast, Nodes[node.Left].SubtreeLast);
+	}
+	if (node.Right != NO_NODE)
+	{
+		node.SubtreeLast = std::max(node.SubtreeLast, Nodes[node.Right].SubtreeLast);
+	}
+}
+
+template<typename IDType>
+void TBIntervalIndex<IDType>::SplitNodes(int32 nodeIndex, const Node& key, int32& outLeftIndex, int32& outRightIndex)
+{
+	if (nodeIndex == NO_NODE)
+	{
+		outLeftIndex = NO_NODE;
+		outRightIndex = NO_NODE;
+		return;
+	}
+
+	Node& node = Nodes[nodeIndex];
+	if (NodeLess(node, key.First, key.Last, key.ID))
+	{
+		SplitNodes(node.Right, key, node.Right, outRightIndex);
+		outLeftIndex = nodeIndex;
+	}
+	else
+	{
+		SplitNodes(node.Left, key, outLeftIndex, node.Left);
+		outRightIndex = nodeIndex;
+	}
+	UpdateSubtreeLast(nodeIndex);
+}
+
+template<typename IDType>
+int32 TBIntervalIndex<IDType>::MergeNodes(int32 leftIndex, int32 rightIndex)
+{
+	if (leftIndex == NO_NODE)
+	{
+		return rightIndex;
+	}
+	if (rightIndex == NO_NODE)
+	{
+		return leftIndex;
+	}
+
+	// Higher priorities go nearer the root, which keeps the tree balanced on average.
+	if (Nodes[leftIndex].Priority > Nodes[rightIndex].Priority)
+	{
+		const int32 mergedRight = MergeNodes(Nodes[leftIndex].Right, rightIndex);
+		Nodes[leftIndex].Right = mergedRight;
+		UpdateSubtreeLast(leftIndex);
+		return leftIndex;
+	}
+	else
+	{
+		const int32 mergedLeft = MergeNodes(leftIndex, Nodes[rightIndex].Left);
+		Nodes[rightIndex].Left = mergedLeft;
+		UpdateSubtreeLast(rightIndex);
+		return rightIndex;
+	}
+}
+
+template<typename IDType>
+int32 TBIntervalIndex<IDType>::RemoveNode(int32 nodeIndex, int64 first, int64 last, const IDType& id)
+{
+	if (nodeIndex == NO_NODE)
+	{
+		return NO_NODE;
+	}
+
+	Node& node = Nodes[nodeIndex];
+	if (node.First == first && node.Last == last && node.ID == id)
+	{
+		const int32 replacement = MergeNodes(node.Left, node.Right);
+		FreeNodes.push_back(nodeIndex);
+		return replacement;
+	}
+
+	if (NodeLess(node, first, last, id))
+	{
+		node.Right = RemoveNode(node.Right, first, last, id);
+	}
+	else
+	{
+		node.Left = RemoveNode(node.Left, first, last, id);
+	}
+	UpdateSubtreeLast(nodeIndex);
+	return nodeIndex;
+}
+
+template<typename IDType>
+void TBIntervalIndex<IDType>::CollectOverlapping(int32 nodeIndex, int64 firstDay, int64 lastDay, std::vector<IDType>& outIDs) const
+{
+	if (nodeIndex == NO_NODE)
+	{
+		return;
+	}
+
+	// Nothing under here lasts until the range starts.
+	const Node& node = Nodes[nodeIndex];
+	if (node.SubtreeLast < firstDay)
+	{
+		return;
+	}
+
+	CollectOverlapping(node.Left, firstDay, lastDay, outIDs);
+	// This node and everything to its right start after the range ends.
+	if (node.First > lastDay)
+	{
+		return;
+	}
+	if (node.Last >= firstDay)
+	{
+		outIDs.push_back(node.ID);
+	}
+	CollectOverlapping(node.Right, firstDay, lastDay, outIDs);
+}
+
+template class TBIntervalIndex<TBEventHandle>;
+template class TBIntervalIndex<QUuid>;
\ No newline at end of file
@@ -0,0 +1,85 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (IntervalIndex.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+#include "Time.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QUuid>
+
+#include <random>
+#include <vector>
+
+/*
+	Day ranges of events or eras, keyed by their handles or IDs, for finding everything active over a range of days
+	without looking at every one.  Ranges include both ends, and open ends are just the limits of int64 (see
+	TBActiveDays).  Instantiated for TBEventHandle and QUuid only.
+
+	This is a treap ordered by first day, where each node also keeps the latest last day in its subtree.  Inserting and
+	removing take O(log n) expected time.  A query skips every subtree that ends before the range or starts after it,
+	so it takes O(log n + k) for the usual case of few long ranges among many short ones, and O(k log n) at worst.
+*/
+template<typename IDType>
+class TBIntervalIndex
+{
+public:
+	TBIntervalIndex();
+
+	// Replaces any range the ID already had.
+	void Insert(const IDType& id, TBActiveDays activeDays);
+	bool Remove(const IDType& id);
+	void Clear();
+	int64 Size() const { return Ranges.size(); }
+
+	// Appends the ID of every range overlapping [firstDay, lastDay] to outIDs, in order of first day.
+	void FindOverlapping(int64 firstDay, int64 lastDay, std::vector<IDType>& outIDs) const;
+	void FindActiveOn(int64 day, std::vector<IDType>& outIDs) const { FindOverlapping(day, day, outIDs); }
+
+private:
+	static constexpr int32 NO_NODE = -1;
+
+	struct Node
+	{
+		int64 First = 0;
+		int64 Last = 0;
+		// Latest Last in this node's subtree.
+		int64 SubtreeLast = 0;
+		IDType ID = IDType();
+		uint32 Priority = 0;
+		int32 Left = NO_NODE;
+		int32 Right = NO_NODE;
+	};
+
+	// Orders nodes by first day, then last day, then ID, so that every node has a distinct place.
+	bool NodeLess(const Node& node, int64 first, int64 last, const IDType& id) const;
+	void UpdateSubtreeLast(int32 nodeIndex);
+	// Splits a subtree into the nodes before key and the rest.
+	void SplitNodes(int32 nodeIndex, const Node& key, int32& outLeftIndex, int32& outRightIndex);
+	// Joins two subtrees, where every node in the left one comes before every node in the right.
+	int32 MergeNodes(int32 leftIndex, int32 rightIndex);
+	int32 RemoveNode(int32 nodeIndex, int64 first, int64 last, const IDType& id);
+	void CollectOverlapping(int32 nodeIndex, int64 firstDay, int64 lastDay, std::vector<IDType>& outIDs) const;
+
+	std::vector<Node> Nodes;
+	std::vector<int32> FreeNodes;
+	int32 Root;
+	// Each ID's range, which is where its node is in the tree.
+	QHash<IDType, TBActiveDays> Ranges;
+	std::minstd_rand PriorityGenerator;
+};
\ No newline at end of file
@@ -28,6 +28,7 @@
 
 #include "CommonTypes.h"
 #include "CommonConcepts.h"
+#include "InlineList.h"
 
 // Overloaded methods and default parameters aren't handled especially elegantly when it comes to this templating,
 // so we need to wrap the offending methods in functions to use in the JsonToX aliases.
@@ -76,6 +77,10 @@ protected:
 	template<typename T>
 	void JsonArrayToList(const QJsonObject& jsonObject, const QString& key, QList<T>& outList,
 		std::function<bool(const QJsonValue&)> typeCheckMethod, std::function<T(const QJsonValue&)> getMethod);
+
+	template<typename T, int32 Capacity>
+	void JsonArrayToList(const QJsonObject& jsonObject, const QString& key, TBInlineList<T, Capacity>& outList,
+		std::function<bool(const QJsonValue&)> typeCheckMethod, std::function<T(const QJsonValue&)> getMethod);
 	
 	template<typename ValueType>
 	void JsonObjectToMap(const QJsonObject& jsonObject, const QString& key, TBMap<QString, ValueType>& outMap,
@@ -111,6 +116,9 @@ protected:
 	// For types that have direct conversions to QJsonValue, use the first overload of ListToJsonArray()
 	template<typename ElemType>
 	static void ListToJsonArray(QJsonObject& parentObject, const QString& key, const QList<ElemType>& inList);
+
+	template<typename ElemType, int32 Capacity>
+	static void ListToJsonArray(QJsonObject& parentObject, const QString& key, const TBInlineList<ElemType, Capacity>& inList);
 	
 	template<typename ListElemType, typename ArrayElemType>
 	static void ListToJsonArray(QJsonObject& parentObject, const QString& key, const QList<ListElemType>& inList,
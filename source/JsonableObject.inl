@@ -113,6 +113,49 @@ void JsonableObject::JsonArrayToList(const QJsonObject& jsonObject, const QStrin
 	}
 }
 
+// Same as above, except that arrays longer than the list can hold fail to load.
+template<typename T, int32 Capacity>
+void JsonableObject::JsonArrayToList(const QJsonObject& jsonObject, const QString& key, TBInlineList<T, Capacity>& outList,
+	std::function<bool(const QJsonValue&)> typeCheckMethod, std::function<T(const QJsonValue&)> getMethod)
+{
+	if (!jsonObject.contains(key))
+	{
+		LoadSuccessful = false;
+		TBLog::Warning("No value for key '%0'", key);
+	}
+
+	QJsonValue listValue = jsonObject[key];
+	if (listValue.isUndefined() || !listValue.isArray())
+	{
+		TBLog::Warning("Error parsing array value for key '%0'.", key);
+		LoadSuccessful = false;
+	}
+	else
+	{
+		QJsonArray jsonArray = listValue.toArray();
+		if (!outList.CanHold(outList.length() + jsonArray.count()))
+		{
+			TBLog::Warning("Array for key '%0' has more than %1 elements.", key, Capacity);
+			LoadSuccessful = false;
+			return;
+		}
+
+		for (const QJsonValue& arrayElem : jsonArray)
+		{
+			if (!arrayElem.isUndefined() && typeCheckMethod(arrayElem))
+			{
+				outList.emplaceBack(getMethod(arrayElem));
+			}
+			else
+			{
+				TBLog::Warning("Error parsing array element for key '%0'.", key);
+				LoadSuccessful = false;
+				break;
+			}
+		}
+	}
+}
+
 template<typename ValueType>
 	void JsonableObject::JsonObjectToMap(const QJsonObject& jsonObject, const QString& key, TBMap<QString, ValueType>& outMap,
 		std::function<bool(const QJsonValue&)> typeCheckMethod, std::function<ValueType(const QJsonValue&)> getMethod)
@@ -348,6 +391,18 @@ void JsonableObject::ListToJsonArray(QJsonObject& parentObject, const QString& k
 	parentObject.insert(key, outArray);
 }
 
+template<typename ElemType, int32 Capacity>
+void JsonableObject::ListToJsonArray(QJsonObject& parentObject, const QString& key, const TBInlineList<ElemType, Capacity>& inList)
+{
+	QJsonArray outArray;
+	for (const ElemType& element : inList)
+	{
+		outArray.push_back(element);
+	}
+
+	parentObject.insert(key, outArray);
+}
+
 // For use with that have custom conversions, such as listed in the macros below.
 template<typename ListElemType, typename ArrayElemType>
 void JsonableObject::ListToJsonArray(QJsonObject& parentObject, const QString& key, const QList<ListElemType>& inList,
@@ -40,7 +40,7 @@ QFile* TBLog::LogFile = nullptr;
 // Get the default Qt message handler.  Fun hack I found on StackOverflow.
 static const QtMessageHandler DefaultMessageHandlerFunction = qInstallMessageHandler(0);
 
-void TBLog::Initialize()
+void TBLog::Initialize(bool isWorkerProcess)
 {
 	// Set custom log message formatting and install our custom handler.
 	// See <https://doc.qt.io/qt-6/qtglobal.html#qSetMessagePattern> for documentation on how this formatting works.
@@ -51,10 +51,11 @@ void TBLog::Initialize()
 	// Setup path to log file.
 	QDir logDir = TBUserFiles::GetBasePath();
 	logDir.cd("logs");
-	const QString logFileName("TimelineBuilder.log");
+	const QString logFileName = isWorkerProcess ? QString("TimelineBuilder-worker-%0.log").arg(QCoreApplication::applicationPid())
+		: QString("TimelineBuilder.log");
 
 	// If we already have a log file, rename it so that it may serve as an archive.
-	if (logDir.exists(logFileName))
+	if (!isWorkerProcess && logDir.exists(logFileName))
 	{
 		// The %0 arg will be replaced with the file's creation time in ISO-8601 format.
 		QString logArchiveName = "TimelineBuilder-%0-archive.log";
@@ -97,9 +98,10 @@ void TBLog::Initialize()
 		}
 	}
 
-	// Create a new log file for writing.
+	// Create a new log file for writing.  A worker's file is only left over from an earlier process with the same ID.
 	LogFile = new QFile(logDir.filePath(logFileName));
-	const bool success = LogFile->open(QIODeviceBase::WriteOnly | QIODeviceBase::NewOnly | QIODeviceBase::Append | QIODeviceBase::Text);
+	const QIODeviceBase::OpenMode openMode = isWorkerProcess ? QIODeviceBase::OpenMode(QIODeviceBase::Truncate) : QIODeviceBase::NewOnly | QIODeviceBase::Append;
+	const bool success = LogFile->open(QIODeviceBase::WriteOnly | QIODeviceBase::Text | openMode);
 	if (!success)
 	{
 		Cleanup();
@@ -64,7 +64,9 @@ public:
 		Engine 4/5 pattern, because I like it better that way.
 	*/
 
-	static void Initialize();
+	// Calendar worker processes log to a file of their own, named for their process ID, which is overwritten rather
+	// than archived.  That leaves the main process's log alone while it's open.
+	static void Initialize(bool isWorkerProcess = false);
 	static void Cleanup();
 
 	// void Log(const QString& message, Args&&... args)
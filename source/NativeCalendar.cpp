@@ -0,0 +1,309 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (NativeCalendar.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NativeCalendar.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <numeric>
+
+// Leap rules whose cycles multiply out past this many years are rejected rather than tabulated.
+// The Gregorian calendar only needs 400.
+static constexpr int64 MAX_CYCLE_YEARS = 1 << 16;
+
+/*
+	TBLeapRule
+*/
+TBLeapRule::TBLeapRule() : JsonableObject(),
+	Cycle(0),
+	Offset(0),
+	Days(0)
+{}
+
+bool TBLeapRule::LoadFromJson(const QJsonObject& jsonObject)
+{
+	JsonableObject::LoadFromJson(jsonObject);
+
+	Cycle = JsonToInt64(jsonObject, "cycle");
+	Days = JsonToInt64(jsonObject, "days");
+	if (jsonObject.contains("offset"))
+	{
+		Offset = JsonToInt64(jsonObject, "offset");
+	}
+
+	if (Cycle <= 0)
+	{
+		TBLog::Warning("Leap rule cycle must be positive (got %0).", Cycle);
+		LoadSuccessful = false;
+	}
+
+	return LoadSuccessful;
+}
+
+void TBLeapRule::PopulateJson(QJsonObject& jsonObject) const
+{
+	jsonObject.insert("cycle", Cycle);
+	jsonObject.insert("offset", Offset);
+	jsonObject.insert("days", Days);
+}
+
+/*
+	TBNativeCalendar
+*/
+TBNativeCalendar::TBNativeCalendar() : JsonableObject(),
+	MonthLengths(),
+	LeapRules(),
+	LeapMonth(0),
+	EpochDay(0),
+	YearZero(false),
+	CommonMonthStarts(),
+	CycleYearStarts(),
+	CycleLeapDays(),
+	CycleYears(1),
+	CycleDays(0)
+{}
+
+bool TBNativeCalendar::LoadFromJson(const QJsonObject& jsonObject)
+{
+	JsonableObject::LoadFromJson(jsonObject);
+
+	JsonArrayToInt64List(jsonObject, "month_lengths", MonthLengths);
+	YearZero = JsonToBool(jsonObject, "year_zero");
+
+	// Everything else is optional and defaults to "no leap years, year 1 starts on day 0".
+	if (jsonObject.contains("leap_rules"))
+	{
+		JsonArrayToObjectList(jsonObject, "leap_rules", LeapRules);
+	}
+	// Leap days go to the last month unless told otherwise.
+	LeapMonth = jsonObject.contains("leap_month") ? JsonToInt64(jsonObject, "leap_month") : MonthLengths.length();
+	if (jsonObject.contains("epoch_day"))
+	{
+		EpochDay = JsonToInt64(jsonObject, "epoch_day");
+	}
+
+	if (LoadSuccessful)
+	{
+		LoadSuccessful = CompileRules();
+	}
+
+	return LoadSuccessful;
+}
+
+void TBNativeCalendar::PopulateJson(QJsonObject& jsonObject) const
+{
+	ListToJsonArray(jsonObject, "month_lengths", MonthLengths);
+	ObjectListToJsonArray(jsonObject, "leap_rules", LeapRules);
+	jsonObject.insert("leap_month", LeapMonth);
+	jsonObject.insert("epoch_day", EpochDay);
+	jsonObject.insert("year_zero", YearZero);
+}
+
+bool TBNativeCalendar::CompileRules()
+{
+	if (MonthLengths.isEmpty())
+	{
+		TBLog::Warning("Native calendar rules need at least one month.");
+		return false;
+	}
+	if (LeapMonth < 1 || LeapMonth > MonthLengths.length())
+	{
+		TBLog::Warning("Native calendar leap month %0 is out of range.", LeapMonth);
+		return false;
+	}
+
+	CommonMonthStarts.assign(1, 0);
+	for (int64 monthLength : MonthLengths)
+	{
+		if (monthLength <= 0)
+		{
+			TBLog::Warning("Native calendar month lengths must be positive.");
+			return false;
+		}
+		CommonMonthStarts.push_back(CommonMonthStarts.back() + monthLength);
+	}
+
+	CycleYears = 1;
+	for (const TBLeapRule& rule : LeapRules)
+	{
+		CycleYears = std::lcm(CycleYears, rule.Cycle);
+		if (CycleYears > MAX_CYCLE_YEARS)
+		{
+			TBLog::Warning("Native calendar leap rules repeat over more than %0 years.", MAX_CYCLE_YEARS);
+			return false;
+		}
+	}
+
+	// Year i of a cycle is astronomical year i + 1 (mod CycleYears).
+	CycleYearStarts.assign(1, 0);
+	CycleLeapDays.clear();
+	CycleLeapDays.reserve(CycleYears);
+	const int64 leapMonthLength = MonthLengths[LeapMonth - 1];
+	for (int64 cycleYear = 0; cycleYear < CycleYears; cycleYear++)
+	{
+		int64 leapDays = 0;
+		for (const TBLeapRule& rule : LeapRules)
+		{
+			if (FloorMod(cycleYear + 1 - rule.Offset, rule.Cycle) == 0)
+			{
+				leapDays += rule.Days;
+			}
+		}
+
+		if (leapMonthLength + leapDays <= 0)
+		{
+			TBLog::Warning("Native calendar leap rules shrink month %0 to nothing.", LeapMonth);
+			return false;
+		}
+
+		CycleLeapDays.push_back(leapDays);
+		CycleYearStarts.push_back(CycleYearStarts.back() + CommonMonthStarts.back() + leapDays);
+	}
+	CycleDays = CycleYearStarts.back();
+
+	return true;
+}
+
+int64 TBNativeCalendar::ToAstronomicalYear(int64 year) const
+{
+	// Without a year zero, year -1 directly precedes year 1.
+	return (YearZero || year > 0) ? year : year + 1;
+}
+
+int64 TBNativeCalendar::FromAstronomicalYear(int64 astronomicalYear) const
+{
+	return (YearZero || astronomicalYear > 0) ? astronomicalYear : astronomicalYear - 1;
+}
+
+int64 TBNativeCalendar::GetMonthLength(int64 cycleYear, int64 monthIndex) const
+{
+	const int64 leapDays = (monthIndex == LeapMonth - 1) ? CycleLeapDays[cycleYear] : 0;
+	return MonthLengths[monthIndex] + leapDays;
+}
+
+int64 TBNativeCalendar::GetMonthStart(int64 cycleYear, int64 monthIndex) const
+{
+	const int64 leapDays = (monthIndex > LeapMonth - 1) ? CycleLeapDays[cycleYear] : 0;
+	return CommonMonthStarts[monthIndex] + leapDays;
+}
+
+bool TBNativeCalendar::BreakDate(int64 day, std::span<int64> outComponents) const
+{
+	const int64 relativeDay = day - EpochDay;
+	const int64 cycle = FloorDiv(relativeDay, CycleDays);
+	const int64 dayOfCycle = relativeDay - cycle * CycleDays;
+
+	// CycleYearStarts ends with CycleDays, which is always past dayOfCycle.
+	const int64 cycleYear = std::upper_bound(CycleYearStarts.begin(), CycleYearStarts.end(), dayOfCycle) - CycleYearStarts.begin() - 1;
+	int64 dayOfYear = dayOfCycle - CycleYearStarts[cycleYear];
+
+	int64 monthIndex = 0;
+	while (dayOfYear >= GetMonthLength(cycleYear, monthIndex))
+	{
+		dayOfYear -= GetMonthLength(cycleYear, monthIndex);
+		monthIndex++;
+	}
+
+	outComponents[0] = FromAstronomicalYear(cycle * CycleYears + cycleYear + 1);
+	outComponents[1] = monthIndex + 1;
+	outComponents[2] = dayOfYear + 1;
+	return true;
+}
+
+bool TBNativeCalendar::CombineDate(std::span<const int64> components, int64& outDay) const
+{
+	if (!IsValidBrokenDate(components))
+	{
+		return false;
+	}
+
+	// Partial dates refer to the first day of the year or month.
+	const int64 monthIndex = components.size() >= 2 ? components[1] - 1 : 0;
+	const int64 dayIndex = components.size() >= 3 ? components[2] - 1 : 0;
+
+	const int64 yearIndex = ToAstronomicalYear(components[0]) - 1;
+	const int64 cycle = FloorDiv(yearIndex, CycleYears);
+	const int64 cycleYear = yearIndex - cycle * CycleYears;
+
+	outDay = EpochDay + cycle * CycleDays + CycleYearStarts[cycleYear] + GetMonthStart(cycleYear, monthIndex) + dayIndex;
+	return true;
+}
+
+bool TBNativeCalendar::MoveDate(int64 startDay, std::span<const int64> delta, int64& outDay) const
+{
+	if (delta.empty() || delta.size() > BrokenDateLength)
+	{
+		return false;
+	}
+
+	int64 start[BrokenDateLength];
+	BreakDate(startDay, start);
+
+	// Years and months move the calendar date, clamping the day to the length of the month we land in.
+	// Days are then added directly.
+	const int64 monthCount = MonthLengths.length();
+	const int64 totalMonths = start[1] - 1 + (delta.size() >= 2 ? delta[1] : 0);
+	const int64 yearIndex = ToAstronomicalYear(start[0]) - 1 + delta[0] + FloorDiv(totalMonths, monthCount);
+	const int64 monthIndex = FloorMod(totalMonths, monthCount);
+
+	const int64 cycleYear = FloorMod(yearIndex, CycleYears);
+	const int64 dayIndex = std::min(start[2], GetMonthLength(cycleYear, monthIndex)) - 1;
+
+	const int64 moved[BrokenDateLength] = { FromAstronomicalYear(yearIndex + 1), monthIndex + 1, dayIndex + 1 };
+	if (!CombineDate(moved, outDay))
+	{
+		return false;
+	}
+
+	outDay += delta.size() >= 3 ? delta[2] : 0;
+	return true;
+}
+
+bool TBNativeCalendar::ValidateBrokenDate(std::span<const int64> components, bool& outValid) const
+{
+	outValid = IsValidBrokenDate(components);
+	return true;
+}
+
+bool TBNativeCalendar::IsValidBrokenDate(std::span<const int64> components) const
+{
+	if (components.empty() || components.size() > BrokenDateLength)
+	{
+		return false;
+	}
+
+	if (!YearZero && components[0] == 0)
+	{
+		return false;
+	}
+
+	if (components.size() >= 2 && (components[1] < 1 || components[1] > MonthLengths.length()))
+	{
+		return false;
+	}
+
+	if (components.size() >= 3)
+	{
+		const int64 cycleYear = FloorMod(ToAstronomicalYear(components[0]) - 1, CycleYears);
+		if (components[2] < 1 || components[2] > GetMonthLength(cycleYear, components[1] - 1))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
\ No newline at end of file
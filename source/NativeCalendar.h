@@ -0,0 +1,112 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (NativeCalendar.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+#include "JsonableObject.h"
+#include "Time.h"
+
+#include <QtCore/QString>
+#include <QtCore/QList>
+
+#include <span>
+#include <vector>
+
+/*
+	Anything that can answer calendar conversions without calling into the calendar script.  Methods return false
+	when they can't give an answer, in which case TBCalendarSystem falls back to the script.
+*/
+class TBNativeDateBackend
+{
+public:
+	virtual ~TBNativeDateBackend() = default;
+
+	virtual int32 GetBrokenDateLength() const = 0;
+	// outComponents must have room for GetBrokenDateLength() values.
+	virtual bool BreakDate(int64 day, std::span<int64> outComponents) const = 0;
+	virtual bool CombineDate(std::span<const int64> components, int64& outDay) const = 0;
+	virtual bool MoveDate(int64 startDay, std::span<const int64> delta, int64& outDay) const { return false; }
+	virtual bool ValidateBrokenDate(std::span<const int64> components, bool& outValid) const = 0;
+};
+
+/*
+	A leap rule adds (or removes) days from the leap month of every year where (astronomical year - offset) is a
+	multiple of the cycle.  Gregorian leap years are three of these: +1 every 4, -1 every 100, +1 every 400.
+*/
+class TBLeapRule : public JsonableObject
+{
+public:
+	TBLeapRule();
+
+	virtual bool LoadFromJson(const QJsonObject& jsonObject) override;
+	virtual void PopulateJson(QJsonObject& jsonObject) const override;
+
+	int64 Cycle;
+	int64 Offset;
+	int64 Days;
+};
+
+/*
+	Declarative description of a regular calendar, read from the "native_rules" object of a calendar system's JSON.
+	Calendars that fit this form (fixed month lengths, cyclic leap rules) get their conversions done here as integer
+	arithmetic instead of going through the calendar script.
+
+	Broken dates are always year, month, day.  Months and days are 1-based.
+*/
+class TBNativeCalendar : public JsonableObject, public TBNativeDateBackend
+{
+public:
+	static constexpr int32 BrokenDateLength = 3;
+
+	TBNativeCalendar();
+
+	virtual bool LoadFromJson(const QJsonObject& jsonObject) override;
+	virtual void PopulateJson(QJsonObject& jsonObject) const override;
+
+	// Breaking and validating always succeed.  Combining and moving fail if the input isn't a valid date (or span).
+	virtual int32 GetBrokenDateLength() const override { return BrokenDateLength; }
+	virtual bool BreakDate(int64 day, std::span<int64> outComponents) const override;
+	virtual bool CombineDate(std::span<const int64> components, int64& outDay) const override;
+	virtual bool MoveDate(int64 startDay, std::span<const int64> delta, int64& outDay) const override;
+	virtual bool ValidateBrokenDate(std::span<const int64> components, bool& outValid) const override;
+
+private:
+	// Rebuilds the cycle tables below from the loaded rules.  Returns false if the rules don't describe a usable calendar.
+	bool CompileRules();
+	bool IsValidBrokenDate(std::span<const int64> components) const;
+
+	int64 ToAstronomicalYear(int64 year) const;
+	int64 FromAstronomicalYear(int64 astronomicalYear) const;
+	int64 GetMonthLength(int64 cycleYear, int64 monthIndex) const;
+	int64 GetMonthStart(int64 cycleYear, int64 monthIndex) const;
+
+	// Loaded rules
+	QList<int64> MonthLengths;
+	QList<TBLeapRule> LeapRules;
+	int64 LeapMonth;
+	int64 EpochDay;
+	bool YearZero;
+
+	// Derived from the rules by CompileRules().  One cycle is the least common multiple of the leap rule cycles,
+	// after which year lengths repeat.
+	std::vector<int64> CommonMonthStarts;
+	std::vector<int64> CycleYearStarts;
+	std::vector<int64> CycleLeapDays;
+	int64 CycleYears;
+	int64 CycleDays;
+};
\ No newline at end of file
@@ -0,0 +1,387 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (PeriodicCalendar.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PeriodicCalendar.h"
+#include "Calendar.h"
+#include "CacheFile.h"
+#include "Logging.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+
+#include <algorithm>
+#include <numeric>
+
+// The first probe samples this many days either side of day 0, doubling until the maximum cycle length fits twice.
+static constexpr int64 INITIAL_PROBE_WINDOW = 1024;
+// Verification asks the script for this many days at a time.
+static constexpr int64 VERIFY_CHUNK_DAYS = 1 << 16;
+static constexpr quint32 PROBE_FILE_MAGIC = 0x54425043;		// "TBPC"
+// Bump this whenever the file layout changes, so that old files are rebuilt instead of misread.
+static constexpr quint32 PROBE_FILE_VERSION = 1;
+
+TBPeriodicCalendar::TBPeriodicCalendar() :
+	BrokenDateLength(0),
+	YearZero(true),
+	BaseDay(0),
+	BaseYear(0),
+	CycleDays(0),
+	CycleYears(0),
+	DayYearOffsets(),
+	DayComponents(),
+	DayLookup()
+{}
+
+std::unique_ptr<TBPeriodicCalendar> TBPeriodicCalendar::Build(const TBCalendarSystem& calendar, int64 maxCycleDays, int64 verifyDays)
+{
+	const int32 dateLength = calendar.GetBrokenDateLength();
+	if (dateLength < 1 || maxCycleDays <= 0)
+	{
+		return nullptr;
+	}
+
+	std::unique_ptr<TBPeriodicCalendar> table(new TBPeriodicCalendar());
+	table->BrokenDateLength = dateLength;
+
+	// Year -1 directly precedes year 1 in calendars without a year zero, which would otherwise look like a break
+	// in the cycle.  Scripts that can't answer are assumed to have one; verification catches it if they don't.
+	try
+	{
+		table->YearZero = calendar.ValidateBrokenDate(TBBrokenDate({ 0 }));
+	}
+	catch (...)
+	{
+		table->YearZero = true;
+	}
+
+	std::vector<TBDate> sampleDays;
+	std::vector<int64> sample;
+	int64 minCycleDays = 1;
+	for (int64 window = INITIAL_PROBE_WINDOW; window <= 2 * maxCycleDays; window *= 2)
+	{
+		sampleDays.resize(2 * window);
+		std::iota(sampleDays.begin(), sampleDays.end(), -window);
+		calendar.BreakDates(sampleDays, sample);
+
+		while (table->FindCycle(-window, sample, minCycleDays, maxCycleDays))
+		{
+			if (table->Verify(calendar, verifyDays))
+			{
+				return table;
+			}
+
+			// Small samples can show a shorter pattern that doesn't hold further out, like leap years without their
+			// century exceptions.  Only look for longer cycles from here on.
+			minCycleDays = table->CycleDays + 1;
+		}
+	}
+
+	TBLog::Log("No cycle of up to %0 days found in calendar '%1'.", maxCycleDays, calendar.GetName());
+	return nullptr;
+}
+
+bool TBPeriodicCalendar::FindCycle(int64 sampleStart, const std::vector<int64>& sample, int64 minCycleDays, int64 maxCycleDays)
+{
+	const int64 dateLength = BrokenDateLength;
+	const int64 sampleCount = sample.size() / dateLength;
+	auto yearAt = [&](int64 index) { return ToAstronomicalYear(sample[index * dateLength]); };
+	auto componentsAt = [&](int64 index) { return sample.data() + index * dateLength + 1; };
+
+	std::vector<int64> yearStarts;
+	for (int64 index = 1; index < sampleCount; index++)
+	{
+		if (yearAt(index) != yearAt(index - 1))
+		{
+			yearStarts.push_back(index);
+		}
+	}
+
+	// Candidate cycles always span whole years, so they're the distances from the first year start to the others.
+	const int64 base = yearStarts.empty() ? 0 : yearStarts.front();
+	for (size_t startIndex = 1; startIndex < yearStarts.size(); startIndex++)
+	{
+		const int64 cycleDays = yearStarts[startIndex] - base;
+		if (cycleDays > maxCycleDays || base + 2 * cycleDays > sampleCount)
+		{
+			// Anything longer can't be confirmed with this sample.
+			break;
+		}
+		if (cycleDays < minCycleDays)
+		{
+			continue;
+		}
+
+		// Cheap check first: the spacing of year starts has to repeat.
+		bool yearStartsRepeat = true;
+		for (size_t yearIndex = 0; yearIndex + startIndex < yearStarts.size(); yearIndex++)
+		{
+			if (yearStarts[yearIndex + startIndex] - yearStarts[yearIndex] != cycleDays)
+			{
+				yearStartsRepeat = false;
+				break;
+			}
+		}
+		if (!yearStartsRepeat)
+		{
+			continue;
+		}
+
+		// Then every day of the sample has to match the day one cycle later.
+		const int64 cycleYears = yearAt(base + cycleDays) - yearAt(base);
+		bool daysRepeat = cycleYears > 0;
+		for (int64 index = 0; daysRepeat && index + cycleDays < sampleCount; index++)
+		{
+			daysRepeat = yearAt(index + cycleDays) - yearAt(index) == cycleYears
+				&& std::equal(componentsAt(index), componentsAt(index) + dateLength - 1, componentsAt(index + cycleDays));
+		}
+		if (!daysRepeat)
+		{
+			continue;
+		}
+
+		BaseDay = sampleStart + base;
+		BaseYear = yearAt(base);
+		CycleDays = cycleDays;
+		CycleYears = cycleYears;
+
+		DayYearOffsets.resize(cycleDays);
+		DayComponents.resize(cycleDays * (dateLength - 1));
+		for (int64 dayOfCycle = 0; dayOfCycle < cycleDays; dayOfCycle++)
+		{
+			DayYearOffsets[dayOfCycle] = yearAt(base + dayOfCycle) - BaseYear;
+			std::copy(componentsAt(base + dayOfCycle), componentsAt(base + dayOfCycle) + dateLength - 1,
+				DayComponents.begin() + dayOfCycle * (dateLength - 1));
+		}
+
+		return BuildLookup();
+	}
+
+	return false;
+}
+
+bool TBPeriodicCalendar::BuildLookup()
+{
+	DayLookup.clear();
+	DayLookup.reserve(CycleDays);
+	for (int64 dayOfCycle = 0; dayOfCycle < CycleDays; dayOfCycle++)
+	{
+		TBBrokenDate key({ DayYearOffsets[dayOfCycle] });
+		for (int64 componentIndex = 0; componentIndex < BrokenDateLength - 1; componentIndex++)
+		{
+			key.append(DayComponents[dayOfCycle * (BrokenDateLength - 1) + componentIndex]);
+		}
+		if (DayLookup.contains(key))
+		{
+			TBLog::Warning("Calendar repeats every %0 days, but gives two days in that cycle the same date.", CycleDays);
+			return false;
+		}
+		DayLookup.insert(key, dayOfCycle);
+	}
+
+	return true;
+}
+
+bool TBPeriodicCalendar::Load(const QString& filePath, const QByteArray& scriptHash, int64 maxCycleDays, int64 verifyDays,
+	int32 brokenDateLength, std::unique_ptr<TBPeriodicCalendar>& outTable)
+{
+	outTable.reset();
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return false;
+	}
+
+	QDataStream stream(&file);
+	quint32 magic = 0;
+	quint32 version = 0;
+	QByteArray fileScriptHash;
+	qint64 fileMaxCycleDays = 0;
+	qint64 fileVerifyDays = 0;
+	qint32 fileDateLength = 0;
+	bool foundCycle = false;
+	stream >> magic >> version;
+	if (magic != PROBE_FILE_MAGIC || version != PROBE_FILE_VERSION)
+	{
+		return false;
+	}
+	stream >> fileScriptHash >> fileMaxCycleDays >> fileVerifyDays >> fileDateLength >> foundCycle;
+	if (stream.status() != QDataStream::Ok || fileScriptHash != scriptHash || fileMaxCycleDays != maxCycleDays || fileVerifyDays != verifyDays
+		|| fileDateLength != brokenDateLength || brokenDateLength < 1)
+	{
+		return false;
+	}
+	if (!foundCycle)
+	{
+		return true;
+	}
+
+	std::unique_ptr<TBPeriodicCalendar> table(new TBPeriodicCalendar());
+	table->BrokenDateLength = brokenDateLength;
+	qint64 baseDay = 0;
+	qint64 baseYear = 0;
+	qint64 cycleDays = 0;
+	qint64 cycleYears = 0;
+	stream >> table->YearZero >> baseDay >> baseYear >> cycleDays >> cycleYears;
+	table->BaseDay = baseDay;
+	table->BaseYear = baseYear;
+	table->CycleDays = cycleDays;
+	table->CycleYears = cycleYears;
+	if (stream.status() != QDataStream::Ok || !ReadInt64Vector(stream, table->DayYearOffsets) || !ReadInt64Vector(stream, table->DayComponents))
+	{
+		return false;
+	}
+
+	// Don't trust a file that doesn't hang together, even if it claims to be for this script.
+	if (cycleDays <= 0 || cycleDays > maxCycleDays || cycleYears <= 0 || table->DayYearOffsets.size() != static_cast<size_t>(cycleDays)
+		|| table->DayComponents.size() != static_cast<size_t>(cycleDays * (brokenDateLength - 1)) || !table->BuildLookup())
+	{
+		TBLog::Warning("Calendar cycle file (%0) is damaged.  Probing again.", filePath);
+		return false;
+	}
+
+	outTable = std::move(table);
+	return true;
+}
+
+bool TBPeriodicCalendar::Save(const QString& filePath, const QByteArray& scriptHash, int64 maxCycleDays, int64 verifyDays,
+	int32 brokenDateLength, const TBPeriodicCalendar* table)
+{
+	// Written to the side and moved into place, so that a crash mid-write can't leave half a table behind.
+	QSaveFile file(filePath);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream << PROBE_FILE_MAGIC << PROBE_FILE_VERSION << scriptHash << static_cast<qint64>(maxCycleDays) << static_cast<qint64>(verifyDays)
+		<< static_cast<qint32>(brokenDateLength) << (table != nullptr);
+	if (table)
+	{
+		stream << table->YearZero << static_cast<qint64>(table->BaseDay) << static_cast<qint64>(table->BaseYear)
+			<< static_cast<qint64>(table->CycleDays) << static_cast<qint64>(table->CycleYears);
+		WriteInt64Vector(stream, table->DayYearOffsets);
+		WriteInt64Vector(stream, table->DayComponents);
+	}
+
+	return stream.status() == QDataStream::Ok && file.commit();
+}
+
+bool TBPeriodicCalendar::Verify(const TBCalendarSystem& calendar, int64 verifyDays) const
+{
+	const int64 verifyStart = BaseDay - verifyDays;
+	const int64 verifyEnd = BaseDay + CycleDays + verifyDays;
+
+	// A cycle that's wrong usually stays wrong from the first bad day onward, so a sparse pass over the whole range
+	// rules most bad candidates out before paying for the full pass.
+	const int64 sparseStride = std::max<int64>(1, (verifyEnd - verifyStart) / VERIFY_CHUNK_DAYS);
+	return VerifyDays(calendar, verifyStart, verifyEnd, sparseStride)
+		&& (sparseStride == 1 || VerifyDays(calendar, verifyStart, verifyEnd, 1));
+}
+
+bool TBPeriodicCalendar::VerifyDays(const TBCalendarSystem& calendar, int64 startDay, int64 endDay, int64 stride) const
+{
+	std::vector<TBDate> days;
+	std::vector<int64> scriptBrokenDates;
+	std::vector<TBDate> scriptCombinedDates;
+	std::vector<int64> tableComponents(BrokenDateLength);
+	for (int64 chunkStart = startDay; chunkStart < endDay; chunkStart += VERIFY_CHUNK_DAYS * stride)
+	{
+		days.clear();
+		for (int64 day = chunkStart; day < endDay && day < chunkStart + VERIFY_CHUNK_DAYS * stride; day += stride)
+		{
+			days.push_back(day);
+		}
+		calendar.BreakDates(days, scriptBrokenDates);
+		calendar.CombineDates(scriptBrokenDates, scriptCombinedDates);
+
+		for (size_t dayIndex = 0; dayIndex < days.size(); dayIndex++)
+		{
+			const int64 day = days[dayIndex].GetDays();
+			BreakDate(day, tableComponents);
+
+			std::span<const int64> scriptComponents(scriptBrokenDates.data() + dayIndex * BrokenDateLength, BrokenDateLength);
+			int64 tableDay = 0;
+			const bool breakMatches = std::equal(tableComponents.begin(), tableComponents.end(), scriptComponents.begin());
+			const bool combineMatches = CombineDate(scriptComponents, tableDay) && tableDay == scriptCombinedDates[dayIndex].GetDays();
+			if (!breakMatches || !combineMatches)
+			{
+				TBLog::Warning("Cycle of %0 days found in calendar '%1' does not hold on day %2.", CycleDays, calendar.GetName(), day);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+int64 TBPeriodicCalendar::ToAstronomicalYear(int64 year) const
+{
+	return (YearZero || year > 0) ? year : year + 1;
+}
+
+int64 TBPeriodicCalendar::FromAstronomicalYear(int64 astronomicalYear) const
+{
+	return (YearZero || astronomicalYear > 0) ? astronomicalYear : astronomicalYear - 1;
+}
+
+bool TBPeriodicCalendar::BreakDate(int64 day, std::span<int64> outComponents) const
+{
+	const int64 cycle = FloorDiv(day - BaseDay, CycleDays);
+	const int64 dayOfCycle = day - BaseDay - cycle * CycleDays;
+
+	outComponents[0] = FromAstronomicalYear(BaseYear + cycle * CycleYears + DayYearOffsets[dayOfCycle]);
+	std::copy_n(DayComponents.begin() + dayOfCycle * (BrokenDateLength - 1), BrokenDateLength - 1, outComponents.begin() + 1);
+	return true;
+}
+
+bool TBPeriodicCalendar::CombineDate(std::span<const int64> components, int64& outDay) const
+{
+	if (components.size() != static_cast<size_t>(BrokenDateLength) || (!YearZero && components[0] == 0))
+	{
+		return false;
+	}
+
+	const int64 relativeYear = ToAstronomicalYear(components[0]) - BaseYear;
+	const int64 cycle = FloorDiv(relativeYear, CycleYears);
+
+	TBBrokenDate key(components.begin(), components.end());
+	key[0] = relativeYear - cycle * CycleYears;
+
+	const auto dayOfCycle = DayLookup.constFind(key);
+	if (dayOfCycle == DayLookup.constEnd())
+	{
+		return false;
+	}
+
+	outDay = BaseDay + cycle * CycleDays + dayOfCycle.value();
+	return true;
+}
+
+bool TBPeriodicCalendar::ValidateBrokenDate(std::span<const int64> components, bool& outValid) const
+{
+	// Dates in the table came out of the script's own break_date, so they're valid.  Anything else might just be a
+	// partial date, so the script has to decide.
+	int64 day = 0;
+	if (CombineDate(components, day))
+	{
+		outValid = true;
+		return true;
+	}
+
+	return false;
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (PeriodicCalendar.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+#include "NativeCalendar.h"
+#include "Time.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+
+#include <memory>
+#include <span>
+#include <vector>
+
+class TBCalendarSystem;
+
+/*
+	Most calendars repeat exactly after some number of days: every year of a 10-month, 30-day calendar looks the same,
+	and Julian-style leap rules repeat every 1461 days.  This probes a calendar's script for that cycle, then answers
+	break and combine from a table covering a single cycle.
+
+	Only complete broken dates are looked up.  Partial dates, and anything not in the table, go to the script.
+*/
+class TBPeriodicCalendar : public TBNativeDateBackend
+{
+public:
+	// Samples the calendar's script to find its cycle and tabulates one cycle of it.  Each candidate table is checked
+	// against the script for verifyDays either side of the tabulated cycle.  Returns null if no cycle of at most
+	// maxCycleDays holds up.  The calendar must not already be using a native backend.
+	static std::unique_ptr<TBPeriodicCalendar> Build(const TBCalendarSystem& calendar, int64 maxCycleDays, int64 verifyDays);
+	// Returns false if there's no probe saved at filePath, or it was made from a different script or with different
+	// limits.  A saved probe that found no cycle loads as a null outTable.
+	static bool Load(const QString& filePath, const QByteArray& scriptHash, int64 maxCycleDays, int64 verifyDays, int32 brokenDateLength,
+		std::unique_ptr<TBPeriodicCalendar>& outTable);
+	// Saves the result of a probe, which may be no cycle at all.
+	static bool Save(const QString& filePath, const QByteArray& scriptHash, int64 maxCycleDays, int64 verifyDays, int32 brokenDateLength,
+		const TBPeriodicCalendar* table);
+
+	virtual int32 GetBrokenDateLength() const override { return BrokenDateLength; }
+	virtual bool BreakDate(int64 day, std::span<int64> outComponents) const override;
+	virtual bool CombineDate(std::span<const int64> components, int64& outDay) const override;
+	virtual bool ValidateBrokenDate(std::span<const int64> components, bool& outValid) const override;
+
+	int64 GetCycleDays() const { return CycleDays; }
+	int64 GetCycleYears() const { return CycleYears; }
+
+private:
+	TBPeriodicCalendar();
+
+	// Looks for a cycle in a flattened run of broken dates starting at sampleStart, and fills the table if one is found.
+	bool FindCycle(int64 sampleStart, const std::vector<int64>& sample, int64 minCycleDays, int64 maxCycleDays);
+	// Fills DayLookup from the per-day tables.  Returns false if two days of the cycle have the same date.
+	bool BuildLookup();
+	bool Verify(const TBCalendarSystem& calendar, int64 verifyDays) const;
+	bool VerifyDays(const TBCalendarSystem& calendar, int64 startDay, int64 endDay, int64 stride) const;
+
+	int64 ToAstronomicalYear(int64 year) const;
+	int64 FromAstronomicalYear(int64 astronomicalYear) const;
+
+	int32 BrokenDateLength;
+	bool YearZero;
+
+	// The table starts on the first day of a year, so every cycle holds a whole number of years.
+	int64 BaseDay;
+	int64 BaseYear;
+	int64 CycleDays;
+	int64 CycleYears;
+
+	// Per day of the cycle: the (astronomical) year relative to BaseYear, and the remaining broken date components.
+	std::vector<int64> DayYearOffsets;
+	std::vector<int64> DayComponents;
+
+	// Reverse lookup from a broken date (with the year made relative to the cycle) to its day of the cycle.
+	QHash<TBBrokenDate, int64> DayLookup;
+};
\ No newline at end of file
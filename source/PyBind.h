@@ -20,34 +20,199 @@
 #include "pybind11/pybind11.h"
 #include "pybind11/stl.h"
 
+#include "CommonTypes.h"
+#include "InlineList.h"
 #include "Logging.h"
+#include "ScriptProfiler.h"
+#include "ScriptResult.h"
 
 #include <QtCore/QString>
 
+#include <array>
+#include <memory>
 #include <utility>
 #include <stdexcept>
+#include <span>
+#include <type_traits>
+#include <vector>
 
 namespace py = pybind11;
 
+/*
+	Converts TBInlineList (and so TBBrokenDate/TBBrokenTimespan) to and from Python sequences directly, without going
+	through std::vector.  Sequences longer than the list's capacity fail to convert, like any other type mismatch.
+*/
+namespace pybind11::detail
+{
+	template<typename T, int32 Capacity>
+	struct type_caster<TBInlineList<T, Capacity>>
+	{
+		// The macro can't take a type with a comma in it.
+		typedef TBInlineList<T, Capacity> ListType;
+		PYBIND11_TYPE_CASTER(ListType, const_name("List[") + make_caster<T>::name + const_name("]"));
+
+		bool load(handle source, bool convert)
+		{
+			if (!isinstance<sequence>(source) || isinstance<bytes>(source) || isinstance<str>(source))
+			{
+				return false;
+			}
+
+			sequence sourceSequence = reinterpret_borrow<sequence>(source);
+			if (!TBInlineList<T, Capacity>::CanHold(static_cast<qsizetype>(sourceSequence.size())))
+			{
+				return false;
+			}
+
+			value.clear();
+			for (const auto& item : sourceSequence)
+			{
+				make_caster<T> elementCaster;
+				if (!elementCaster.load(item, convert))
+				{
+					return false;
+				}
+				value.append(cast_op<T&&>(std::move(elementCaster)));
+			}
+			return true;
+		}
+
+		static handle cast(const TBInlineList<T, Capacity>& source, return_value_policy policy, handle parent)
+		{
+			list result(source.size());
+			ssize_t index = 0;
+			for (const T& element : source)
+			{
+				object item = reinterpret_steal<object>(make_caster<T>::cast(element, policy, parent));
+				if (!item)
+				{
+					return handle();
+				}
+				PyList_SET_ITEM(result.ptr(), index++, item.release().ptr());
+			}
+			return result.release();
+		}
+	};
+}
+
+/*
+	Takes the GIL for the current scope, like py::gil_scoped_acquire.  When scripts are profiled, the time spent
+	waiting for it is counted against the first script call made in the scope.
+*/
+#if TB_PROFILE_SCRIPTS
+class TBScopedGil
+{
+public:
+	TBScopedGil() :
+		WaitStart(TBScriptProfiler::Clock::now()),
+		Gil()
+	{
+		TBScriptProfiler::SetPendingGilWait(std::chrono::duration_cast<std::chrono::nanoseconds>(TBScriptProfiler::Clock::now() - WaitStart).count());
+	}
+
+	~TBScopedGil()
+	{
+		// Nothing in this scope called a script, so the wait doesn't belong to the next scope's call either.
+		TBScriptProfiler::TakePendingGilWait();
+	}
+
+private:
+	TBScriptProfiler::Clock::time_point WaitStart;
+	py::gil_scoped_acquire Gil;
+};
+#else
+using TBScopedGil = py::gil_scoped_acquire;
+#endif //TB_PROFILE_SCRIPTS
+
+/*
+	Gives up the GIL for the current scope if this thread holds it, and takes it back at the end, for waiting on
+	something that may itself be waiting on the GIL.  Without an explicit answer, whether the GIL is held is read from
+	this thread's current thread state, which Python clears whenever the GIL is given up.  PyGILState_Check() can't
+	be asked instead, since it always answers yes once subinterpreters exist.
+*/
+class TBScopedGilRelease
+{
+public:
+	TBScopedGilRelease() :
+		TBScopedGilRelease(Py_IsInitialized() && GetCurrentThreadState() != nullptr)
+	{}
+
+	explicit TBScopedGilRelease(bool callerHoldsGil) :
+		HeldThreadState(callerHoldsGil ? PyEval_SaveThread() : nullptr)
+	{}
+
+	~TBScopedGilRelease()
+	{
+		Restore();
+	}
+
+	TBScopedGilRelease(const TBScopedGilRelease&) = delete;
+	TBScopedGilRelease& operator=(const TBScopedGilRelease&) = delete;
+
+	bool IsReleased() const { return HeldThreadState != nullptr; }
+
+	// Takes the GIL back before the end of the scope.
+	void Restore()
+	{
+		if (HeldThreadState != nullptr)
+		{
+			PyEval_RestoreThread(HeldThreadState);
+			HeldThreadState = nullptr;
+		}
+	}
+
+private:
+	static PyThreadState* GetCurrentThreadState()
+	{
+#if PY_VERSION_HEX >= 0x030D0000
+		return PyThreadState_GetUnchecked();
+#else
+		return _PyThreadState_UncheckedGet();
+#endif
+	}
+
+	PyThreadState* HeldThreadState;
+};
+
 // Repackage exceptions for display and logging.
 #define CATCH_PY_EXCEPTIONS \
 catch (py::error_already_set& pythonException) \
 { \
 	TBLog::Error("Exception when calling Python function '%0' from %1 (Line %2): %3", functionName, callingFunction, callingLine, pythonException.what()); \
-	throw pythonException; \
+	throw; \
 } \
 catch (std::runtime_error& otherException) \
 { \
 	TBLog::Error("Exception inside pybind11 from %0 (Line %1): %2", callingFunction, callingLine, otherException.what()); \
-	throw otherException; \
+	throw; \
+}
+
+// Same as callable(args...), except that the arguments are converted up front so that profiling can time it separately.
+template<typename... Args>
+py::object CallPythonCallable(const py::object& callable, Args&&... args)
+{
+	py::tuple argTuple;
+	{
+		TB_PROFILE_SCRIPT_CONVERSION();
+		argTuple = py::make_tuple<py::return_value_policy::automatic_reference>(std::forward<Args>(args)...);
+	}
+
+	PyObject* result = PyObject_CallObject(callable.ptr(), argTuple.ptr());
+	if (result == nullptr)
+	{
+		throw py::error_already_set();
+	}
+	return py::reinterpret_steal<py::object>(result);
 }
 
 template<typename T, typename... Args>
 T CallPythonFunction(py::module_& pythonModule, const char* functionName, const char* callingFunction, int callingLine, Args&&... args)
 {
+	TB_PROFILE_SCRIPT_CALL(functionName);
 	try
 	{
-		py::object result = pythonModule.attr(functionName)(std::forward<Args>(args)...);
+		py::object result = CallPythonCallable(pythonModule.attr(functionName), std::forward<Args>(args)...);
+		TB_PROFILE_SCRIPT_CONVERSION();
 		return result.cast<T>();
 	}
 	CATCH_PY_EXCEPTIONS
@@ -56,9 +221,10 @@ T CallPythonFunction(py::module_& pythonModule, const char* functionName, const
 template<typename... Args>
 void CallVoidPythonFunction(py::module_& pythonModule, const char* functionName, const char* callingFunction, int callingLine, Args&&... args)
 {
+	TB_PROFILE_SCRIPT_CALL(functionName);
 	try
 	{
-		pythonModule.attr(functionName)(std::forward<Args>(args)...);
+		CallPythonCallable(pythonModule.attr(functionName), std::forward<Args>(args)...);
 	}
 	CATCH_PY_EXCEPTIONS
 }
@@ -66,9 +232,11 @@ void CallVoidPythonFunction(py::module_& pythonModule, const char* functionName,
 template<typename T, typename... Args>
 T CallPythonMethod(py::object& pythonObject, const char* functionName, const char* callingFunction, int callingLine, Args&&... args)
 {
+	TB_PROFILE_SCRIPT_CALL(functionName);
 	try
 	{
-		py::object result = pythonObject.attr(functionName)(std::forward<Args>(args)...);
+		py::object result = CallPythonCallable(pythonObject.attr(functionName), std::forward<Args>(args)...);
+		TB_PROFILE_SCRIPT_CONVERSION();
 		return result.cast<T>();
 	}
 	CATCH_PY_EXCEPTIONS
@@ -77,9 +245,225 @@ T CallPythonMethod(py::object& pythonObject, const char* functionName, const cha
 template<typename... Args>
 void CallVoidPythonMethod(py::object& pythonObject, const char* functionName, const char* callingFunction, int callingLine, Args&&... args)
 {
+	TB_PROFILE_SCRIPT_CALL(functionName);
+	try
+	{
+		CallPythonCallable(pythonObject.attr(functionName), std::forward<Args>(args)...);
+	}
+	CATCH_PY_EXCEPTIONS
+}
+
+/*
+	A script function looked up once ahead of time, so that calling it doesn't repeat the string-keyed attribute
+	lookup on every call.  Functions the script doesn't define resolve to an invalid handle, which raises an
+	AttributeError when called, the same as a lookup at call time would.
+*/
+struct TBResolvedPythonMethod
+{
+	py::object Callable;
+	const char* Name = "";
+
+	bool IsValid() const { return static_cast<bool>(Callable); }
+
+	bool Resolve(const py::object& owner, const char* functionName)
+	{
+		Name = functionName;
+		Callable = py::hasattr(owner, functionName) ? owner.attr(functionName) : py::object();
+		return IsValid();
+	}
+};
+
+#if PY_VERSION_HEX < 0x03090000
+#define PyObject_Vectorcall _PyObject_Vectorcall
+#endif
+
+// py::cast() only goes from C++ values to Python, so arguments that are already Python objects are passed through as-is.
+template<typename Arg>
+py::object ToPythonArgument(Arg&& arg)
+{
+	if constexpr (py::detail::is_pyobject<std::remove_cvref_t<Arg>>::value)
+	{
+		return py::reinterpret_borrow<py::object>(arg);
+	}
+	else
+	{
+		return py::cast(std::forward<Arg>(arg));
+	}
+}
+
+// Calls a resolved function through the vectorcall protocol, which skips building an argument tuple.  Returns a new
+// reference, or null with the Python error indicator set.
+template<typename... Args>
+PyObject* VectorcallResolvedPythonMethod(const TBResolvedPythonMethod& method, Args&&... args)
+{
+	if (!method.IsValid())
+	{
+		PyErr_Format(PyExc_AttributeError, "Calendar script has no function '%s'", method.Name);
+		return nullptr;
+	}
+
+	// The leading null is scratch space that PY_VECTORCALL_ARGUMENTS_OFFSET allows the callee to use.
+	std::array<py::object, sizeof...(Args) + 1> argObjects;
+	{
+		TB_PROFILE_SCRIPT_CONVERSION();
+		argObjects = { py::object(), ToPythonArgument(std::forward<Args>(args))... };
+	}
+	std::array<PyObject*, sizeof...(Args) + 1> argPointers;
+	for (size_t argIndex = 0; argIndex < argObjects.size(); argIndex++)
+	{
+		argPointers[argIndex] = argObjects[argIndex].ptr();
+	}
+
+	return PyObject_Vectorcall(method.Callable.ptr(), argPointers.data() + 1, sizeof...(Args) | PY_VECTORCALL_ARGUMENTS_OFFSET, nullptr);
+}
+
+template<typename T, typename... Args>
+T CallResolvedPythonMethod(const TBResolvedPythonMethod& method, const char* callingFunction, int callingLine, Args&&... args)
+{
+	const char* functionName = method.Name;
+	TB_PROFILE_SCRIPT_CALL(functionName);
 	try
 	{
-		pythonObject.attr(functionName)(std::forward<Args>(args)...);
+		PyObject* result = VectorcallResolvedPythonMethod(method, std::forward<Args>(args)...);
+		if (result == nullptr)
+		{
+			throw py::error_already_set();
+		}
+
+		py::object resultObject = py::reinterpret_steal<py::object>(result);
+		if constexpr (!std::is_void_v<T>)
+		{
+			TB_PROFILE_SCRIPT_CONVERSION();
+			return resultObject.cast<T>();
+		}
 	}
 	CATCH_PY_EXCEPTIONS
-}
\ No newline at end of file
+}
+
+/*
+	A Python exception taken out of the interpreter without formatting it, for TBScriptError.  py::error_already_set
+	builds its message (traceback included) as soon as it's constructed, which is most of the cost of a failed call.
+*/
+struct TBPythonErrorState
+{
+	PyObject* Type = nullptr;
+	PyObject* Value = nullptr;
+	PyObject* Traceback = nullptr;
+
+	TBPythonErrorState() = default;
+	// Owns a reference to each object, so copies would release them twice.  Share it through the shared_ptr instead.
+	TBPythonErrorState(const TBPythonErrorState&) = delete;
+	TBPythonErrorState& operator=(const TBPythonErrorState&) = delete;
+
+	// Takes the pending Python error.  The GIL must be held.
+	static std::shared_ptr<TBPythonErrorState> Fetch()
+	{
+		std::shared_ptr<TBPythonErrorState> state = std::make_shared<TBPythonErrorState>();
+		PyErr_Fetch(&state->Type, &state->Value, &state->Traceback);
+		return state;
+	}
+
+	~TBPythonErrorState()
+	{
+		if (Type != nullptr && Py_IsInitialized())
+		{
+			py::gil_scoped_acquire gil;
+			Py_XDECREF(Type);
+			Py_XDECREF(Value);
+			Py_XDECREF(Traceback);
+		}
+	}
+
+	// "ExceptionType: message", without the traceback.  Takes the GIL.
+	QString Format()
+	{
+		if (Type == nullptr || !Py_IsInitialized())
+		{
+			return "Unknown Python error";
+		}
+
+		py::gil_scoped_acquire gil;
+		PyErr_NormalizeException(&Type, &Value, &Traceback);
+		QString text = QString::fromUtf8(reinterpret_cast<PyTypeObject*>(Type)->tp_name);
+		if (Value != nullptr)
+		{
+			py::object valueText = py::reinterpret_steal<py::object>(PyObject_Str(Value));
+			if (valueText)
+			{
+				text += ": " + QString::fromStdString(valueText.cast<std::string>());
+			}
+			else
+			{
+				PyErr_Clear();
+			}
+		}
+		return text;
+	}
+};
+
+/*
+	Non-throwing counterpart of CallResolvedPythonMethod.  Failures come back as a TBScriptError and aren't logged, so
+	callers that expect many of them (validating imported dates, say) don't pay for an exception and a log line each.
+	Only errors from the script itself are returned; arguments that can't be converted to Python still throw, since
+	that's a mistake on our side.
+*/
+template<typename T, typename... Args>
+TBScriptResult<T> TryCallResolvedPythonMethod(const TBResolvedPythonMethod& method, Args&&... args)
+{
+	if (!method.IsValid())
+	{
+		return TBScriptError(TBScriptErrorCode::MissingFunction, method.Name);
+	}
+
+	TB_PROFILE_SCRIPT_CALL(method.Name);
+	PyObject* result = VectorcallResolvedPythonMethod(method, std::forward<Args>(args)...);
+	if (result == nullptr)
+	{
+		return TBScriptError(TBScriptErrorCode::ScriptException, method.Name, TBPythonErrorState::Fetch());
+	}
+
+	py::object resultObject = py::reinterpret_steal<py::object>(result);
+	TB_PROFILE_SCRIPT_CONVERSION();
+	py::detail::make_caster<T> caster;
+	if (!caster.load(resultObject, true))
+	{
+		// Casters may leave an error set when they give up.
+		PyErr_Clear();
+		return TBScriptError(TBScriptErrorCode::BadResult, method.Name);
+	}
+	return py::detail::cast_op<T>(std::move(caster));
+}
+
+template<typename... Args>
+void CallVoidResolvedPythonMethod(const TBResolvedPythonMethod& method, const char* callingFunction, int callingLine, Args&&... args)
+{
+	CallResolvedPythonMethod<void>(method, callingFunction, callingLine, std::forward<Args>(args)...);
+}
+
+/*
+	Buffer protocol helpers for batch calls.  Contiguous int64 data is handed to scripts as a read-only memoryview,
+	so they can iterate it without us building a Python list first.
+*/
+inline py::memoryview Int64SpanToMemoryView(std::span<const int64> values)
+{
+	return py::memoryview::from_buffer(values.data(), { static_cast<py::ssize_t>(values.size()) }, { static_cast<py::ssize_t>(sizeof(int64)) });
+}
+
+// Objects that expose a contiguous int64 buffer (such as array.array('q')) are copied straight out of the buffer.
+// Anything else goes through pybind11's usual sequence conversion.
+inline void PythonObjectToInt64Vector(const py::object& inObject, std::vector<int64>& outValues)
+{
+	if (PyObject_CheckBuffer(inObject.ptr()))
+	{
+		py::buffer_info info = inObject.cast<py::buffer>().request();
+		if (info.ndim == 1 && info.itemsize == sizeof(int64) && info.strides[0] == sizeof(int64)
+			&& info.format == py::format_descriptor<int64>::format())
+		{
+			const int64* data = static_cast<const int64*>(info.ptr);
+			outValues.assign(data, data + info.size);
+			return;
+		}
+	}
+
+	outValues = inObject.cast<std::vector<int64>>();
+}
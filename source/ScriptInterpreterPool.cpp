@@ -0,0 +1,293 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (ScriptInterpreterPool.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PyBind.h"		// This has to come first to not conflict with Qt defines.
+#include "ScriptInterpreterPool.h"
+#include "CalendarScriptRunner.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+
+// Subinterpreters with their own GIL arrived in Python 3.12 (PEP 684).
+#if PY_VERSION_HEX >= 0x030C0000
+#define TB_HAS_PER_INTERPRETER_GIL 1
+#else
+#define TB_HAS_PER_INTERPRETER_GIL 0
+#endif
+
+/*
+	TBScriptInterpreterPool::Worker
+*/
+struct TBScriptInterpreterPool::Worker
+{
+	std::thread Thread;
+	// Empty once the worker's interpreter is up and has imported the calendar.
+	std::string StartError;
+	// Lives in the worker's own interpreter.  Only touched on the worker's thread.
+	TBCalendarScriptRunner Runner;
+};
+
+/*
+	TBScriptInterpreterPool
+*/
+TBScriptInterpreterPool::TBScriptInterpreterPool() :
+	Workers(),
+	QueueMutex(),
+	QueueCondition(),
+	Queue(),
+	Stopping(false)
+{}
+
+TBScriptInterpreterPool::~TBScriptInterpreterPool()
+{
+	StopWorkers(true);
+}
+
+bool TBScriptInterpreterPool::IsSupported()
+{
+	return TB_HAS_PER_INTERPRETER_GIL;
+}
+
+std::unique_ptr<TBScriptInterpreterPool> TBScriptInterpreterPool::Create(const QString& moduleName, int32 interpreterCount)
+{
+	if (interpreterCount <= 0)
+	{
+		return nullptr;
+	}
+	if (!IsSupported())
+	{
+		TBLog::Warning("Calendar script interpreters need Python 3.12 or later, but this build uses Python %0.  "
+			"Calendar scripts will only run on the main interpreter.", PY_VERSION);
+		return nullptr;
+	}
+
+	std::vector<std::string> modulePath;
+	try
+	{
+		modulePath = py::module_::import("sys").attr("path").cast<std::vector<std::string>>();
+	}
+	catch (py::error_already_set& pythonException)
+	{
+		TBLog::Error("Could not read the Python module path for calendar script interpreters: %0", pythonException.what());
+		return nullptr;
+	}
+
+	std::unique_ptr<TBScriptInterpreterPool> pool(new TBScriptInterpreterPool());
+	const std::string moduleNameUtf8 = moduleName.toStdString();
+	std::latch startLatch(interpreterCount);
+	{
+		// Workers create their interpreters from the main one, so they need its GIL until they're up.
+		py::gil_scoped_release releaseMainInterpreter;
+		for (int32 workerIndex = 0; workerIndex < interpreterCount; workerIndex++)
+		{
+			Worker& worker = *pool->Workers.emplace_back(std::make_unique<Worker>());
+			worker.Thread = std::thread(&TBScriptInterpreterPool::WorkerMain, pool.get(), std::ref(worker),
+				std::cref(moduleNameUtf8), std::cref(modulePath), std::ref(startLatch));
+		}
+		startLatch.wait();
+	}
+
+	for (int32 workerIndex = 0; workerIndex < interpreterCount; workerIndex++)
+	{
+		const std::string& startError = pool->Workers[workerIndex]->StartError;
+		if (!startError.empty())
+		{
+			TBLog::Error("Calendar script interpreter %0 for '%1' failed to start: %2", workerIndex, moduleName,
+				QString::fromStdString(startError));
+			return nullptr;
+		}
+	}
+
+	return pool;
+}
+
+void TBScriptInterpreterPool::WorkerMain(Worker& worker, const std::string& moduleName, const std::vector<std::string>& modulePath,
+	std::latch& startLatch)
+{
+#if TB_HAS_PER_INTERPRETER_GIL
+	// New interpreters have to be created from a thread state of an existing one.
+	const PyGILState_STATE mainGilState = PyGILState_Ensure();
+	PyThreadState* mainThreadState = PyThreadState_Get();
+
+	PyInterpreterConfig config = {};
+	config.use_main_obmalloc = 0;
+	config.allow_fork = 0;
+	config.allow_exec = 0;
+	config.allow_threads = 1;
+	config.allow_daemon_threads = 0;
+	config.check_multi_interp_extensions = 1;
+	config.gil = PyInterpreterConfig_OWN_GIL;
+
+	PyThreadState* workerThreadState = nullptr;
+	const PyStatus status = Py_NewInterpreterFromConfig(&workerThreadState, &config);
+	if (PyStatus_Exception(status))
+	{
+		// On failure we're still on the main interpreter's thread state.
+		worker.StartError = status.err_msg ? status.err_msg : "Could not create a subinterpreter";
+		PyGILState_Release(mainGilState);
+		startLatch.count_down();
+		return;
+	}
+
+	// Creating an interpreter with its own GIL gave up the main interpreter's, so from here on this thread only holds
+	// the worker's GIL, which nothing else ever asks for.
+	worker.StartError = worker.Runner.ImportCalendar(moduleName, modulePath);
+	startLatch.count_down();
+
+	while (worker.StartError.empty())
+	{
+		Task task;
+		{
+			std::unique_lock lock(QueueMutex);
+			QueueCondition.wait(lock, [this]() { return Stopping || !Queue.empty(); });
+			if (Queue.empty())
+			{
+				break;
+			}
+			task = std::move(Queue.front());
+			Queue.pop_front();
+		}
+		task(worker);
+	}
+
+	worker.Runner.Release();
+	Py_EndInterpreter(workerThreadState);
+
+	// Shutting down leaves no thread state current, so go back to the main interpreter's to release it properly.
+	PyEval_RestoreThread(mainThreadState);
+	PyGILState_Release(mainGilState);
+#else
+	worker.StartError = "Subinterpreters are not supported by this Python version";
+	startLatch.count_down();
+#endif
+}
+
+void TBScriptInterpreterPool::StopWorkers(bool callerHoldsGil)
+{
+	{
+		std::scoped_lock lock(QueueMutex);
+		Stopping = true;
+	}
+	QueueCondition.notify_all();
+
+	// Workers need the main interpreter's GIL to shut their interpreters down.
+	{
+		TBScopedGilRelease releaseGil(callerHoldsGil);
+		for (std::unique_ptr<Worker>& worker : Workers)
+		{
+			if (worker->Thread.joinable())
+			{
+				worker->Thread.join();
+			}
+		}
+	}
+
+	Workers.clear();
+}
+
+size_t TBScriptInterpreterPool::RunChunked(size_t itemCount, const std::function<std::string(Worker&, size_t, size_t, size_t)>& runChunk)
+{
+	const size_t chunkCount = std::clamp<size_t>(itemCount / MinChunkItems, 1, Workers.size());
+	std::vector<std::string> chunkErrors(chunkCount);
+	std::latch chunksFinished(static_cast<std::ptrdiff_t>(chunkCount));
+	{
+		std::scoped_lock lock(QueueMutex);
+		for (size_t chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			const size_t firstItem = itemCount * chunkIndex / chunkCount;
+			const size_t lastItem = itemCount * (chunkIndex + 1) / chunkCount;
+			Queue.emplace_back([&, chunkIndex, firstItem, lastItem](Worker& worker)
+			{
+				try
+				{
+					chunkErrors[chunkIndex] = runChunk(worker, chunkIndex, firstItem, lastItem);
+				}
+				catch (const std::exception& exception)
+				{
+					chunkErrors[chunkIndex] = exception.what();
+				}
+				chunksFinished.count_down();
+			});
+		}
+	}
+	QueueCondition.notify_all();
+	chunksFinished.wait();
+
+	for (const std::string& chunkError : chunkErrors)
+	{
+		if (!chunkError.empty())
+		{
+			TBLog::Error("Exception from calendar script interpreter: %0", QString::fromStdString(chunkError));
+			throw std::runtime_error(chunkError);
+		}
+	}
+
+	return chunkCount;
+}
+
+void TBScriptInterpreterPool::BreakDates(std::span<const int64> days, int32 brokenDateLength, std::vector<int64>& outFlatBrokenDates)
+{
+	std::vector<std::vector<int64>> chunkResults(Workers.size());
+	const size_t chunkCount = RunChunked(days.size(), [&](Worker& worker, size_t chunkIndex, size_t firstItem, size_t lastItem)
+	{
+		return worker.Runner.BreakDates(days.subspan(firstItem, lastItem - firstItem), brokenDateLength, chunkResults[chunkIndex]);
+	});
+
+	outFlatBrokenDates.clear();
+	outFlatBrokenDates.reserve(days.size() * brokenDateLength);
+	for (size_t chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	{
+		outFlatBrokenDates.insert(outFlatBrokenDates.end(), chunkResults[chunkIndex].begin(), chunkResults[chunkIndex].end());
+	}
+}
+
+void TBScriptInterpreterPool::CombineDates(std::span<const int64> flatBrokenDates, int32 brokenDateLength, std::vector<int64>& outDays)
+{
+	const size_t dateCount = flatBrokenDates.size() / brokenDateLength;
+	std::vector<std::vector<int64>> chunkResults(Workers.size());
+	const size_t chunkCount = RunChunked(dateCount, [&](Worker& worker, size_t chunkIndex, size_t firstItem, size_t lastItem)
+	{
+		std::span<const int64> chunk = flatBrokenDates.subspan(firstItem * brokenDateLength, (lastItem - firstItem) * brokenDateLength);
+		return worker.Runner.CombineDates(chunk, brokenDateLength, chunkResults[chunkIndex]);
+	});
+
+	outDays.clear();
+	outDays.reserve(dateCount);
+	for (size_t chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	{
+		outDays.insert(outDays.end(), chunkResults[chunkIndex].begin(), chunkResults[chunkIndex].end());
+	}
+}
+
+void TBScriptInterpreterPool::FormatDates(std::span<const int64> days, std::vector<std::string>& outFormattedDates)
+{
+	std::vector<std::vector<std::string>> chunkResults(Workers.size());
+	const size_t chunkCount = RunChunked(days.size(), [&](Worker& worker, size_t chunkIndex, size_t firstItem, size_t lastItem)
+	{
+		return worker.Runner.FormatDates(days.subspan(firstItem, lastItem - firstItem), chunkResults[chunkIndex]);
+	});
+
+	outFormattedDates.clear();
+	outFormattedDates.reserve(days.size());
+	for (size_t chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	{
+		std::move(chunkResults[chunkIndex].begin(), chunkResults[chunkIndex].end(), std::back_inserter(outFormattedDates));
+	}
+}
\ No newline at end of file
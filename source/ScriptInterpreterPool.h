@@ -0,0 +1,90 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (ScriptInterpreterPool.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+
+#include <QtCore/QString>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+	A set of Python subinterpreters, each with its own GIL and running on its own thread, that have all imported the
+	same calendar script.  Batch conversions are split into chunks and spread across them, so they can use more than
+	one core.
+
+	Subinterpreters with their own GIL need Python 3.12 or later.  Against older Pythons, Create() always fails and
+	calendars stay on the main interpreter.
+
+	Workers talk to Python through the C API directly rather than pybind11, since pybind11's type registry belongs to
+	the main interpreter.
+*/
+class TBScriptInterpreterPool
+{
+public:
+	// Batches are split into chunks of at least this many items.
+	static constexpr size_t MinChunkItems = 256;
+
+	static bool IsSupported();
+
+	// Starts interpreterCount workers, each importing moduleName and calling its init_calendar().  Must be called
+	// from a thread holding the main interpreter's GIL.  Returns null if any of them fail to start.
+	static std::unique_ptr<TBScriptInterpreterPool> Create(const QString& moduleName, int32 interpreterCount);
+
+	// Must be destroyed on a thread holding the main interpreter's GIL, which is given up while the workers stop.
+	~TBScriptInterpreterPool();
+
+	int32 GetInterpreterCount() const { return static_cast<int32>(Workers.size()); }
+	// Whether a batch is big enough to be worth handing to the pool rather than running on the main interpreter.
+	bool ShouldSplit(size_t itemCount) const { return Workers.size() > 1 && itemCount >= 2 * MinChunkItems; }
+
+	// Batch calls, mirroring the ones on TBCalendarSystem.  These throw std::runtime_error if any chunk fails, after
+	// all chunks have finished.
+	void BreakDates(std::span<const int64> days, int32 brokenDateLength, std::vector<int64>& outFlatBrokenDates);
+	void CombineDates(std::span<const int64> flatBrokenDates, int32 brokenDateLength, std::vector<int64>& outDays);
+	void FormatDates(std::span<const int64> days, std::vector<std::string>& outFormattedDates);
+
+private:
+	struct Worker;
+	typedef std::function<void(Worker&)> Task;
+
+	TBScriptInterpreterPool();
+
+	// Splits itemCount items into one chunk per worker (fewer for small batches), runs runChunk on each, and waits.
+	// runChunk gets the chunk index and item range, and returns an error message or an empty string.
+	// Returns the number of chunks.
+	size_t RunChunked(size_t itemCount, const std::function<std::string(Worker&, size_t, size_t, size_t)>& runChunk);
+
+	void WorkerMain(Worker& worker, const std::string& moduleName, const std::vector<std::string>& modulePath, std::latch& startLatch);
+	void StopWorkers(bool callerHoldsGil);
+
+	std::vector<std::unique_ptr<Worker>> Workers;
+
+	std::mutex QueueMutex;
+	std::condition_variable QueueCondition;
+	std::deque<Task> Queue;
+	bool Stopping;
+};
\ No newline at end of file
@@ -0,0 +1,160 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (ScriptProfiler.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ScriptProfiler.h"
+#include "Logging.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QJsonDocument>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Keyed by name rather than by pointer, since the same function name can come from more than one string literal.
+static std::mutex StatsMutex;
+static std::map<std::string, TBScriptCallStats, std::less<>> Stats;
+
+static thread_local uint64 PendingGilWaitNs = 0;
+static thread_local TBScriptCallTimer* CurrentTimer = nullptr;
+
+static uint64 NanosecondsSince(TBScriptProfiler::Clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(TBScriptProfiler::Clock::now() - start).count();
+}
+
+void TBScriptProfiler::Record(const char* functionName, uint64 wallNs, uint64 gilWaitNs, uint64 conversionNs)
+{
+	std::scoped_lock lock(StatsMutex);
+	auto found = Stats.find(std::string_view(functionName));
+	if (found == Stats.end())
+	{
+		found = Stats.emplace(functionName, TBScriptCallStats()).first;
+	}
+
+	TBScriptCallStats& stats = found->second;
+	stats.Calls++;
+	stats.TotalNs += wallNs;
+	stats.MaxNs = std::max(stats.MaxNs, wallNs);
+	stats.GilWaitNs += gilWaitNs;
+	stats.ConversionNs += conversionNs;
+}
+
+void TBScriptProfiler::Reset()
+{
+	std::scoped_lock lock(StatsMutex);
+	Stats.clear();
+}
+
+void TBScriptProfiler::SetPendingGilWait(uint64 gilWaitNs)
+{
+	PendingGilWaitNs = gilWaitNs;
+}
+
+uint64 TBScriptProfiler::TakePendingGilWait()
+{
+	return std::exchange(PendingGilWaitNs, 0);
+}
+
+void TBScriptProfiler::LogStats()
+{
+	std::vector<std::pair<std::string, TBScriptCallStats>> sortedStats;
+	{
+		std::scoped_lock lock(StatsMutex);
+		sortedStats.assign(Stats.begin(), Stats.end());
+	}
+	std::sort(sortedStats.begin(), sortedStats.end(), [](const auto& first, const auto& second) { return first.second.TotalNs > second.second.TotalNs; });
+
+	if (sortedStats.empty())
+	{
+		TBLog::Log(IsEnabled() ? "No script calls profiled." : "Script profiling is not enabled in this build.");
+		return;
+	}
+
+	TBLog::Log("Script call profile:");
+	for (const auto& [functionName, stats] : sortedStats)
+	{
+		TBLog::Log("%0: %1 calls, %2 ms total, %3 us mean, %4 us max, %5 ms waiting for the GIL, %6 ms converting",
+			QString::fromStdString(functionName), stats.Calls, stats.TotalNs / 1.0e6, stats.TotalNs / 1.0e3 / stats.Calls,
+			stats.MaxNs / 1.0e3, stats.GilWaitNs / 1.0e6, stats.ConversionNs / 1.0e6);
+	}
+}
+
+QJsonObject TBScriptProfiler::GetStatsJson()
+{
+	QJsonObject functions;
+	{
+		std::scoped_lock lock(StatsMutex);
+		for (const auto& [functionName, stats] : Stats)
+		{
+			QJsonObject function;
+			function.insert("calls", static_cast<qint64>(stats.Calls));
+			function.insert("total_ns", static_cast<qint64>(stats.TotalNs));
+			function.insert("max_ns", static_cast<qint64>(stats.MaxNs));
+			function.insert("gil_wait_ns", static_cast<qint64>(stats.GilWaitNs));
+			function.insert("conversion_ns", static_cast<qint64>(stats.ConversionNs));
+			functions.insert(QString::fromStdString(functionName), function);
+		}
+	}
+
+	QJsonObject result;
+	result.insert("enabled", IsEnabled());
+	result.insert("functions", functions);
+	return result;
+}
+
+bool TBScriptProfiler::WriteStatsJson(const QString& path)
+{
+	QFile outputFile(path);
+	if (!outputFile.open(QIODeviceBase::WriteOnly | QIODeviceBase::Truncate | QIODeviceBase::Text)
+		|| outputFile.write(QJsonDocument(GetStatsJson()).toJson(QJsonDocument::Indented)) < 0)
+	{
+		TBLog::Error("Could not write script profile to %0.", path);
+		return false;
+	}
+	return true;
+}
+
+TBScriptCallTimer::TBScriptCallTimer(const char* functionName) :
+	FunctionName(functionName),
+	Start(TBScriptProfiler::Clock::now()),
+	GilWaitNs(TBScriptProfiler::TakePendingGilWait()),
+	ConversionNs(0),
+	OuterTimer(std::exchange(CurrentTimer, this))
+{}
+
+TBScriptCallTimer::~TBScriptCallTimer()
+{
+	CurrentTimer = OuterTimer;
+	TBScriptProfiler::Record(FunctionName, NanosecondsSince(Start), GilWaitNs, ConversionNs);
+}
+
+TBScriptConversionTimer::TBScriptConversionTimer() :
+	Start(TBScriptProfiler::Clock::now())
+{}
+
+TBScriptConversionTimer::~TBScriptConversionTimer()
+{
+	if (CurrentTimer != nullptr)
+	{
+		CurrentTimer->ConversionNs += NanosecondsSince(Start);
+	}
+}
\ No newline at end of file
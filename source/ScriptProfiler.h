@@ -0,0 +1,118 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (ScriptProfiler.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+
+#include <QtCore/QJsonObject>
+#include <QtCore/QString>
+
+#include <chrono>
+
+/*
+	Totals for every call made to one script function.  Wall time covers the whole call, argument and result
+	conversion included.  GIL wait is how long the caller spent getting the GIL before the call, and isn't part of the
+	wall time.
+*/
+struct TBScriptCallStats
+{
+	uint64 Calls = 0;
+	uint64 TotalNs = 0;
+	uint64 MaxNs = 0;
+	uint64 GilWaitNs = 0;
+	uint64 ConversionNs = 0;
+};
+
+/*
+	Counts calls into calendar scripts, per function name.  The call templates in PyBind.h only report here in builds
+	with TB_PROFILE_SCRIPTS set; otherwise the timers compile away and the stats stay empty.  No configuration sets it
+	by default, so add it to the project's defines to profile.
+*/
+class TBScriptProfiler
+{
+public:
+	// This is a static method class only.  Never instantiate.
+	TBScriptProfiler() = delete;
+
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr bool IsEnabled()
+	{
+#if TB_PROFILE_SCRIPTS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	static void Record(const char* functionName, uint64 wallNs, uint64 gilWaitNs, uint64 conversionNs);
+	static void Reset();
+
+	// The GIL wait of the calling thread's current GIL scope, handed to the first call made in it.
+	static void SetPendingGilWait(uint64 gilWaitNs);
+	static uint64 TakePendingGilWait();
+
+	// One line per function, slowest total first.
+	static void LogStats();
+	static QJsonObject GetStatsJson();
+	static bool WriteStatsJson(const QString& path);
+};
+
+/*
+	Times one script call from construction to destruction and records it under functionName.  Conversion timers
+	made on the same thread while it's alive add to its conversion time.
+*/
+class TBScriptCallTimer
+{
+public:
+	explicit TBScriptCallTimer(const char* functionName);
+	~TBScriptCallTimer();
+
+	TBScriptCallTimer(const TBScriptCallTimer&) = delete;
+	TBScriptCallTimer& operator=(const TBScriptCallTimer&) = delete;
+
+private:
+	friend class TBScriptConversionTimer;
+
+	const char* FunctionName;
+	TBScriptProfiler::Clock::time_point Start;
+	uint64 GilWaitNs;
+	uint64 ConversionNs;
+	TBScriptCallTimer* OuterTimer;
+};
+
+class TBScriptConversionTimer
+{
+public:
+	TBScriptConversionTimer();
+	~TBScriptConversionTimer();
+
+	TBScriptConversionTimer(const TBScriptConversionTimer&) = delete;
+	TBScriptConversionTimer& operator=(const TBScriptConversionTimer&) = delete;
+
+private:
+	TBScriptProfiler::Clock::time_point Start;
+};
+
+#if TB_PROFILE_SCRIPTS
+#define TB_PROFILE_SCRIPT_CALL(functionName) const TBScriptCallTimer scriptCallTimer(functionName)
+#define TB_PROFILE_SCRIPT_CONVERSION() const TBScriptConversionTimer scriptConversionTimer
+#else
+#define TB_PROFILE_SCRIPT_CALL(functionName)
+#define TB_PROFILE_SCRIPT_CONVERSION()
+#endif //TB_PROFILE_SCRIPTS
\ No newline at end of file
@@ -0,0 +1,37 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (ScriptResult.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PyBind.h"		// This has to come first to not conflict with Qt defines.
+#include "ScriptResult.h"
+
+QString TBScriptError::GetMessage() const
+{
+	switch (Code)
+	{
+	case TBScriptErrorCode::ScriptException:
+		return QString("Exception when calling Python function '%0': %1").arg(FunctionName, PythonError ? PythonError->Format() : QString("Unknown Python error"));
+	case TBScriptErrorCode::BadResult:
+		return QString("Python function '%0' returned a value of the wrong type").arg(FunctionName);
+	case TBScriptErrorCode::MissingFunction:
+		return QString("Calendar script has no function '%0'").arg(FunctionName);
+	case TBScriptErrorCode::TimedOut:
+		return QString("Python function '%0' ran past its time budget and was interrupted").arg(FunctionName);
+	case TBScriptErrorCode::CircuitOpen:
+		return QString("Python function '%0' wasn't called, since its calendar script keeps running past its time budget").arg(FunctionName);
+	}
+	return QString("Unknown error calling Python function '%0'").arg(FunctionName);
+}
\ No newline at end of file
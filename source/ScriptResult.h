@@ -0,0 +1,131 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (ScriptResult.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+
+#include <QtCore/QString>
+
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <variant>
+
+enum class TBScriptErrorCode : uint8
+{
+	// The script raised an exception.
+	ScriptException,
+	// The script returned something that doesn't convert to the expected type.
+	BadResult,
+	// The script doesn't define the function.
+	MissingFunction,
+	// The call ran past its time budget and the watchdog interrupted it.
+	TimedOut,
+	// The calendar's circuit breaker is open after too many timeouts, so the script wasn't called.
+	CircuitOpen
+};
+
+// Defined in PyBind.h, so that code handling errors doesn't need Python headers.
+struct TBPythonErrorState;
+
+/*
+	Why a script call failed.  Creating one is cheap: the Python exception is kept as-is, and only turned into text if
+	GetMessage() is called.
+*/
+class TBScriptError
+{
+public:
+	TBScriptError(TBScriptErrorCode code, const char* functionName, std::shared_ptr<TBPythonErrorState> pythonError = nullptr) :
+		Code(code),
+		FunctionName(functionName),
+		PythonError(std::move(pythonError))
+	{}
+
+	TBScriptErrorCode GetCode() const { return Code; }
+	const char* GetFunctionName() const { return FunctionName; }
+
+	// Takes the GIL if the error came from a Python exception.
+	QString GetMessage() const;
+
+private:
+	TBScriptErrorCode Code;
+	// Static string naming the script function that failed.
+	const char* FunctionName;
+	std::shared_ptr<TBPythonErrorState> PythonError;
+};
+
+/*
+	A TBScriptError thrown by the calls that throw, so that catching code can still tell what went wrong.  Timeouts and
+	open circuit breakers are always reported this way, since they aren't the script raising an exception.
+*/
+class TBScriptException : public std::runtime_error
+{
+public:
+	explicit TBScriptException(const TBScriptError& error) :
+		std::runtime_error(error.GetMessage().toStdString()),
+		Error(error)
+	{}
+
+	const TBScriptError& GetError() const { return Error; }
+
+private:
+	TBScriptError Error;
+};
+
+/*
+	Either a value or a TBScriptError, for calls that shouldn't throw or log when they fail.  The interface follows
+	std::expected, which isn't available before C++23.
+*/
+template<typename T>
+class TBScriptResult
+{
+public:
+	TBScriptResult(const T& value) : Storage(std::in_place_index<0>, value) {}
+	TBScriptResult(T&& value) : Storage(std::in_place_index<0>, std::move(value)) {}
+	TBScriptResult(const TBScriptError& error) : Storage(std::in_place_index<1>, error) {}
+	TBScriptResult(TBScriptError&& error) : Storage(std::in_place_index<1>, std::move(error)) {}
+
+	bool has_value() const { return Storage.index() == 0; }
+	explicit operator bool() const { return has_value(); }
+
+	// Throws if there's no value, formatting the error's message only then.
+	T& value() & { ThrowIfError(); return std::get<0>(Storage); }
+	const T& value() const & { ThrowIfError(); return std::get<0>(Storage); }
+	T&& value() && { ThrowIfError(); return std::get<0>(std::move(Storage)); }
+	T value_or(T fallback) const { return has_value() ? std::get<0>(Storage) : std::move(fallback); }
+
+	// Only valid when there's no value.
+	const TBScriptError& error() const { return std::get<1>(Storage); }
+
+	// Only valid when there is a value.
+	T& operator*() { return std::get<0>(Storage); }
+	const T& operator*() const { return std::get<0>(Storage); }
+	T* operator->() { return &std::get<0>(Storage); }
+	const T* operator->() const { return &std::get<0>(Storage); }
+
+private:
+	void ThrowIfError() const
+	{
+		if (!has_value())
+		{
+			throw TBScriptException(error());
+		}
+	}
+
+	std::variant<T, TBScriptError> Storage;
+};
\ No newline at end of file
@@ -0,0 +1,309 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (ScriptWatchdog.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PyBind.h"		// This has to come first to not conflict with Qt defines.
+#include "ScriptWatchdog.h"
+#include "Settings.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+TBScriptWatchdog* TBScriptWatchdog::singleton = nullptr;
+
+static std::chrono::milliseconds GetMillisecondsSetting(const char* key)
+{
+	return std::chrono::milliseconds(std::max<int64>(0, TBSettings::Get().GetValue<int64>(TBSettingsFile::System, "Calendar", key)));
+}
+
+TBScriptWatchdog::TBScriptWatchdog() :
+	CallBudget(GetMillisecondsSetting("ScriptCallBudgetMs")),
+	LongBudget(GetMillisecondsSetting("ScriptLongBudgetMs")),
+	BreakerTimeouts(std::max(1, TBSettings::Get().GetValue<int32>(TBSettingsFile::System, "Calendar", "ScriptBreakerTimeouts"))),
+	BreakerWindow(GetMillisecondsSetting("ScriptBreakerWindowMs")),
+	BreakerCooldown(GetMillisecondsSetting("ScriptBreakerCooldownMs")),
+	WatchMutex(),
+	WatchChanged(),
+	Watches(),
+	NextWatchID(1),
+	Stopping(false),
+	WatchThread()
+{
+	WatchThread = std::thread(&TBScriptWatchdog::Run, this);
+}
+
+TBScriptWatchdog::~TBScriptWatchdog()
+{
+	{
+		std::scoped_lock lock(WatchMutex);
+		Stopping = true;
+	}
+	WatchChanged.notify_all();
+
+	// The watchdog thread may be waiting for the GIL to interrupt something.
+	TBScopedGilRelease releaseGil;
+	WatchThread.join();
+}
+
+void TBScriptWatchdog::Initialize()
+{
+	if (singleton != nullptr)
+	{
+		throw std::runtime_error("TBScriptWatchdog singleton already initialized!");
+	}
+	else
+	{
+		singleton = new TBScriptWatchdog();
+	}
+}
+
+void TBScriptWatchdog::Cleanup()
+{
+	if (singleton != nullptr)
+	{
+		delete singleton;
+		singleton = nullptr;
+	}
+}
+
+std::chrono::milliseconds TBScriptWatchdog::GetBudget(TBScriptBudget budget) const
+{
+	return budget == TBScriptBudget::Long ? LongBudget : CallBudget;
+}
+
+uint64 TBScriptWatchdog::BeginWatch(std::chrono::milliseconds budget)
+{
+	Watch watch;
+	watch.ThreadID = PyThread_get_thread_ident();
+	watch.Deadline = std::chrono::steady_clock::now() + budget;
+	bool isNextDeadline = true;
+	{
+		std::scoped_lock lock(WatchMutex);
+		watch.WatchID = NextWatchID++;
+		// The watchdog thread only needs waking if this deadline comes before the one it's already waiting for.
+		for (const Watch& otherWatch : Watches)
+		{
+			if (!otherWatch.Interrupted && otherWatch.Deadline <= watch.Deadline)
+			{
+				isNextDeadline = false;
+				break;
+			}
+		}
+		Watches.push_back(watch);
+	}
+	if (isNextDeadline)
+	{
+		WatchChanged.notify_one();
+	}
+	return watch.WatchID;
+}
+
+bool TBScriptWatchdog::EndWatch(uint64 watchID)
+{
+	std::scoped_lock lock(WatchMutex);
+	auto watch = std::find_if(Watches.begin(), Watches.end(), [watchID](const Watch& candidate) { return candidate.WatchID == watchID; });
+	if (watch == Watches.end())
+	{
+		return false;
+	}
+
+	const bool interrupted = watch->Interrupted;
+	if (interrupted)
+	{
+		// The call may have returned before Python got around to raising the TimeoutError, which would then go off in
+		// whatever this thread runs next.
+		PyThreadState_SetAsyncExc(watch->ThreadID, nullptr);
+	}
+	Watches.erase(watch);
+	return interrupted;
+}
+
+void TBScriptWatchdog::Run()
+{
+	std::unique_lock lock(WatchMutex);
+	while (!Stopping)
+	{
+		auto nextWatch = Watches.end();
+		for (auto watch = Watches.begin(); watch != Watches.end(); ++watch)
+		{
+			if (!watch->Interrupted && (nextWatch == Watches.end() || watch->Deadline < nextWatch->Deadline))
+			{
+				nextWatch = watch;
+			}
+		}
+
+		if (nextWatch == Watches.end())
+		{
+			WatchChanged.wait(lock);
+			continue;
+		}
+		if (std::chrono::steady_clock::now() < nextWatch->Deadline)
+		{
+			WatchChanged.wait_until(lock, nextWatch->Deadline);
+			continue;
+		}
+
+		// Watched threads hold the GIL while they register and unregister, so the GIL comes first.  While we hold it,
+		// a watch that's still registered is still in its call.
+		const uint64 watchID = nextWatch->WatchID;
+		lock.unlock();
+		const PyGILState_STATE gilState = PyGILState_Ensure();
+		lock.lock();
+		auto watch = std::find_if(Watches.begin(), Watches.end(), [watchID](const Watch& candidate) { return candidate.WatchID == watchID; });
+		if (watch != Watches.end() && !Stopping)
+		{
+			watch->Interrupted = true;
+			PyThreadState_SetAsyncExc(watch->ThreadID, PyExc_TimeoutError);
+		}
+		lock.unlock();
+		PyGILState_Release(gilState);
+		lock.lock();
+	}
+}
+
+/*
+	TBScriptCircuitBreaker
+*/
+TBScriptCircuitBreaker::TBScriptCircuitBreaker() :
+	BreakerMutex(),
+	RecentTimeouts(),
+	OpenUntil(),
+	Open(false),
+	TrialCallRunning(false)
+{}
+
+bool TBScriptCircuitBreaker::AllowCall()
+{
+	std::scoped_lock lock(BreakerMutex);
+	if (!Open)
+	{
+		return true;
+	}
+	if (TrialCallRunning || Clock::now() < OpenUntil)
+	{
+		return false;
+	}
+	TrialCallRunning = true;
+	return true;
+}
+
+void TBScriptCircuitBreaker::RecordSuccess()
+{
+	std::scoped_lock lock(BreakerMutex);
+	if (Open && TrialCallRunning)
+	{
+		Open = false;
+		TrialCallRunning = false;
+		RecentTimeouts.clear();
+	}
+}
+
+bool TBScriptCircuitBreaker::RecordTimeout()
+{
+	if (!TBScriptWatchdog::IsInitialized())
+	{
+		return false;
+	}
+	const TBScriptWatchdog& watchdog = TBScriptWatchdog::Get();
+	const Clock::time_point now = Clock::now();
+
+	std::scoped_lock lock(BreakerMutex);
+	if (Open)
+	{
+		// The trial call timed out too.
+		TrialCallRunning = false;
+		OpenUntil = now + watchdog.GetBreakerCooldown();
+		return false;
+	}
+
+	std::erase_if(RecentTimeouts, [&](Clock::time_point timeout) { return now - timeout > watchdog.GetBreakerWindow(); });
+	RecentTimeouts.push_back(now);
+	if (static_cast<int32>(RecentTimeouts.size()) >= watchdog.GetBreakerTimeouts())
+	{
+		Open = true;
+		OpenUntil = now + watchdog.GetBreakerCooldown();
+		return true;
+	}
+	return false;
+}
+
+bool TBScriptCircuitBreaker::IsOpen() const
+{
+	std::scoped_lock lock(BreakerMutex);
+	return Open;
+}
+
+void TBScriptCircuitBreaker::Reset()
+{
+	std::scoped_lock lock(BreakerMutex);
+	RecentTimeouts.clear();
+	Open = false;
+	TrialCallRunning = false;
+}
+
+/*
+	TBScriptWatch
+*/
+TBScriptWatch::TBScriptWatch(TBScriptCircuitBreaker& breaker, TBScriptBudget budget) :
+	Breaker(breaker),
+	WatchID(0),
+	Finished(false),
+	TimedOut(false),
+	BreakerOpened(false)
+{
+	if (TBScriptWatchdog::IsInitialized())
+	{
+		const std::chrono::milliseconds budgetTime = TBScriptWatchdog::Get().GetBudget(budget);
+		if (budgetTime.count() > 0)
+		{
+			WatchID = TBScriptWatchdog::Get().BeginWatch(budgetTime);
+		}
+	}
+}
+
+TBScriptWatch::~TBScriptWatch()
+{
+	Finish();
+}
+
+bool TBScriptWatch::Finish()
+{
+	if (Finished)
+	{
+		return TimedOut;
+	}
+	Finished = true;
+
+	if (WatchID != 0)
+	{
+		TimedOut = TBScriptWatchdog::Get().EndWatch(WatchID);
+		if (TimedOut)
+		{
+			BreakerOpened = Breaker.RecordTimeout();
+		}
+		else
+		{
+			Breaker.RecordSuccess();
+		}
+	}
+	else
+	{
+		// Unwatched calls can't time out.  One may still be the breaker's trial call, if this budget is turned off and
+		// the other isn't, and the breaker would stay open for good if it never heard back.
+		Breaker.RecordSuccess();
+	}
+	return TimedOut;
+}
\ No newline at end of file
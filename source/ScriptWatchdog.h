@@ -0,0 +1,147 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (ScriptWatchdog.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class TBScriptBudget : uint8
+{
+	// A call about a single date.
+	Call,
+	// Initialization and batch calls, which can take a while even when nothing's wrong.
+	Long
+};
+
+/*
+	Interrupts calendar script calls that run past their time budget.  A watched call is registered before it goes
+	into the script, and if it's still running when its budget is up, the watchdog thread takes the GIL and raises
+	TimeoutError in the calling thread.  Python only checks for that between bytecodes, so a script stuck inside a
+	single long native call (a huge integer power, say) is only interrupted once that call returns.
+
+	Only calls on the main interpreter are watched.  Worker processes have their own timeout.
+*/
+class TBScriptWatchdog
+{
+public:
+	static void Initialize();
+	static bool IsInitialized() { return singleton != nullptr; }
+	static TBScriptWatchdog& Get() { return *singleton; }
+	static void Cleanup();
+
+	std::chrono::milliseconds GetBudget(TBScriptBudget budget) const;
+	// How many timeouts within the window open a circuit breaker, and how long it stays open.
+	int32 GetBreakerTimeouts() const { return BreakerTimeouts; }
+	std::chrono::milliseconds GetBreakerWindow() const { return BreakerWindow; }
+	std::chrono::milliseconds GetBreakerCooldown() const { return BreakerCooldown; }
+
+	// Both of these need the calling thread to hold the GIL.  EndWatch returns true if the call was interrupted.
+	uint64 BeginWatch(std::chrono::milliseconds budget);
+	bool EndWatch(uint64 watchID);
+
+private:
+	TBScriptWatchdog();
+	~TBScriptWatchdog();
+
+	static TBScriptWatchdog* singleton;
+
+	struct Watch
+	{
+		uint64 WatchID = 0;
+		// Python's identifier for the watched thread, for PyThreadState_SetAsyncExc.
+		unsigned long ThreadID = 0;
+		std::chrono::steady_clock::time_point Deadline;
+		bool Interrupted = false;
+	};
+
+	void Run();
+
+	std::chrono::milliseconds CallBudget;
+	std::chrono::milliseconds LongBudget;
+	int32 BreakerTimeouts;
+	std::chrono::milliseconds BreakerWindow;
+	std::chrono::milliseconds BreakerCooldown;
+
+	std::mutex WatchMutex;
+	std::condition_variable WatchChanged;
+	std::vector<Watch> Watches;
+	uint64 NextWatchID;
+	bool Stopping;
+	std::thread WatchThread;
+};
+
+/*
+	Keeps a calendar from being called while its script keeps timing out.  Once there have been enough timeouts close
+	together, the breaker opens and calls fail right away, without going into the script.  After a cooldown, one call
+	is let through: if it finishes in time the breaker closes again, and if not it stays open for another cooldown.
+	Never opens while the watchdog isn't running.
+*/
+class TBScriptCircuitBreaker
+{
+public:
+	TBScriptCircuitBreaker();
+
+	// False while the breaker is open, meaning the call shouldn't be made.
+	bool AllowCall();
+	void RecordSuccess();
+	// Returns true if this timeout opened the breaker.
+	bool RecordTimeout();
+	bool IsOpen() const;
+	void Reset();
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	mutable std::mutex BreakerMutex;
+	std::vector<Clock::time_point> RecentTimeouts;
+	Clock::time_point OpenUntil;
+	bool Open;
+	bool TrialCallRunning;
+};
+
+/*
+	Watches one script call for as long as it's in scope, and reports how it went to a circuit breaker.  If the
+	watchdog isn't running or the budget is turned off, the call isn't watched and always counts as a success.  The
+	GIL has to be held for the whole scope.
+*/
+class TBScriptWatch
+{
+public:
+	TBScriptWatch(TBScriptCircuitBreaker& breaker, TBScriptBudget budget);
+	~TBScriptWatch();
+
+	TBScriptWatch(const TBScriptWatch&) = delete;
+	TBScriptWatch& operator=(const TBScriptWatch&) = delete;
+
+	// Stops watching early.  Returns true if the call ran out of time.
+	bool Finish();
+	// Whether the call's timeout was the one that opened the breaker.  Only set once finished.
+	bool OpenedBreaker() const { return BreakerOpened; }
+
+private:
+	TBScriptCircuitBreaker& Breaker;
+	uint64 WatchID;
+	bool Finished;
+	bool TimedOut;
+	bool BreakerOpened;
+};
\ No newline at end of file
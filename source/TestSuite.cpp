@@ -23,14 +23,80 @@
 #include "JsonFiles.h"
 #include "Calendar.h"
 #include "Logging.h"
+#include "AllocationCounter.h"
+#include "CalendarCache.h"
+#include "ScriptProfiler.h"
+#include "TickGenerator.h"
+#include "UuidMap.h"
+#include "Version.h"
 
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QJsonArray>
 #include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QMap>
+#include <QtCore/QUuid>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Benchmark inputs are spread over this many days either side of day 0, which is a few thousand years in most calendars.
+static constexpr int64 BENCH_DAY_RANGE = 1000000;
+// Fixed, so that runs of the same build see the same inputs.
+static constexpr uint64 BENCH_SEED = 0x5EED;
+static constexpr int64 BENCH_DEFAULT_CALLS = 1000000;
+
+// Tick boundaries are checked over this many days either side of day 0.
+static constexpr int64 TICK_TEST_DAY_RANGE = 4000;
+
+// Verifier threads take the day range this many days at a time.
+static constexpr int64 VERIFY_CHUNK_DAYS = 65536;
+// There's no batch call for moving dates, so only every this many days gets its moves checked.
+static constexpr int64 VERIFY_MOVE_STRIDE = 61;
+// Counterexamples kept for each invariant, earliest days first.
+static constexpr size_t VERIFY_MAX_COUNTEREXAMPLES = 8;
+static constexpr int64 VERIFY_DEFAULT_MIN_YEAR = -10000;
+static constexpr int64 VERIFY_DEFAULT_MAX_YEAR = 10000;
+
+static constexpr int64 MAP_BENCH_DEFAULT_SIZES[] = { 10000, 1000000, 10000000 };
 
 TBTestSuite::TBTestSuite(const QCoreApplication& app) :
 	Parser(),
-	CalendarParam("calendar-test", "Tests the given calendar system without running the full app.", "system")
+	CalendarParam("calendar-test", "Tests the given calendar system without running the full app.", "system"),
+	CalendarBenchParam("calendar-bench", "Benchmarks the given calendar system without running the full app.", "system"),
+	CalendarBenchCallsParam("calendar-bench-calls", "Number of calls to time for each calendar method.", "count"),
+	CalendarBenchOutputParam("calendar-bench-output", "File to write calendar benchmark results to, as JSON.", "path"),
+	CalendarBenchScriptOnlyParam("calendar-bench-script-only", "Sends every benchmarked call to the calendar script, past native rules and result caches."),
+	CalendarVerifyParam("calendar-verify", "Checks the given calendar system's conversions over a range of years.", "system"),
+	CalendarVerifyMinYearParam("calendar-verify-min-year", "First year for the calendar verifier to check.", "year"),
+	CalendarVerifyMaxYearParam("calendar-verify-max-year", "Last year for the calendar verifier to check.", "year"),
+	CalendarVerifyThreadsParam("calendar-verify-threads", "Number of threads for the calendar verifier.", "count"),
+	CacheTestParam("cache-test", "Checks that the calendar result cache hits, misses and resets as it should."),
+	MapBenchParam("map-bench", "Benchmarks the map types TBMap can be with QUuid keys."),
+	MapBenchSizesParam("map-bench-sizes", "Comma-separated entry counts for the map benchmark.", "sizes"),
+	MapBenchOutputParam("map-bench-output", "File to write map benchmark results to, as JSON.", "path")
 {
 	Parser.addOption(CalendarParam);
+	Parser.addOption(CalendarBenchParam);
+	Parser.addOption(CalendarBenchCallsParam);
+	Parser.addOption(CalendarBenchOutputParam);
+	Parser.addOption(CalendarBenchScriptOnlyParam);
+	Parser.addOption(CalendarVerifyParam);
+	Parser.addOption(CalendarVerifyMinYearParam);
+	Parser.addOption(CalendarVerifyMaxYearParam);
+	Parser.addOption(CalendarVerifyThreadsParam);
+	Parser.addOption(CacheTestParam);
+	Parser.addOption(MapBenchParam);
+	Parser.addOption(MapBenchSizesParam);
+	Parser.addOption(MapBenchOutputParam);
 
 	// Must run after adding all options.
 	Parser.process(app);
@@ -41,6 +107,10 @@ bool TBTestSuite::RunTests()
 	bool anyTestRan = false;
 
 	anyTestRan |= CalendarSystemTest();
+	anyTestRan |= CalendarBenchmark();
+	anyTestRan |= CalendarVerifier();
+	anyTestRan |= CalendarCacheTest();
+	anyTestRan |= MapBenchmark();
 
 	return anyTestRan;
 }
@@ -60,52 +130,12 @@ bool TBTestSuite::CalendarSystemTest()
 
 	TBLog::Log("Beginning calendar system test: %0", testSystem);
 
-	QString jsonPath = QString("scripts/%0.json").arg(testSystem);
-	TBJsonFile jsonFile(jsonPath, QIODevice::ReadOnly);
-	QJsonDocument* calendarData = nullptr;
-	EJsonFileResult openResult = jsonFile.GetJsonDocument(calendarData);
-
-	if (openResult == EJsonFileResult::Success)
-	{
-		TBLog::Log("Calendar system data successfully loaded.");
-	}
-	else
-	{
-		assert(calendarData != nullptr);
-
-		switch (openResult)
-		{
-		case EJsonFileResult::FileNotFound:
-			TBLog::Error("Could not open calendar system file (%0).  Test aborted.", jsonPath);
-			break;
-		case EJsonFileResult::FileNotJson:
-			TBLog::Error("Calendar system file (%0) did not contain valid JSON.  Test aborted.", jsonPath);
-			break;
-		default:
-			TBLog::Error("Unknown error opening the calendar system file (%s).  Test aborted.", jsonPath);
-			break;
-		}
-
-		return true;
-	}
-
 	TBCalendarSystem calendarSystem;
-	calendarSystem.LoadFromJson(calendarData->object());
-	if (!calendarSystem.IsValid())
+	if (!LoadCalendarSystem(testSystem, calendarSystem))
 	{
-		TBLog::Error("Error populating calendar system from JSON data.  Test aborted.");
 		return true;
 	}
 
-	TBLog::Log("Calendar System Info:");
-	TBLog::Log(QString("%0 --- %1").arg(calendarSystem.GetName(), calendarSystem.GetDescription()));
-
-	if (!calendarSystem.InitializeScript())
-	{
-		TBLog::Error("Error initializing calendar script.  See Python exception above.  Test aborted.");
-		return true;
-	}
-	
 	TBLog::Log("Calendar system script initialized.  Beginning test suite.");
 
 	/*
@@ -308,6 +338,46 @@ bool TBTestSuite::CalendarSystemTest()
 				}
 			}
 		}
+		// Tick boundary tests
+		{
+			// Boundaries found from samples have to match breaking every day in the range.  Units shorter than the
+			// sampling stride (like the festival days in harptos_cal) are the ones that could go missing.
+			std::vector<TBDate> days;
+			for (int64 day = -TICK_TEST_DAY_RANGE - 1; day < TICK_TEST_DAY_RANGE; day++)
+			{
+				days.push_back(day);
+			}
+			std::vector<int64> brokenDays;
+			calendarSystem.BreakDates(days, brokenDays);
+
+			TBTickGenerator tickGenerator;
+			for (int32 component = 0; component < static_cast<int32>(maxBrokenDateLength); component++)
+			{
+				std::vector<TBDate> expectedBoundaries;
+				for (size_t dayIndex = 1; dayIndex < days.size(); dayIndex++)
+				{
+					const int64* previousDate = brokenDays.data() + (dayIndex - 1) * maxBrokenDateLength;
+					const int64* date = brokenDays.data() + dayIndex * maxBrokenDateLength;
+					if (!std::equal(previousDate, previousDate + component + 1, date))
+					{
+						expectedBoundaries.push_back(days[dayIndex]);
+					}
+				}
+
+				std::vector<TBDate> boundaries;
+				tickGenerator.GetBoundaries(calendarSystem, -TICK_TEST_DAY_RANGE, TICK_TEST_DAY_RANGE, TBTickUnit{ component, 1 }, boundaries);
+				if (boundaries == expectedBoundaries)
+				{
+					TBLog::Log("Test %0: Found all %1 boundaries of component %2 between day %3 and day %4", testIndex++,
+						boundaries.size(), component, -TICK_TEST_DAY_RANGE, TICK_TEST_DAY_RANGE);
+				}
+				else
+				{
+					TBLog::Warning("Test %0: Found %1 boundaries of component %2 between day %3 and day %4, but there are %5!", testIndex++,
+						boundaries.size(), component, -TICK_TEST_DAY_RANGE, TICK_TEST_DAY_RANGE, expectedBoundaries.size());
+				}
+			}
+		}
 	}
 	catch (...)
 	{
@@ -315,7 +385,890 @@ bool TBTestSuite::CalendarSystemTest()
 		return true;
 	}
 
+	const TBCacheStats cacheStats = calendarSystem.GetCacheStats();
+	TBLog::Log("Calendar result cache: %0 hits, %1 misses.", cacheStats.Hits, cacheStats.Misses);
+	if constexpr (TBScriptProfiler::IsEnabled())
+	{
+		TBScriptProfiler::LogStats();
+	}
+
 	TBLog::Log("Calendar system test suite complete.");
 
+	return true;
+}
+
+bool TBTestSuite::LoadCalendarSystem(const QString& systemName, TBCalendarSystem& outCalendarSystem)
+{
+	QString jsonPath = QString("scripts/%0.json").arg(systemName);
+	TBJsonFile jsonFile(jsonPath, QIODevice::ReadOnly);
+	QJsonDocument* calendarData = nullptr;
+	EJsonFileResult openResult = jsonFile.GetJsonDocument(calendarData);
+
+	if (openResult == EJsonFileResult::Success)
+	{
+		TBLog::Log("Calendar system data successfully loaded.");
+	}
+	else
+	{
+		assert(calendarData != nullptr);
+
+		switch (openResult)
+		{
+		case EJsonFileResult::FileNotFound:
+			TBLog::Error("Could not open calendar system file (%0).  Aborted.", jsonPath);
+			break;
+		case EJsonFileResult::FileNotJson:
+			TBLog::Error("Calendar system file (%0) did not contain valid JSON.  Aborted.", jsonPath);
+			break;
+		default:
+			TBLog::Error("Unknown error opening the calendar system file (%s).  Aborted.", jsonPath);
+			break;
+		}
+
+		return false;
+	}
+
+	outCalendarSystem.LoadFromJson(calendarData->object());
+	if (!outCalendarSystem.IsValid())
+	{
+		TBLog::Error("Error populating calendar system from JSON data.  Aborted.");
+		return false;
+	}
+
+	TBLog::Log("Calendar System Info:");
+	TBLog::Log(QString("%0 --- %1").arg(outCalendarSystem.GetName(), outCalendarSystem.GetDescription()));
+
+	if (!outCalendarSystem.InitializeScript())
+	{
+		TBLog::Error("Error initializing calendar script.  See Python exception above.  Aborted.");
+		return false;
+	}
+	
+
+	return true;
+}
+
+// Times callCount calls to call(index), one at a time, and returns the method's entry for the results file.
+template<typename CallFunction>
+static QJsonObject BenchmarkCalendarMethod(const QString& methodName, size_t callCount, std::vector<int64>& latencies, CallFunction call)
+{
+	using Clock = std::chrono::steady_clock;
+
+	latencies.resize(callCount);
+	const uint64 allocationsBefore = TBAllocationCounter::GetThreadAllocations();
+	const Clock::time_point start = Clock::now();
+	for (size_t callIndex = 0; callIndex < callCount; callIndex++)
+	{
+		const Clock::time_point callStart = Clock::now();
+		call(callIndex);
+		latencies[callIndex] = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - callStart).count();
+	}
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	const uint64 allocations = TBAllocationCounter::GetThreadAllocations() - allocationsBefore;
+
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&](double fraction)
+	{
+		return latencies[std::min(callCount - 1, static_cast<size_t>(fraction * callCount))];
+	};
+
+	const double callsPerSecond = seconds > 0.0 ? callCount / seconds : 0.0;
+	const double allocationsPerCall = static_cast<double>(allocations) / callCount;
+	if constexpr (TBAllocationCounter::IsEnabled())
+	{
+		TBLog::Log("%0: %1 calls/s, p50 %2 ns, p99 %3 ns, p99.9 %4 ns, %5 allocations/call", methodName, callsPerSecond,
+			percentile(0.5), percentile(0.99), percentile(0.999), allocationsPerCall);
+	}
+	else
+	{
+		TBLog::Log("%0: %1 calls/s, p50 %2 ns, p99 %3 ns, p99.9 %4 ns", methodName, callsPerSecond, percentile(0.5),
+			percentile(0.99), percentile(0.999));
+	}
+
+	QJsonObject result;
+	result.insert("calls", static_cast<qint64>(callCount));
+	result.insert("seconds", seconds);
+	result.insert("calls_per_second", callsPerSecond);
+	result.insert("p50_ns", static_cast<qint64>(percentile(0.5)));
+	result.insert("p99_ns", static_cast<qint64>(percentile(0.99)));
+	result.insert("p999_ns", static_cast<qint64>(percentile(0.999)));
+	result.insert("max_ns", static_cast<qint64>(latencies.back()));
+	if constexpr (TBAllocationCounter::IsEnabled())
+	{
+		result.insert("allocations_per_call", allocationsPerCall);
+	}
+	return result;
+}
+
+bool TBTestSuite::CalendarBenchmark()
+{
+	// Only try to run the benchmark if a value has been specified
+	QString benchSystem = Parser.value(CalendarBenchParam);
+	if (benchSystem.isEmpty())
+	{
+		return false;
+	}
+
+	TBLog::Log("Beginning calendar system benchmark: %0", benchSystem);
+
+	int64 callCount = BENCH_DEFAULT_CALLS;
+	if (Parser.isSet(CalendarBenchCallsParam))
+	{
+		bool validCount = false;
+		callCount = Parser.value(CalendarBenchCallsParam).toLongLong(&validCount);
+		if (!validCount || callCount <= 0)
+		{
+			TBLog::Error("Invalid calendar benchmark call count (%0).  Benchmark aborted.", Parser.value(CalendarBenchCallsParam));
+			return true;
+		}
+	}
+
+	const QString outputPath = Parser.isSet(CalendarBenchOutputParam) ? Parser.value(CalendarBenchOutputParam)
+		: QString("calendar-bench-%0.json").arg(benchSystem);
+
+	TBCalendarSystem calendarSystem;
+	if (!LoadCalendarSystem(benchSystem, calendarSystem))
+	{
+		return true;
+	}
+
+	const bool scriptOnly = Parser.isSet(CalendarBenchScriptOnlyParam);
+	if (scriptOnly)
+	{
+		TBLog::Log("Bypassing native rules, the native date format and result caches, so every call goes to the script.");
+		calendarSystem.BypassFastPaths();
+	}
+
+	// Only the benchmark's own calls go into its profile.
+	TBScriptProfiler::Reset();
+
+	const int32 brokenDateLength = calendarSystem.GetBrokenDateLength();
+	const size_t calls = static_cast<size_t>(callCount);
+	QJsonObject methodResults;
+
+	try
+	{
+		/*
+			Inputs are all generated up front, so that only the calls themselves are timed.
+		*/
+		TBLog::Log("Generating %0 inputs per method...", callCount);
+
+		std::mt19937_64 random(BENCH_SEED);
+		std::uniform_int_distribution<int64> dayDistribution(-BENCH_DAY_RANGE, BENCH_DAY_RANGE);
+		std::uniform_int_distribution<int64> spanDistribution(-12, 12);
+		std::uniform_int_distribution<int32> invalidDistribution(0, 3);
+
+		auto randomDays = [&]()
+		{
+			std::vector<TBDate> days(calls);
+			std::generate(days.begin(), days.end(), [&]() { return TBDate(dayDistribution(random)); });
+			return days;
+		};
+		// Dates from breaking random days, so they're valid unless we deliberately break them.
+		auto randomBrokenDates = [&]()
+		{
+			std::vector<int64> flatBrokenDates;
+			calendarSystem.BreakDates(randomDays(), flatBrokenDates);
+			std::vector<TBBrokenDate> brokenDates;
+			brokenDates.reserve(calls);
+			for (size_t offset = 0; offset < flatBrokenDates.size(); offset += brokenDateLength)
+			{
+				brokenDates.emplace_back(flatBrokenDates.begin() + offset, flatBrokenDates.begin() + offset + brokenDateLength);
+			}
+			return brokenDates;
+		};
+
+		const std::vector<TBDate> breakDays = randomDays();
+		const std::vector<TBDate> formatDays = randomDays();
+		const std::vector<TBDate> moveDays = randomDays();
+		const std::vector<TBBrokenDate> combineDates = randomBrokenDates();
+		std::vector<TBBrokenDate> validateDates = randomBrokenDates();
+		// About a quarter of validation inputs are pushed out of range.
+		for (TBBrokenDate& brokenDate : validateDates)
+		{
+			if (invalidDistribution(random) == 0)
+			{
+				brokenDate.last() += 100 * spanDistribution(random);
+			}
+		}
+		std::vector<TBBrokenTimespan> moveSpans(calls);
+		for (TBBrokenTimespan& span : moveSpans)
+		{
+			span.resize(brokenDateLength);
+			std::generate(span.begin(), span.end(), [&]() { return spanDistribution(random); });
+		}
+
+		/*
+			Benchmark proper begins here.  Each method is run on its own, so a failing one doesn't stop the rest.
+		*/
+		std::vector<int64> latencies;
+		// Keeps results alive so the calls can't be optimized away.
+		volatile int64 sink = 0;
+
+		/*
+			Each method's results say where its calls went first: "native" rules or "format_program" (which fall back
+			to the script for anything they can't answer), or "script".  Script results are cached, except for
+			MoveDate, so the cache counts show how many calls the script actually served.
+		*/
+		auto runMethod = [&](const QString& methodName, const QString& path, auto call)
+		{
+			try
+			{
+				const TBCacheStats cacheStatsBefore = calendarSystem.GetCacheStats();
+				QJsonObject methodResult = BenchmarkCalendarMethod(methodName, calls, latencies, call);
+				const TBCacheStats cacheStatsAfter = calendarSystem.GetCacheStats();
+				methodResult.insert("path", path);
+				methodResult.insert("cache_hits", static_cast<qint64>(cacheStatsAfter.Hits - cacheStatsBefore.Hits));
+				methodResult.insert("cache_misses", static_cast<qint64>(cacheStatsAfter.Misses - cacheStatsBefore.Misses));
+				TBLog::Log("%0 went to %1 first.", methodName, path);
+				methodResults.insert(methodName, methodResult);
+			}
+			catch (const std::exception& exception)
+			{
+				TBLog::Error("Exception thrown while benchmarking %0: %1", methodName, exception.what());
+				QJsonObject failure;
+				failure.insert("error", QString(exception.what()));
+				methodResults.insert(methodName, failure);
+			}
+		};
+
+		const QString datePath = calendarSystem.HasNativeBackend() ? QString("native") : QString("script");
+		const QString formatPath = calendarSystem.HasFormatProgram() ? QString("format_program") : QString("script");
+
+		runMethod("BreakDate", datePath, [&](size_t index)
+		{
+			TBBrokenDate brokenDate;
+			calendarSystem.BreakDate(breakDays[index], brokenDate);
+			sink = sink + brokenDate.length();
+		});
+		runMethod("CombineDate", datePath, [&](size_t index)
+		{
+			sink = sink + calendarSystem.CombineDate(combineDates[index]).GetDays();
+		});
+		runMethod("FormatDate", formatPath, [&](size_t index)
+		{
+			sink = sink + calendarSystem.FormatDate(formatDays[index]).length();
+		});
+		runMethod("MoveDate", datePath, [&](size_t index)
+		{
+			sink = sink + calendarSystem.MoveDate(moveDays[index], moveSpans[index]).GetDays();
+		});
+		runMethod("ValidateBrokenDate", datePath, [&](size_t index)
+		{
+			sink = sink + (calendarSystem.ValidateBrokenDate(validateDates[index]) ? 1 : 0);
+		});
+	}
+	catch (const std::exception& exception)
+	{
+		TBLog::Error("Exception thrown while preparing calendar benchmark: %0  Benchmark aborted.", exception.what());
+		return true;
+	}
+
+	const TBCacheStats cacheStats = calendarSystem.GetCacheStats();
+	TBLog::Log("Calendar result cache: %0 hits, %1 misses.", cacheStats.Hits, cacheStats.Misses);
+	if constexpr (TBScriptProfiler::IsEnabled())
+	{
+		TBScriptProfiler::LogStats();
+	}
+
+	/*
+		Results
+	*/
+	QJsonObject cacheResults;
+	cacheResults.insert("hits", static_cast<qint64>(cacheStats.Hits));
+	cacheResults.insert("misses", static_cast<qint64>(cacheStats.Misses));
+
+	QJsonObject results;
+	results.insert("system", benchSystem);
+	results.insert("version", QString("%0.%1.%2").arg(MAJOR_VERSION).arg(MINOR_VERSION).arg(PATCH_VERSION));
+	results.insert("calls_per_method", callCount);
+	results.insert("script_only", scriptOnly);
+	results.insert("seed", static_cast<qint64>(BENCH_SEED));
+	results.insert("methods", methodResults);
+	results.insert("cache", cacheResults);
+	results.insert("script_profile", TBScriptProfiler::GetStatsJson());
+
+	QFile outputFile(outputPath);
+	if (!outputFile.open(QIODeviceBase::WriteOnly | QIODeviceBase::Truncate | QIODeviceBase::Text)
+		|| outputFile.write(QJsonDocument(results).toJson(QJsonDocument::Indented)) < 0)
+	{
+		TBLog::Error("Could not write calendar benchmark results to %0.", outputPath);
+		return true;
+	}
+
+	TBLog::Log("Calendar benchmark complete.  Results written to %0.", outputPath);
+
+	return true;
+}
+
+static QString BrokenDateToString(std::span<const int64> components)
+{
+	QStringList parts;
+	for (int64 component : components)
+	{
+		parts.append(QString::number(component));
+	}
+	return QString("[%0]").arg(parts.join(", "));
+}
+
+/*
+	Invariants checked by the calendar verifier.  Each keeps a count of failures and the earliest few
+	counterexamples, which can come in from any verifier thread.
+*/
+struct TBVerifiedInvariant
+{
+	QString Description;
+	std::atomic<uint64> Checked = 0;
+	std::atomic<uint64> Failed = 0;
+
+	std::mutex CounterexampleMutex;
+	// Keyed by day, so the earliest are kept.
+	std::map<int64, QString> Counterexamples;
+
+	explicit TBVerifiedInvariant(const QString& description) : Description(description) {}
+
+	void AddFailure(int64 day, const QString& details)
+	{
+		Failed++;
+		std::scoped_lock lock(CounterexampleMutex);
+		if (Counterexamples.size() < VERIFY_MAX_COUNTEREXAMPLES || day < Counterexamples.rbegin()->first)
+		{
+			Counterexamples.emplace(day, details);
+			if (Counterexamples.size() > VERIFY_MAX_COUNTEREXAMPLES)
+			{
+				Counterexamples.erase(std::prev(Counterexamples.end()));
+			}
+		}
+	}
+};
+
+bool TBTestSuite::CalendarVerifier()
+{
+	// Only try to run the verifier if a value has been specified
+	QString verifySystem = Parser.value(CalendarVerifyParam);
+	if (verifySystem.isEmpty())
+	{
+		return false;
+	}
+
+	TBLog::Log("Beginning calendar system verification: %0", verifySystem);
+
+	auto readInt64Option = [this](const QCommandLineOption& option, int64 defaultValue, int64& outValue)
+	{
+		bool valid = true;
+		outValue = Parser.isSet(option) ? Parser.value(option).toLongLong(&valid) : defaultValue;
+		if (!valid)
+		{
+			TBLog::Error("Invalid value for --%0 (%1).  Verification aborted.", option.names().first(), Parser.value(option));
+		}
+		return valid;
+	};
+
+	int64 minYear = 0;
+	int64 maxYear = 0;
+	int64 threadCount = 0;
+	if (!readInt64Option(CalendarVerifyMinYearParam, VERIFY_DEFAULT_MIN_YEAR, minYear)
+		|| !readInt64Option(CalendarVerifyMaxYearParam, VERIFY_DEFAULT_MAX_YEAR, maxYear)
+		|| !readInt64Option(CalendarVerifyThreadsParam, std::max<int64>(std::thread::hardware_concurrency(), 1), threadCount))
+	{
+		return true;
+	}
+	if (minYear > maxYear || threadCount <= 0)
+	{
+		TBLog::Error("Calendar verifier needs a non-empty year range and at least one thread.  Verification aborted.");
+		return true;
+	}
+
+	// The invariants are checked against the script itself.  A second instance keeps whatever fast path the calendar
+	// found, and that's checked against the script rather than against itself.
+	TBCalendarSystem calendarSystem;
+	TBCalendarSystem fastCalendarSystem;
+	if (!LoadCalendarSystem(verifySystem, calendarSystem) || !LoadCalendarSystem(verifySystem, fastCalendarSystem))
+	{
+		return true;
+	}
+	calendarSystem.BypassFastPaths();
+	const bool checkFastPath = fastCalendarSystem.HasNativeBackend();
+
+	const int32 brokenDateLength = calendarSystem.GetBrokenDateLength();
+
+	/*
+		Work out the day range from the years.  The range ends the day before the first valid year after maxYear, so
+		calendars without a year zero still get all of maxYear.
+	*/
+	int64 firstDay = 0;
+	int64 lastDay = 0;
+	try
+	{
+		firstDay = calendarSystem.CombineDate(TBBrokenDate({ minYear })).GetDays();
+		// Only ever has to skip one year (zero), so give up after that and let combining report the problem.
+		int64 followingYear = maxYear + 1;
+		if (!calendarSystem.ValidateBrokenDate(TBBrokenDate({ followingYear })))
+		{
+			followingYear++;
+		}
+		lastDay = calendarSystem.CombineDate(TBBrokenDate({ followingYear })).GetDays() - 1;
+	}
+	catch (const std::exception& exception)
+	{
+		TBLog::Error("Could not find the days for years %0 to %1: %2  Verification aborted.", minYear, maxYear, exception.what());
+		return true;
+	}
+	if (firstDay > lastDay)
+	{
+		TBLog::Error("Years %0 to %1 map to an empty day range (%2 to %3).  Verification aborted.", minYear, maxYear, firstDay, lastDay);
+		return true;
+	}
+
+	const int64 chunkCount = (lastDay - firstDay) / VERIFY_CHUNK_DAYS + 1;
+	threadCount = std::min(threadCount, chunkCount);
+	TBLog::Log("Verifying years %0 to %1 (days %2 to %3) on %4 threads.", minYear, maxYear, firstDay, lastDay, threadCount);
+	if (!checkFastPath)
+	{
+		TBLog::Log("Calendar has no fast path for breaking and combining dates, so only its script is verified.");
+	}
+
+	TBVerifiedInvariant roundTrip("combine_date(break_date(d)) == d");
+	TBVerifiedInvariant ordering("break_date(d) < break_date(d + 1)");
+	TBVerifiedInvariant moveZero("move_date(d, 0) == d");
+	TBVerifiedInvariant moveDay("move_date(d, one day) == d + 1");
+	TBVerifiedInvariant fastPath("fast path breaks and combines dates like the script");
+
+	std::atomic<int64> nextChunk = 0;
+	std::atomic<bool> aborted = false;
+	std::mutex errorMutex;
+	QString firstError;
+
+	auto verifyChunks = [&]()
+	{
+		std::vector<TBDate> days;
+		std::vector<int64> flatBrokenDates;
+		std::vector<TBDate> combinedDates;
+		std::vector<int64> fastFlatBrokenDates;
+		std::vector<TBDate> fastCombinedDates;
+		TBBrokenTimespan zeroSpan(brokenDateLength, 0);
+		TBBrokenTimespan daySpan(brokenDateLength, 0);
+		daySpan.last() = 1;
+
+		try
+		{
+			for (int64 chunk = nextChunk++; chunk < chunkCount && !aborted; chunk = nextChunk++)
+			{
+				const int64 chunkStart = firstDay + chunk * VERIFY_CHUNK_DAYS;
+				const int64 chunkEnd = std::min(chunkStart + VERIFY_CHUNK_DAYS - 1, lastDay);
+
+				// One day past the end, so ordering can be checked across chunk boundaries.
+				days.clear();
+				for (int64 day = chunkStart; day <= chunkEnd + 1; day++)
+				{
+					days.emplace_back(day);
+				}
+				calendarSystem.BreakDates(days, flatBrokenDates);
+				std::span<const int64> allComponents(flatBrokenDates);
+				auto componentsOf = [&](size_t dayIndex) { return allComponents.subspan(dayIndex * brokenDateLength, brokenDateLength); };
+
+				const size_t checkedDays = static_cast<size_t>(chunkEnd - chunkStart + 1);
+				calendarSystem.CombineDates(allComponents.first(checkedDays * brokenDateLength), combinedDates);
+				if (checkFastPath)
+				{
+					fastCalendarSystem.BreakDates(days, fastFlatBrokenDates);
+					fastCalendarSystem.CombineDates(allComponents.first(checkedDays * brokenDateLength), fastCombinedDates);
+				}
+
+				for (size_t dayIndex = 0; dayIndex < checkedDays; dayIndex++)
+				{
+					const int64 day = chunkStart + static_cast<int64>(dayIndex);
+					if (combinedDates[dayIndex].GetDays() != day)
+					{
+						roundTrip.AddFailure(day, QString("day %0 breaks to %1, which combines to day %2").arg(day)
+							.arg(BrokenDateToString(componentsOf(dayIndex))).arg(combinedDates[dayIndex].GetDays()));
+					}
+
+					std::span<const int64> current = componentsOf(dayIndex);
+					std::span<const int64> next = componentsOf(dayIndex + 1);
+					if (!std::lexicographical_compare(current.begin(), current.end(), next.begin(), next.end()))
+					{
+						ordering.AddFailure(day, QString("day %0 breaks to %1, but day %2 breaks to %3").arg(day)
+							.arg(BrokenDateToString(current)).arg(day + 1).arg(BrokenDateToString(next)));
+					}
+
+					if (checkFastPath)
+					{
+						std::span<const int64> fastComponents = std::span<const int64>(fastFlatBrokenDates).subspan(dayIndex * brokenDateLength, brokenDateLength);
+						if (!std::ranges::equal(fastComponents, current))
+						{
+							fastPath.AddFailure(day, QString("day %0 breaks to %1 in the script, but to %2 in the fast path").arg(day)
+								.arg(BrokenDateToString(current)).arg(BrokenDateToString(fastComponents)));
+						}
+						else if (fastCombinedDates[dayIndex] != combinedDates[dayIndex])
+						{
+							fastPath.AddFailure(day, QString("%0 combines to day %1 in the script, but to day %2 in the fast path")
+								.arg(BrokenDateToString(current)).arg(combinedDates[dayIndex].GetDays()).arg(fastCombinedDates[dayIndex].GetDays()));
+						}
+					}
+
+					if (day % VERIFY_MOVE_STRIDE == 0)
+					{
+						const int64 unmoved = calendarSystem.MoveDate(day, zeroSpan).GetDays();
+						if (unmoved != day)
+						{
+							moveZero.AddFailure(day, QString("day %0 moved by nothing is day %1").arg(day).arg(unmoved));
+						}
+						const int64 moved = calendarSystem.MoveDate(day, daySpan).GetDays();
+						if (moved != day + 1)
+						{
+							moveDay.AddFailure(day, QString("day %0 moved by one day is day %1").arg(day).arg(moved));
+						}
+						moveZero.Checked++;
+						moveDay.Checked++;
+					}
+				}
+
+				roundTrip.Checked += checkedDays;
+				ordering.Checked += checkedDays;
+				if (checkFastPath)
+				{
+					fastPath.Checked += checkedDays;
+				}
+			}
+		}
+		catch (const std::exception& exception)
+		{
+			std::scoped_lock lock(errorMutex);
+			if (firstError.isEmpty())
+			{
+				firstError = exception.what();
+			}
+			aborted = true;
+		}
+	};
+
+	const auto start = std::chrono::steady_clock::now();
+	{
+		// Workers take the GIL for script calls, so this thread can't keep it while waiting on them.
+		py::gil_scoped_release releaseForWorkers;
+		std::vector<std::thread> workers;
+		for (int64 workerIndex = 0; workerIndex < threadCount; workerIndex++)
+		{
+			workers.emplace_back(verifyChunks);
+		}
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (aborted)
+	{
+		TBLog::Error("Exception thrown while verifying calendar system: %0  Verification failed!", firstError);
+		return true;
+	}
+
+	/*
+		Results
+	*/
+	bool allPassed = true;
+	for (TBVerifiedInvariant* invariant : { &roundTrip, &ordering, &moveZero, &moveDay, &fastPath })
+	{
+		if (invariant->Checked == 0)
+		{
+			continue;
+		}
+		if (invariant->Failed == 0)
+		{
+			TBLog::Log("Passed: %0 (%1 checks)", invariant->Description, invariant->Checked.load());
+			continue;
+		}
+
+		allPassed = false;
+		TBLog::Warning("Failed: %0 (%1 of %2 checks).  Earliest counterexamples:", invariant->Description, invariant->Failed.load(),
+			invariant->Checked.load());
+		for (const auto& [day, details] : invariant->Counterexamples)
+		{
+			TBLog::Warning("    %0", details);
+		}
+	}
+
+	TBLog::Log("Calendar system verification %0 in %1 seconds.", allPassed ? "passed" : "failed", seconds);
+
+	return true;
+}
+
+bool TBTestSuite::CalendarCacheTest()
+{
+	if (!Parser.isSet(CacheTestParam))
+	{
+		return false;
+	}
+
+	TBLog::Log("Beginning calendar result cache test.");
+
+	uint32 testIndex = 1;
+	bool allPassed = true;
+	auto check = [&](bool passed, const QString& description)
+	{
+		if (passed)
+		{
+			TBLog::Log("Test %0: Passed: %1", testIndex++, description);
+		}
+		else
+		{
+			TBLog::Warning("Test %0: Failed: %1", testIndex++, description);
+			allPassed = false;
+		}
+	};
+	auto statsAre = [](const TBShardedCache<TBDayCacheKey, QVariant>& cache, uint64 hits, uint64 misses)
+	{
+		const TBCacheStats stats = cache.GetStats();
+		return stats.Hits == hits && stats.Misses == misses;
+	};
+
+	TBShardedCache<TBDayCacheKey, QVariant> cache;
+	const TBDayCacheKey formatKey = { TBCachedCalendarCall::FormatDate, 42 };
+	const TBDayCacheKey breakKey = { TBCachedCalendarCall::BreakDate, 42 };
+	QVariant value;
+
+	check(!cache.IsEnabled() && !cache.Find(formatKey, value), "a cache that was never reset is disabled");
+
+	cache.Reset(64, 4);
+	check(cache.IsEnabled() && !cache.Find(formatKey, value) && statsAre(cache, 0, 1), "an empty cache misses");
+	cache.Insert(formatKey, QString("formatted"));
+	check(cache.Find(formatKey, value) && value.toString() == "formatted" && statsAre(cache, 1, 1), "an inserted entry hits");
+	check(!cache.Find(breakKey, value) && statsAre(cache, 1, 2), "the same day from another call misses");
+
+	cache.Reset(64, 4);
+	check(!cache.Find(formatKey, value) && statsAre(cache, 0, 1), "resetting drops entries and counters");
+
+	// One shard, so that least-recently-used is over the whole cache.
+	cache.Reset(4, 1);
+	for (int64 day = 0; day < 5; day++)
+	{
+		cache.Insert({ TBCachedCalendarCall::FormatDate, day }, day);
+	}
+	check(!cache.Find({ TBCachedCalendarCall::FormatDate, 0 }, value) && cache.Find({ TBCachedCalendarCall::FormatDate, 4 }, value),
+		"a full cache evicts its least recently used entry");
+
+	cache.Reset(0, 0);
+	cache.Insert(formatKey, QString("formatted"));
+	check(!cache.IsEnabled() && !cache.Find(formatKey, value), "a cache reset to no capacity stays empty");
+
+	// Lookups on other threads have to survive the shards being replaced under them.
+	std::atomic<bool> stopping = false;
+	std::atomic<uint64> foundWrongValue = 0;
+	std::vector<std::thread> readers;
+	for (int32 readerIndex = 0; readerIndex < 4; readerIndex++)
+	{
+		readers.emplace_back([&cache, &stopping, &foundWrongValue, readerIndex]()
+		{
+			QVariant readValue;
+			for (int64 day = readerIndex; !stopping; day = (day + 1) % 1024)
+			{
+				const TBDayCacheKey key = { TBCachedCalendarCall::BreakDate, day };
+				if (cache.Find(key, readValue))
+				{
+					foundWrongValue += readValue.toLongLong() != day;
+				}
+				else
+				{
+					cache.Insert(key, day);
+				}
+			}
+		});
+	}
+	for (int32 resetIndex = 0; resetIndex < 1000; resetIndex++)
+	{
+		cache.Reset(resetIndex % 2 == 0 ? 256 : 0, 4);
+	}
+	stopping = true;
+	for (std::thread& reader : readers)
+	{
+		reader.join();
+	}
+	check(foundWrongValue == 0, "resetting while other threads use the cache");
+
+	TBLog::Log("Calendar result cache test %0.", allPassed ? "passed" : "failed");
+
+	return true;
+}
+
+// Random version 4 UUIDs, like the ones events and eras get.
+static std::vector<QUuid> RandomUuids(size_t count, std::mt19937_64& random)
+{
+	std::vector<QUuid> uuids;
+	uuids.reserve(count);
+	for (size_t index = 0; index < count; index++)
+	{
+		const uint64 high = random();
+		const uint64 low = random();
+		uuids.emplace_back(static_cast<uint>(high >> 32), static_cast<ushort>(high >> 16), static_cast<ushort>((high & 0x0FFF) | 0x4000),
+			static_cast<uchar>(((low >> 56) & 0x3F) | 0x80), static_cast<uchar>(low >> 48), static_cast<uchar>(low >> 40),
+			static_cast<uchar>(low >> 32), static_cast<uchar>(low >> 24), static_cast<uchar>(low >> 16), static_cast<uchar>(low >> 8),
+			static_cast<uchar>(low));
+	}
+	return uuids;
+}
+
+// Fills a map with keys, then times looking up every key in lookupOrder, looking up keys that aren't there, and
+// iterating.  Returns the map's entry for the results file.
+template<typename MapType>
+static QJsonObject BenchmarkUuidMap(const QString& mapName, const std::vector<QUuid>& keys, const std::vector<QUuid>& lookupOrder,
+	const std::vector<QUuid>& missingKeys)
+{
+	using Clock = std::chrono::steady_clock;
+	auto nanosecondsPer = [](Clock::time_point start, size_t count)
+	{
+		return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / count;
+	};
+
+	// Keeps results alive so the lookups can't be optimized away.
+	volatile int64 sink = 0;
+	QJsonObject result;
+	{
+		[[maybe_unused]] const int64 liveBytesBefore = TBAllocationCounter::GetThreadLiveBytes();
+		const Clock::time_point insertStart = Clock::now();
+		MapType map;
+		// Loading a timeline reserves first too.
+		if constexpr (requires { map.reserve(qsizetype()); })
+		{
+			map.reserve(static_cast<qsizetype>(keys.size()));
+		}
+		for (size_t index = 0; index < keys.size(); index++)
+		{
+			map.insert(keys[index], static_cast<int64>(index));
+		}
+		const double insertNs = nanosecondsPer(insertStart, keys.size());
+		// TBUuidMap reports what its arrays hold.  Qt's maps can only be measured by counting what they allocate, which
+		// only builds with allocation counting can do.
+		int64 bytes = -1;
+		if constexpr (requires { map.GetMemoryUsage(); })
+		{
+			bytes = static_cast<int64>(map.GetMemoryUsage());
+		}
+		else if constexpr (TBAllocationCounter::IsEnabled())
+		{
+			bytes = TBAllocationCounter::GetThreadLiveBytes() - liveBytesBefore;
+		}
+
+		const Clock::time_point lookupStart = Clock::now();
+		int64 lookupSum = 0;
+		for (const QUuid& key : lookupOrder)
+		{
+			auto found = map.constFind(key);
+			lookupSum += found != map.constEnd() ? found.value() : 0;
+		}
+		const double lookupNs = nanosecondsPer(lookupStart, lookupOrder.size());
+		sink = sink + lookupSum;
+
+		const Clock::time_point missStart = Clock::now();
+		int64 missCount = 0;
+		for (const QUuid& key : missingKeys)
+		{
+			missCount += map.contains(key) ? 0 : 1;
+		}
+		const double missNs = nanosecondsPer(missStart, missingKeys.size());
+		sink = sink + missCount;
+
+		const Clock::time_point iterateStart = Clock::now();
+		int64 valueSum = 0;
+		for (const int64 value : std::as_const(map))
+		{
+			valueSum += value;
+		}
+		const double iterateNs = nanosecondsPer(iterateStart, keys.size());
+		sink = sink + valueSum;
+
+		TBLog::Log("%0, %1 entries: insert %2 ns, lookup %3 ns, missing lookup %4 ns, iterate %5 ns, %6 bytes/entry", mapName,
+			static_cast<int64>(keys.size()), insertNs, lookupNs, missNs, iterateNs,
+			bytes >= 0 ? QString::number(static_cast<double>(bytes) / keys.size()) : QString("unmeasured"));
+
+		result.insert("insert_ns", insertNs);
+		result.insert("lookup_ns", lookupNs);
+		result.insert("missing_lookup_ns", missNs);
+		result.insert("iterate_ns", iterateNs);
+		if (bytes >= 0)
+		{
+			result.insert("bytes", static_cast<qint64>(bytes));
+			result.insert("bytes_per_entry", static_cast<double>(bytes) / keys.size());
+		}
+	}
+	return result;
+}
+
+bool TBTestSuite::MapBenchmark()
+{
+	if (!Parser.isSet(MapBenchParam))
+	{
+		return false;
+	}
+
+	std::vector<int64> sizes(std::begin(MAP_BENCH_DEFAULT_SIZES), std::end(MAP_BENCH_DEFAULT_SIZES));
+	if (Parser.isSet(MapBenchSizesParam))
+	{
+		sizes.clear();
+		for (const QString& sizeText : Parser.value(MapBenchSizesParam).split(',', Qt::SkipEmptyParts))
+		{
+			bool validSize = false;
+			const int64 size = sizeText.trimmed().toLongLong(&validSize);
+			if (!validSize || size <= 0)
+			{
+				TBLog::Error("Invalid map benchmark size (%0).  Benchmark aborted.", sizeText);
+				return true;
+			}
+			sizes.push_back(size);
+		}
+	}
+
+	const QString outputPath = Parser.isSet(MapBenchOutputParam) ? Parser.value(MapBenchOutputParam) : QString("map-bench.json");
+
+	/*
+		Values are just int64s, so the numbers are the maps' own costs.  Memory is what each map has allocated once
+		it's full.  TBUuidMap reports that itself.  QMap and QHash allocate through operator new from templates compiled
+		into this program, so their memory is only measured in the Benchmark configuration.
+	*/
+	TBLog::Log("Beginning map benchmark.");
+	QJsonArray sizeResults;
+	try
+	{
+		for (const int64 size : sizes)
+		{
+			std::mt19937_64 random(BENCH_SEED);
+			const std::vector<QUuid> keys = RandomUuids(static_cast<size_t>(size), random);
+			const std::vector<QUuid> missingKeys = RandomUuids(static_cast<size_t>(size), random);
+			std::vector<QUuid> lookupOrder = keys;
+			std::shuffle(lookupOrder.begin(), lookupOrder.end(), random);
+
+			QJsonObject mapResults;
+			mapResults.insert("QMap", BenchmarkUuidMap<QMap<QUuid, int64>>("QMap", keys, lookupOrder, missingKeys));
+			mapResults.insert("QHash", BenchmarkUuidMap<QHash<QUuid, int64>>("QHash", keys, lookupOrder, missingKeys));
+			mapResults.insert("TBUuidMap", BenchmarkUuidMap<TBUuidMap<int64>>("TBUuidMap", keys, lookupOrder, missingKeys));
+
+			QJsonObject sizeResult;
+			sizeResult.insert("entries", size);
+			sizeResult.insert("maps", mapResults);
+			sizeResults.append(sizeResult);
+		}
+	}
+	catch (const std::exception& exception)
+	{
+		TBLog::Error("Exception thrown while benchmarking maps: %0  Benchmark aborted.", exception.what());
+		return true;
+	}
+
+	QJsonObject results;
+	results.insert("version", QString("%0.%1.%2").arg(MAJOR_VERSION).arg(MINOR_VERSION).arg(PATCH_VERSION));
+	results.insert("seed", static_cast<qint64>(BENCH_SEED));
+	results.insert("sizes", sizeResults);
+
+	QFile outputFile(outputPath);
+	if (!outputFile.open(QIODeviceBase::WriteOnly | QIODeviceBase::Truncate | QIODeviceBase::Text)
+		|| outputFile.write(QJsonDocument(results).toJson(QJsonDocument::Indented)) < 0)
+	{
+		TBLog::Error("Could not write map benchmark results to %0.", outputPath);
+		return true;
+	}
+
+	TBLog::Log("Map benchmark complete.  Results written to %0.", outputPath);
+
 	return true;
 }
\ No newline at end of file
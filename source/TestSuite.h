@@ -38,4 +38,31 @@ private:
 	// Calendar System
 	QCommandLineOption CalendarParam;
 	bool CalendarSystemTest();
+
+	// Calendar Benchmark
+	QCommandLineOption CalendarBenchParam;
+	QCommandLineOption CalendarBenchCallsParam;
+	QCommandLineOption CalendarBenchOutputParam;
+	QCommandLineOption CalendarBenchScriptOnlyParam;
+	bool CalendarBenchmark();
+
+	// Calendar Verifier
+	QCommandLineOption CalendarVerifyParam;
+	QCommandLineOption CalendarVerifyMinYearParam;
+	QCommandLineOption CalendarVerifyMaxYearParam;
+	QCommandLineOption CalendarVerifyThreadsParam;
+	bool CalendarVerifier();
+
+	// Calendar Cache
+	QCommandLineOption CacheTestParam;
+	bool CalendarCacheTest();
+
+	// Map Benchmark
+	QCommandLineOption MapBenchParam;
+	QCommandLineOption MapBenchSizesParam;
+	QCommandLineOption MapBenchOutputParam;
+	bool MapBenchmark();
+
+	// Loads scripts/<systemName>.json and initializes its script, logging why if that fails.
+	bool LoadCalendarSystem(const QString& systemName, class TBCalendarSystem& outCalendarSystem);
 };
\ No newline at end of file
@@ -0,0 +1,276 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (TickGenerator.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PyBind.h"		// This has to come first to not conflict with Qt defines.
+#include "TickGenerator.h"
+#include "Calendar.h"
+
+#include <algorithm>
+#include <exception>
+
+// A unit's cache starts over once it holds this many boundaries, so that panning for a long time doesn't grow it forever.
+static constexpr size_t MAX_CACHED_BOUNDARIES = 1 << 16;
+// How far to look for the next boundary while learning a unit's length.
+static constexpr int64 MAX_UNIT_DAYS = 1 << 24;
+
+static bool SamePrefix(const int64* first, const int64* second, int32 component)
+{
+	return std::equal(first, first + component + 1, second);
+}
+
+TBTickGenerator::TBTickGenerator() :
+	CacheMutex(),
+	Caches()
+{}
+
+void TBTickGenerator::GetBoundaries(const TBCalendarSystem& calendar, TBDate startDate, TBDate endDate, TBTickUnit unit,
+	std::vector<TBDate>& outBoundaries)
+{
+	outBoundaries.clear();
+	const int64 startDay = startDate.GetDays();
+	const int64 endDay = endDate.GetDays();
+	if (startDay >= endDay || unit.Component < 0 || unit.Component >= calendar.GetBrokenDateLength() || unit.Step < 1)
+	{
+		return;
+	}
+
+	std::unique_lock lock = LockCache();
+
+	// Only the parts of the range that aren't covered yet are computed.  Each part goes into its own list first, so
+	// that a script failure doesn't leave the cache with a gap in it.
+	UnitCache& cache = Caches[unit];
+	const bool touchesCovered = cache.CoveredStart < cache.CoveredEnd && startDay <= cache.CoveredEnd && endDay >= cache.CoveredStart;
+	if (!touchesCovered || cache.Boundaries.size() > MAX_CACHED_BOUNDARIES)
+	{
+		std::vector<TBDate> boundaries;
+		ComputeBoundaries(calendar, startDay, endDay, unit, cache, boundaries);
+		cache.Boundaries = std::move(boundaries);
+		cache.CoveredStart = startDay;
+		cache.CoveredEnd = endDay;
+	}
+	else
+	{
+		if (startDay < cache.CoveredStart)
+		{
+			std::vector<TBDate> boundaries;
+			ComputeBoundaries(calendar, startDay, cache.CoveredStart, unit, cache, boundaries);
+			cache.Boundaries.insert(cache.Boundaries.begin(), boundaries.begin(), boundaries.end());
+			cache.CoveredStart = startDay;
+		}
+		if (endDay > cache.CoveredEnd)
+		{
+			std::vector<TBDate> boundaries;
+			ComputeBoundaries(calendar, cache.CoveredEnd, endDay, unit, cache, boundaries);
+			cache.Boundaries.insert(cache.Boundaries.end(), boundaries.begin(), boundaries.end());
+			cache.CoveredEnd = endDay;
+		}
+	}
+
+	outBoundaries.assign(std::lower_bound(cache.Boundaries.begin(), cache.Boundaries.end(), startDate),
+		std::lower_bound(cache.Boundaries.begin(), cache.Boundaries.end(), endDate));
+}
+
+void TBTickGenerator::Clear()
+{
+	// The calendar clears its caches with the GIL held, so this has to give it up like GetBoundaries() does.
+	std::unique_lock lock = LockCache();
+	Caches.clear();
+}
+
+std::unique_lock<std::mutex> TBTickGenerator::LockCache()
+{
+	// Whoever holds the lock may be waiting on the GIL to reach the script, so don't hold onto it while waiting.
+	std::unique_lock lock(CacheMutex, std::try_to_lock);
+	if (!lock.owns_lock())
+	{
+		TBScopedGilRelease releaseGil;
+		lock.lock();
+	}
+	return lock;
+}
+
+void TBTickGenerator::ComputeBoundaries(const TBCalendarSystem& calendar, int64 startDay, int64 endDay, TBTickUnit unit, UnitCache& cache,
+	std::vector<TBDate>& outBoundaries)
+{
+	if (startDay >= endDay)
+	{
+		return;
+	}
+	if (cache.SampleStride == 0)
+	{
+		LearnUnit(calendar, startDay - 1, endDay - startDay, unit.Component, cache);
+	}
+
+	// The day before the range is sampled too, so that a boundary right on startDay shows up.
+	const int32 dateLength = calendar.GetBrokenDateLength();
+	std::vector<TBDate> samples;
+	for (int64 day = startDay - 1; day < endDay - 1; day += cache.SampleStride)
+	{
+		samples.push_back(day);
+	}
+	samples.push_back(endDay - 1);
+
+	std::vector<int64> sampleDates;
+	calendar.BreakDates(samples, sampleDates);
+	auto sampleAt = [&](size_t sampleIndex) { return sampleDates.data() + sampleIndex * dateLength; };
+
+	// A unit starts somewhere after each sample that's in a different unit from the one before.  Its first day is
+	// most likely the new unit's leading components followed by the usual first values.
+	std::vector<size_t> changes;
+	std::vector<int64> candidates;
+	for (size_t sampleIndex = 1; sampleIndex < samples.size(); sampleIndex++)
+	{
+		if (!SamePrefix(sampleAt(sampleIndex - 1), sampleAt(sampleIndex), unit.Component))
+		{
+			changes.push_back(sampleIndex);
+			candidates.insert(candidates.end(), sampleAt(sampleIndex), sampleAt(sampleIndex) + unit.Component + 1);
+			candidates.insert(candidates.end(), cache.FirstValues.begin(), cache.FirstValues.end());
+		}
+	}
+	if (changes.empty())
+	{
+		return;
+	}
+
+	// A candidate is only right if it's between its two samples and the day before it is in the earlier sample's unit.
+	// Otherwise some unit was too short to get a sample of its own, and the boundaries are bisected one at a time.
+	std::vector<TBDate> candidateDays;
+	std::vector<int64> previousDates;
+	bool candidatesChecked = true;
+	try
+	{
+		calendar.CombineDates(candidates, candidateDays);
+		std::vector<TBDate> previousDays(candidateDays.size());
+		std::transform(candidateDays.begin(), candidateDays.end(), previousDays.begin(), [](TBDate day) { return TBDate(day.GetDays() - 1); });
+		calendar.BreakDates(previousDays, previousDates);
+	}
+	catch (const std::exception&)
+	{
+		// Some unit doesn't start on the usual first values.  Every boundary gets found the slow way below.
+		candidatesChecked = false;
+	}
+
+	for (size_t changeIndex = 0; changeIndex < changes.size(); changeIndex++)
+	{
+		const size_t sampleIndex = changes[changeIndex];
+		const int64 lowDay = samples[sampleIndex - 1].GetDays();
+		const int64 highDay = samples[sampleIndex].GetDays();
+
+		const bool candidateHolds = candidatesChecked
+			&& candidateDays[changeIndex].GetDays() > lowDay && candidateDays[changeIndex].GetDays() <= highDay
+			&& SamePrefix(previousDates.data() + changeIndex * dateLength, sampleAt(sampleIndex - 1), unit.Component);
+		if (candidateHolds)
+		{
+			if (FloorMod(sampleAt(sampleIndex)[unit.Component], unit.Step) == 0)
+			{
+				outBoundaries.push_back(candidateDays[changeIndex]);
+			}
+		}
+		else
+		{
+			BisectBoundaries(calendar, lowDay, highDay, unit, outBoundaries);
+		}
+	}
+}
+
+void TBTickGenerator::LearnUnit(const TBCalendarSystem& calendar, int64 fromDay, int64 rangeDays, int32 component, UnitCache& cache)
+{
+	// Samples are half a unit apart, so usually only one unit starts between two of them.  Shorter units are still
+	// found, just by bisecting.
+	int64 firstBoundary = 0;
+	int64 secondBoundary = 0;
+	if (FindNextBoundary(calendar, fromDay, MAX_UNIT_DAYS, component, firstBoundary)
+		&& FindNextBoundary(calendar, firstBoundary, MAX_UNIT_DAYS, component, secondBoundary))
+	{
+		cache.SampleStride = std::max<int64>(1, (secondBoundary - firstBoundary) / 2);
+		TBBrokenDate firstDate;
+		calendar.BreakDate(firstBoundary, firstDate);
+		cache.FirstValues.assign(firstDate.begin() + component + 1, firstDate.end());
+	}
+	else
+	{
+		// Units are longer than anyone will look at, so sampling the ends of the range will do.
+		cache.SampleStride = std::max<int64>(1, rangeDays);
+		cache.FirstValues.assign(calendar.GetBrokenDateLength() - component - 1, 0);
+	}
+}
+
+bool TBTickGenerator::FindNextBoundary(const TBCalendarSystem& calendar, int64 fromDay, int64 maxDays, int32 component, int64& outBoundary)
+{
+	TBBrokenDate fromDate;
+	TBBrokenDate probeDate;
+	calendar.BreakDate(fromDay, fromDate);
+
+	int64 lowDay = fromDay;
+	for (int64 step = 1; step <= maxDays; step *= 2)
+	{
+		const int64 probeDay = fromDay + step;
+		calendar.BreakDate(probeDay, probeDate);
+		if (fromDate.length() != probeDate.length() || !SamePrefix(fromDate.constData(), probeDate.constData(), component))
+		{
+			outBoundary = BisectBoundary(calendar, lowDay, probeDay, component);
+			return true;
+		}
+		lowDay = probeDay;
+	}
+
+	return false;
+}
+
+void TBTickGenerator::BisectBoundaries(const TBCalendarSystem& calendar, int64 lowDay, int64 highDay, TBTickUnit unit,
+	std::vector<TBDate>& outBoundaries)
+{
+	TBBrokenDate highDate;
+	TBBrokenDate boundaryDate;
+	calendar.BreakDate(highDay, highDate);
+	while (true)
+	{
+		const int64 boundary = BisectBoundary(calendar, lowDay, highDay, unit.Component);
+		calendar.BreakDate(boundary, boundaryDate);
+		if (FloorMod(boundaryDate[unit.Component], unit.Step) == 0)
+		{
+			outBoundaries.push_back(boundary);
+		}
+		if (boundaryDate.length() == highDate.length() && SamePrefix(boundaryDate.constData(), highDate.constData(), unit.Component))
+		{
+			return;
+		}
+		lowDay = boundary;
+	}
+}
+
+int64 TBTickGenerator::BisectBoundary(const TBCalendarSystem& calendar, int64 lowDay, int64 highDay, int32 component)
+{
+	// Units are contiguous, so the days in lowDay's unit come before all the others.
+	TBBrokenDate lowDate;
+	TBBrokenDate middleDate;
+	calendar.BreakDate(lowDay, lowDate);
+	while (highDay - lowDay > 1)
+	{
+		const int64 middleDay = lowDay + (highDay - lowDay) / 2;
+		calendar.BreakDate(middleDay, middleDate);
+		if (middleDate.length() == lowDate.length() && SamePrefix(lowDate.constData(), middleDate.constData(), component))
+		{
+			lowDay = middleDay;
+		}
+		else
+		{
+			highDay = middleDay;
+		}
+	}
+	return highDay;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (TickGenerator.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+#include "Time.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QHashFunctions>
+
+#include <mutex>
+#include <vector>
+
+class TBCalendarSystem;
+
+/*
+	Which boundaries to find: the days where broken date component Component (or one before it) changes, keeping only
+	those where that component's new value is a multiple of Step.  In a year/month/day calendar, component 0 is years,
+	component 0 with a step of 10 is decades, and component 1 is months.
+*/
+struct TBTickUnit
+{
+	int32 Component = 0;
+	int64 Step = 1;
+
+	bool operator==(const TBTickUnit& other) const = default;
+};
+
+inline size_t qHash(const TBTickUnit& unit, size_t seed = 0)
+{
+	return qHashMulti(seed, unit.Component, unit.Step);
+}
+
+/*
+	Finds unit boundaries over a range of days with a couple of batch calls, instead of a CombineDate per tick.  The
+	range is sampled at under a unit's length, so each unit that starts in it shows up as a change between two
+	samples, and then the first day of each new unit is combined in one batch and checked.  Where a unit is too short
+	to have been sampled (a one-day festival month, say), the days between the two samples are bisected instead.
+
+	Each unit keeps the range it last covered, so moving the range (panning, at one zoom level) only computes the days
+	that weren't covered already.
+*/
+class TBTickGenerator
+{
+public:
+	TBTickGenerator();
+
+	// Replaces outBoundaries with the boundaries in [startDate, endDate), in order.  Throws if the script fails.
+	void GetBoundaries(const TBCalendarSystem& calendar, TBDate startDate, TBDate endDate, TBTickUnit unit, std::vector<TBDate>& outBoundaries);
+	void Clear();
+
+private:
+	struct UnitCache
+	{
+		int64 CoveredStart = 0;
+		int64 CoveredEnd = 0;
+		// Every boundary in [CoveredStart, CoveredEnd), in order.
+		std::vector<TBDate> Boundaries;
+		// Learned from the first range asked for: the distance between samples, and the components after Component on
+		// the first day of a unit.
+		int64 SampleStride = 0;
+		std::vector<int64> FirstValues;
+	};
+
+	// Locks CacheMutex, giving up the GIL while waiting for it.
+	std::unique_lock<std::mutex> LockCache();
+	// Finds every boundary in [startDay, endDay) and appends them to outBoundaries.
+	static void ComputeBoundaries(const TBCalendarSystem& calendar, int64 startDay, int64 endDay, TBTickUnit unit, UnitCache& cache,
+		std::vector<TBDate>& outBoundaries);
+	// Fills in the cache's stride and first values from the two units after fromDay.
+	static void LearnUnit(const TBCalendarSystem& calendar, int64 fromDay, int64 rangeDays, int32 component, UnitCache& cache);
+	// First day after fromDay where components 0 through component change.  Returns false if none turned up within maxDays.
+	static bool FindNextBoundary(const TBCalendarSystem& calendar, int64 fromDay, int64 maxDays, int32 component, int64& outBoundary);
+	// Appends every boundary in (lowDay, highDay], given that the two days are in different units.
+	static void BisectBoundaries(const TBCalendarSystem& calendar, int64 lowDay, int64 highDay, TBTickUnit unit,
+		std::vector<TBDate>& outBoundaries);
+	// First day in (lowDay, highDay] whose components 0 through component differ from lowDay's.
+	static int64 BisectBoundary(const TBCalendarSystem& calendar, int64 lowDay, int64 highDay, int32 component);
+
+	std::mutex CacheMutex;
+	QHash<TBTickUnit, UnitCache> Caches;
+};
\ No newline at end of file
@@ -16,6 +16,7 @@
 */
 
 #include "Time.h"
+#include "Calendar.h"
 
 // Just so I don't have to write a whole bunch of operator implementations twice.
 #define IMPLEMENT_ONE_COMPARISON(type, operatorName, operatorSymbol, comparedValue) \
@@ -58,4 +59,25 @@ TBTimespan::TBTimespan(int64 inDays) : Days(inDays)
 
 }
 
-IMPLEMENT_ALL_COMPARISONS(TBTimespan, Days)
\ No newline at end of file
+IMPLEMENT_ALL_COMPARISONS(TBTimespan, Days)
+
+TBResolvedDays ResolvePeriodDays(TBPeriodBounds bounds, bool hasEndDate, std::optional<TBDate> startDay, std::optional<TBDate> endDay)
+{
+	const bool needsEnd = BoundsNeedEnd(bounds) || (!EnumValueIsValid(bounds) && hasEndDate);
+
+	TBResolvedDays resolvedDays;
+	resolvedDays.Resolved = (startDay.has_value() || !BoundsNeedStart(bounds)) && (endDay.has_value() || !needsEnd);
+	resolvedDays.StartDay = startDay.value_or(endDay.value_or(TBDate()));
+	resolvedDays.EndDay = endDay.value_or(resolvedDays.StartDay);
+	return resolvedDays;
+}
+
+std::optional<TBDate> CombinePeriodDate(const TBCalendarSystem& calendar, const TBBrokenDate& date)
+{
+	if (date.isEmpty())
+	{
+		return std::nullopt;
+	}
+	TBScriptResult<TBDate> day = calendar.TryCombineDate(date);
+	return day ? std::optional<TBDate>(*day) : std::nullopt;
+}
\ No newline at end of file
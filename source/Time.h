@@ -18,15 +18,23 @@
 #pragma once
 
 #include "CommonTypes.h"
+#include "InlineList.h"
 
-#include <QtCore/QList>
+#include <limits>
+#include <optional>
+
+class TBCalendarSystem;
 
 // Aliases so that A) this doesn't have to be done a bunch of places, and B) people don't have to remember
-// that TBBrokenDate is a QList<int64> all the time.
+// that TBBrokenDate is a TBInlineList<int64> all the time.
 // Please remember to include "JsonableObject.h" when using these.
 #define JsonArrayToBrokenDate JsonArrayToInt64List
 #define BrokenDateToJsonArray(parentObject, key, inDate) ListToJsonArray(parentObject, key, inDate)
 
+// Broken dates and timespans are stored inline, so they can't have more components than this.
+// Calendar scripts that report a longer broken date length are rejected.
+const int32 MAX_BROKEN_DATE_LENGTH = 8;
+
 // Just so I don't have to type a whole bunch of operator declarations twice.
 #define DECLARE_ONE_COMPARISON(type, operatorName) bool operatorName(const type& other) const;
 #define DECLARE_ALL_COMPARISONS(type) \
@@ -74,12 +82,28 @@ public:
 /*
 	Date as broken out into individual int components; values are in descending order (for example, year then month then day)
 */
-typedef QList<int64> TBBrokenDate;
+typedef TBInlineList<int64, MAX_BROKEN_DATE_LENGTH> TBBrokenDate;
 
 /*
 	Timespan as broken out into individual int components; values are in descending order (for example, years then months then days)
 */
-typedef QList<int64> TBBrokenTimespan;
+typedef TBInlineList<int64, MAX_BROKEN_DATE_LENGTH> TBBrokenTimespan;
+
+/*
+	Integer division and modulo that round toward negative infinity, so that day -1 lands at the end of the
+	previous year/month/week instead of at the end of the next one.  Divisors must be positive.
+*/
+inline int64 FloorDiv(int64 numerator, int64 denominator)
+{
+	const int64 quotient = numerator / denominator;
+	return (numerator % denominator < 0) ? quotient - 1 : quotient;
+}
+
+inline int64 FloorMod(int64 numerator, int64 denominator)
+{
+	const int64 remainder = numerator % denominator;
+	return (remainder < 0) ? remainder + denominator : remainder;
+}
 
 // Defines how events/eras durations are bounded
 ENUM_CLASS(TBPeriodBounds, uint8,
@@ -87,4 +111,58 @@ ENUM_CLASS(TBPeriodBounds, uint8,
 	StartOnly,
 	EndOnly,
 	StartAndEnd
-)
\ No newline at end of file
+)
+
+// Which of a period's dates its bounds need.  Periods with invalid bounds (from older files) need their start, and
+// their end if they have one.
+inline bool BoundsNeedStart(TBPeriodBounds bounds)
+{
+	return bounds != TBPeriodBounds::EndOnly;
+}
+
+inline bool BoundsNeedEnd(TBPeriodBounds bounds)
+{
+	return bounds == TBPeriodBounds::EndOnly || bounds == TBPeriodBounds::StartAndEnd;
+}
+
+/*
+	The days a period is active, both ends included.  Ends its bounds leave open run to the limits of int64, and
+	NoDuration periods are only active on their start day.
+*/
+struct TBActiveDays
+{
+	int64 First;
+	int64 Last;
+};
+
+inline TBActiveDays GetActiveDays(TBPeriodBounds bounds, TBDate startDay, TBDate endDay)
+{
+	switch (bounds)
+	{
+	case TBPeriodBounds::NoDuration:
+		return { startDay.GetDays(), startDay.GetDays() };
+	case TBPeriodBounds::StartOnly:
+		return { startDay.GetDays(), std::numeric_limits<int64>::max() };
+	case TBPeriodBounds::EndOnly:
+		return { std::numeric_limits<int64>::min(), endDay.GetDays() };
+	default:
+		return { startDay.GetDays(), endDay.GetDays() };
+	}
+}
+
+/*
+	A period's day numbers, worked out from its dates.  Resolved is false unless every date its bounds need combined.
+	A date that's missing takes the other one's day, so that unresolved periods still have somewhere to be.
+*/
+struct TBResolvedDays
+{
+	TBDate StartDay;
+	TBDate EndDay;
+	bool Resolved = false;
+};
+
+// Shared by events and eras.  startDay and endDay are null for dates that didn't combine, and hasEndDate is whether
+// the period has an end date at all, which periods with invalid bounds only need if they do.
+TBResolvedDays ResolvePeriodDays(TBPeriodBounds bounds, bool hasEndDate, std::optional<TBDate> startDay, std::optional<TBDate> endDay);
+// Combines one of a period's dates through calendar.  Null if the date is empty or doesn't combine.
+std::optional<TBDate> CombinePeriodDate(const TBCalendarSystem& calendar, const TBBrokenDate& date);
\ No newline at end of file
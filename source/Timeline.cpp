@@ -20,10 +20,17 @@
 #include "Era.h"
 #include "Event.h"
 #include "Calendar.h"
+#include "CalendarRegistry.h"
+#include "CalendarConverter.h"
+#include "Logging.h"
 
 #include <QtCore/QUuid>
 #include <QtCore/QString>
 
+#include <algorithm>
+#include <exception>
+#include <optional>
+
 #define JsonObjectToEraMap(jsonObject, key, eraMap) \
 JsonObjectToObjectMap<QUuid, TBEra>(jsonObject, key, eraMap, &JsonableObject::StringToUuid)
 
@@ -33,16 +40,23 @@ JsonObjectToObjectMap<QUuid, TBEvent>(jsonObject, key, eventMap, &JsonableObject
 #define EraMapToJsonObject(jsonObject, key, eraMap) \
 ObjectMapToJsonObject<QUuid, TBEra>(jsonObject, key, eraMap, &JsonableObject::UuidToString)
 
-#define EventMapToJsonObject(jsonObject, key, eventMap) \
-ObjectMapToJsonObject<QUuid, TBEvent>(jsonObject, key, eventMap, &JsonableObject::UuidToString)
-
 TBTimeline::TBTimeline() :
 	JsonableObject(),
 	Settings(),
 	PresentDate(0),
 	DefaultCalendarSystem(),
 	Eras(),
-	Events()
+	Events(),
+	ResolvedGeneration(0),
+	EventIndex(),
+	EraIndex(),
+	EventStore(),
+	EventsByHandle(),
+	EventParents(),
+	EventPrerequisiteStarts(),
+	EventPrerequisites(),
+	EraConverterMutex(),
+	EraConverters()
 {
 
 }
@@ -58,6 +72,17 @@ bool TBTimeline::LoadFromJson(const QJsonObject& jsonObject)
 
 	JsonObjectToEraMap(jsonObject, "eras", Eras);
 	JsonObjectToEventMap(jsonObject, "events", Events);
+	AssignEventHandles(jsonObject.value("events").toObject());
+	if (TBCalendarRegistry::IsInitialized())
+	{
+		ResolveDays();
+	}
+
+	{
+		// Era bounds and overrides may have changed.
+		std::scoped_lock lock(EraConverterMutex);
+		EraConverters.clear();
+	}
 
 	return LoadSuccessful;
 }
@@ -70,5 +95,395 @@ void TBTimeline::PopulateJson(QJsonObject& jsonObject) const
 	jsonObject.insert("default_calendar", UuidToJson(DefaultCalendarSystem));
 
 	EraMapToJsonObject(jsonObject, "eras", Eras);
-	EventMapToJsonObject(jsonObject, "events", Events);
+
+	// Events don't keep their links themselves, so they're written out here as IDs.
+	QJsonObject eventsObject;
+	for (TBEventHandle handle = 0; handle < EventsByHandle.size(); ++handle)
+	{
+		const TBEvent& event = *EventsByHandle[handle];
+		QJsonObject eventObject;
+		event.PopulateJson(eventObject);
+		eventObject.insert("parent_id", UuidToJson(GetEventID(EventParents[handle])));
+		QList<QUuid> prerequisiteIDs;
+		for (const TBEventHandle prerequisite : GetPrerequisiteEvents(handle))
+		{
+			prerequisiteIDs.append(GetEventID(prerequisite));
+		}
+		UuidListToJsonArray(eventObject, "prereqs", prerequisiteIDs);
+		eventsObject.insert(UuidToString(event.GetID()), eventObject);
+	}
+	jsonObject.insert("events", eventsObject);
+}
+
+std::shared_ptr<const TBCalendarSystem> TBTimeline::GetCalendarSystem(const QUuid& calendarID) const
+{
+	return TBCalendarRegistry::Get().GetCalendarSystem(calendarID.isNull() ? DefaultCalendarSystem : calendarID);
+}
+
+std::shared_ptr<const TBCalendarConverter> TBTimeline::GetEraConverter(const QUuid& eraID) const
+{
+	{
+		std::scoped_lock lock(EraConverterMutex);
+		// Converters made before either calendar was reloaded are rebuilt, and every other era's stays as it is.
+		auto existingConverter = EraConverters.constFind(eraID);
+		if (existingConverter != EraConverters.constEnd() && existingConverter.value()->IsCurrent())
+		{
+			return existingConverter.value();
+		}
+	}
+
+	auto era = Eras.constFind(eraID);
+	if (era == Eras.constEnd() || era->GetCalendarOverride().isNull())
+	{
+		return nullptr;
+	}
+
+	// The converter is built without the lock held, since loading the calendars and converting the anchors both call
+	// into scripts, which other threads asking for converters shouldn't have to wait on.
+	std::shared_ptr<const TBCalendarSystem> sourceCalendar = GetCalendarSystem();
+	std::shared_ptr<const TBCalendarSystem> targetCalendar = GetCalendarSystem(era->GetCalendarOverride());
+	if (!sourceCalendar || !targetCalendar)
+	{
+		return nullptr;
+	}
+
+	std::shared_ptr<TBCalendarConverter> converter = std::make_shared<TBCalendarConverter>(sourceCalendar, targetCalendar);
+	for (const TBBrokenDate& bound : { era->GetStartDate(), era->GetEndDate() })
+	{
+		if (!bound.isEmpty())
+		{
+			try
+			{
+				converter->AddAnchor(bound);
+			}
+			catch (const std::exception& exception)
+			{
+				// The converter still works without the anchor, it just has to convert that date when asked.
+				TBLog::Warning("Could not anchor a bound of era %0 in its calendar: %1", eraID.toString(), exception.what());
+			}
+		}
+	}
+
+	std::scoped_lock lock(EraConverterMutex);
+	// Another thread may have built one meanwhile, in which case everyone keeps using theirs.
+	auto existingConverter = EraConverters.constFind(eraID);
+	if (existingConverter != EraConverters.constEnd() && existingConverter.value()->IsCurrent())
+	{
+		return existingConverter.value();
+	}
+	EraConverters.insert(eraID, converter);
+	return converter;
+}
+
+// Combines dates in one batch call where it can.  A date the calendar rejects fails the whole batch, so if that happens
+// the batch's dates are combined one at a time instead.  Dates that are empty or don't combine come back null.
+static std::vector<std::optional<TBDate>> CombineDatesForResolve(const TBCalendarSystem& calendar, const std::vector<const TBBrokenDate*>& dates)
+{
+	std::vector<std::optional<TBDate>> days(dates.size());
+	auto combineOne = [&](size_t dateIndex)
+	{
+		days[dateIndex] = CombinePeriodDate(calendar, *dates[dateIndex]);
+	};
+
+	// Partial dates can't go in a batch.
+	const int32 dateLength = calendar.GetBrokenDateLength();
+	std::vector<size_t> batchIndices;
+	std::vector<int64> flatDates;
+	for (size_t dateIndex = 0; dateIndex < dates.size(); dateIndex++)
+	{
+		const TBBrokenDate& date = *dates[dateIndex];
+		if (date.isEmpty())
+		{
+			continue;
+		}
+		else if (date.length() == dateLength)
+		{
+			batchIndices.push_back(dateIndex);
+			flatDates.insert(flatDates.end(), date.begin(), date.end());
+		}
+		else
+		{
+			combineOne(dateIndex);
+		}
+	}
+
+	std::vector<TBDate> batchDays;
+	bool batchCombined = true;
+	try
+	{
+		calendar.CombineDates(flatDates, batchDays);
+	}
+	catch (const std::exception&)
+	{
+		batchCombined = false;
+	}
+
+	for (size_t batchIndex = 0; batchIndex < batchIndices.size(); batchIndex++)
+	{
+		if (batchCombined)
+		{
+			days[batchIndices[batchIndex]] = batchDays[batchIndex];
+		}
+		else
+		{
+			combineOne(batchIndices[batchIndex]);
+		}
+	}
+	return days;
+}
+
+void TBTimeline::AssignEventHandles(const QJsonObject& eventsObject)
+{
+	EventsByHandle.clear();
+	EventsByHandle.reserve(Events.size());
+	for (TBEvent& event : Events)
+	{
+		event.SetHandle(static_cast<TBEventHandle>(EventsByHandle.size()));
+		EventsByHandle.push_back(&event);
+	}
+
+	// The links are read here rather than by the events, which only ever see their own JSON.
+	std::vector<QJsonObject> eventObjects(EventsByHandle.size());
+	for (auto eventValue = eventsObject.constBegin(); eventValue != eventsObject.constEnd(); ++eventValue)
+	{
+		const TBEventHandle handle = GetEventHandle(StringToUuid(eventValue.key()));
+		if (handle != NO_EVENT_HANDLE)
+		{
+			eventObjects[handle] = eventValue.value().toObject();
+		}
+	}
+
+	EventParents.assign(EventsByHandle.size(), NO_EVENT_HANDLE);
+	EventPrerequisiteStarts.clear();
+	EventPrerequisiteStarts.reserve(EventsByHandle.size() + 1);
+	EventPrerequisites.clear();
+	for (TBEventHandle handle = 0; handle < EventsByHandle.size(); ++handle)
+	{
+		const QJsonObject& eventObject = eventObjects[handle];
+		EventParents[handle] = GetEventHandle(JsonToUuid(eventObject, "parent_id"));
+		EventPrerequisiteStarts.push_back(static_cast<uint32>(EventPrerequisites.size()));
+		QList<QUuid> prerequisiteIDs;
+		JsonArrayToUuidList(eventObject, "prereqs", prerequisiteIDs);
+		for (const QUuid& prerequisiteID : prerequisiteIDs)
+		{
+			const TBEventHandle prerequisite = GetEventHandle(prerequisiteID);
+			if (prerequisite != NO_EVENT_HANDLE)
+			{
+				EventPrerequisites.push_back(prerequisite);
+			}
+		}
+	}
+	EventPrerequisiteStarts.push_back(static_cast<uint32>(EventPrerequisites.size()));
+}
+
+TBEventHandle TBTimeline::GetEventHandle(const QUuid& eventID) const
+{
+	if (eventID.isNull())
+	{
+		return NO_EVENT_HANDLE;
+	}
+	auto event = Events.constFind(eventID);
+	return event != Events.constEnd() ? event->GetHandle() : NO_EVENT_HANDLE;
+}
+
+QUuid TBTimeline::GetEventID(TBEventHandle handle) const
+{
+	return handle < EventsByHandle.size() ? EventsByHandle[handle]->GetID() : QUuid();
+}
+
+const TBEvent* TBTimeline::GetEvent(TBEventHandle handle) const
+{
+	return handle < EventsByHandle.size() ? EventsByHandle[handle] : nullptr;
+}
+
+TBEventHandle TBTimeline::GetParentEvent(TBEventHandle handle) const
+{
+	return handle < EventParents.size() ? EventParents[handle] : NO_EVENT_HANDLE;
+}
+
+std::span<const TBEventHandle> TBTimeline::GetPrerequisiteEvents(TBEventHandle handle) const
+{
+	if (handle >= EventsByHandle.size())
+	{
+		return {};
+	}
+	const TBEventHandle* prerequisites = EventPrerequisites.data();
+	return std::span<const TBEventHandle>(prerequisites + EventPrerequisiteStarts[handle], prerequisites + EventPrerequisiteStarts[handle + 1]);
+}
+
+bool TBTimeline::IsAncestorEvent(TBEventHandle ancestor, TBEventHandle event) const
+{
+	// A chain longer than the number of events has looped.
+	TBEventHandle current = GetParentEvent(event);
+	for (size_t step = 0; current != NO_EVENT_HANDLE && step < EventParents.size(); ++step)
+	{
+		if (current == ancestor)
+		{
+			return true;
+		}
+		current = EventParents[current];
+	}
+	return false;
+}
+
+bool TBTimeline::ResolveDays()
+{
+	std::shared_ptr<const TBCalendarSystem> calendar = GetCalendarSystem();
+	if (!calendar)
+	{
+		for (TBEvent& event : Events)
+		{
+			event.SetResolvedDays(std::nullopt, std::nullopt);
+		}
+		for (TBEra& era : Eras)
+		{
+			era.SetResolvedDays(std::nullopt, std::nullopt);
+		}
+		EventIndex.Clear();
+		EraIndex.Clear();
+		RebuildEventStore();
+		ResolvedGeneration = 0;
+		return false;
+	}
+
+	// Start and end of every event, then of every era.  The maps aren't changed in between, so they iterate in the
+	// same order below.
+	std::vector<const TBBrokenDate*> dates;
+	dates.reserve(2 * (Events.size() + Eras.size()));
+	for (const TBEvent& event : Events)
+	{
+		dates.push_back(&event.GetStartDate());
+		dates.push_back(&event.GetEndDate());
+	}
+	for (const TBEra& era : Eras)
+	{
+		dates.push_back(&era.GetStartDate());
+		dates.push_back(&era.GetEndDate());
+	}
+
+	const std::vector<std::optional<TBDate>> days = CombineDatesForResolve(*calendar, dates);
+	size_t dayIndex = 0;
+	EventIndex.Clear();
+	for (TBEvent& event : Events)
+	{
+		event.SetResolvedDays(days[dayIndex], days[dayIndex + 1]);
+		dayIndex += 2;
+		if (event.HasResolvedDays())
+		{
+			EventIndex.Insert(event.GetHandle(), event.GetActiveDays());
+		}
+	}
+	EraIndex.Clear();
+	for (TBEra& era : Eras)
+	{
+		era.SetResolvedDays(days[dayIndex], days[dayIndex + 1]);
+		dayIndex += 2;
+		if (era.HasResolvedDays())
+		{
+			EraIndex.Insert(era.GetID(), era.GetActiveDays());
+		}
+	}
+
+	RebuildEventStore();
+	ResolvedGeneration = calendar->GetScriptGeneration();
+	return true;
+}
+
+void TBTimeline::RebuildEventStore()
+{
+	// Rows are handles, so the store takes the events and their parents in handle order.
+	EventStore.Rebuild(EventsByHandle, EventParents);
+}
+
+void TBTimeline::RefreshResolvedDays()
+{
+	std::shared_ptr<const TBCalendarSystem> calendar = GetCalendarSystem();
+	if (calendar && calendar->GetScriptGeneration() != ResolvedGeneration)
+	{
+		ResolveDays();
+	}
+}
+
+std::vector<TBEventHandle> TBTimeline::FindEventsOverlapping(TBDate firstDay, TBDate lastDay)
+{
+	RefreshResolvedDays();
+	std::vector<TBEventHandle> eventHandles;
+	EventIndex.FindOverlapping(firstDay.GetDays(), lastDay.GetDays(), eventHandles);
+	return eventHandles;
+}
+
+std::vector<QUuid> TBTimeline::FindErasOverlapping(TBDate firstDay, TBDate lastDay)
+{
+	RefreshResolvedDays();
+	std::vector<QUuid> eraIDs;
+	EraIndex.FindOverlapping(firstDay.GetDays(), lastDay.GetDays(), eraIDs);
+	return eraIDs;
+}
+
+const TBEventStore& TBTimeline::GetEventStore()
+{
+	RefreshResolvedDays();
+	return EventStore;
+}
+
+std::vector<const TBEvent*> TBTimeline::GetEventsInStartOrder()
+{
+	RefreshResolvedDays();
+
+	std::vector<const TBEvent*> orderedEvents;
+	orderedEvents.reserve(Events.size());
+	for (const TBEvent& event : Events)
+	{
+		orderedEvents.push_back(&event);
+	}
+	std::sort(orderedEvents.begin(), orderedEvents.end(), [](const TBEvent* first, const TBEvent* second) { return first->StartsBefore(*second); });
+	return orderedEvents;
+}
+
+bool TBTimeline::SetEventDates(const QUuid& eventID, const TBBrokenDate& startDate, const TBBrokenDate& endDate)
+{
+	auto event = Events.find(eventID);
+	std::shared_ptr<const TBCalendarSystem> calendar = GetCalendarSystem();
+	if (event == Events.end() || !calendar)
+	{
+		return false;
+	}
+
+	event->SetDates(startDate, endDate, *calendar);
+	if (event->HasResolvedDays())
+	{
+		EventIndex.Insert(event->GetHandle(), event->GetActiveDays());
+	}
+	else
+	{
+		EventIndex.Remove(event->GetHandle());
+	}
+	EventStore.Update(*event);
+	return true;
+}
+
+bool TBTimeline::SetEraDates(const QUuid& eraID, const TBBrokenDate& startDate, const TBBrokenDate& endDate)
+{
+	auto era = Eras.find(eraID);
+	std::shared_ptr<const TBCalendarSystem> calendar = GetCalendarSystem();
+	if (era == Eras.end() || !calendar)
+	{
+		return false;
+	}
+
+	era->SetDates(startDate, endDate, *calendar);
+	if (era->HasResolvedDays())
+	{
+		EraIndex.Insert(eraID, era->GetActiveDays());
+	}
+	else
+	{
+		EraIndex.Remove(eraID);
+	}
+	{
+		// Its converter's anchors are the old bounds.
+		std::scoped_lock lock(EraConverterMutex);
+		EraConverters.remove(eraID);
+	}
+	return true;
 }
\ No newline at end of file
@@ -20,9 +20,22 @@
 #include "CommonTypes.h"
 #include "Time.h"
 #include "JsonableObject.h"
+#include "IntervalIndex.h"
+#include "EventStore.h"
 
 #include <QtCore/QUuid>
 
+#include <QtCore/QHash>
+
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+class TBCalendarConverter;
+class TBCalendarSystem;
+class TBEvent;
+
 struct TBTimelineSettings
 {
 	int64 MinYear;
@@ -37,11 +50,73 @@ public:
 	virtual bool LoadFromJson(const QJsonObject& jsonObject);
 	virtual void PopulateJson(QJsonObject& jsonObject) const;
 
+	// Looks the calendar up in the calendar registry, which imports its script if nothing has used it yet.  A null ID
+	// (like an era without an override) means the timeline's default calendar.  Returns null if it can't be loaded.
+	std::shared_ptr<const TBCalendarSystem> GetCalendarSystem(const QUuid& calendarID = QUuid()) const;
+
+	// Converts dates from the default calendar into an era's override calendar, with the era's bounds already
+	// anchored.  The converter is made on first request and kept, so the anchors and calendars stay loaded.  Returns
+	// null if the era has no override, or either calendar can't be loaded.  A bound that won't convert is left out of
+	// the anchors.
+	std::shared_ptr<const TBCalendarConverter> GetEraConverter(const QUuid& eraID) const;
+
+	// Works out the day numbers of every event's and era's dates through the default calendar, in as few calls as
+	// possible.  Done on load, and again by RefreshResolvedDays() once the calendar's script has been reloaded.
+	// Returns false if the calendar can't be loaded, which leaves everything unresolved.
+	bool ResolveDays();
+	void RefreshResolvedDays();
+
+	// Handles of the events, or IDs of the eras, active at any point in [firstDay, lastDay], in order of their first
+	// active day.  Found through an index of the resolved day numbers, so unresolved ones never turn up.
+	std::vector<TBEventHandle> FindEventsOverlapping(TBDate firstDay, TBDate lastDay);
+	std::vector<QUuid> FindErasOverlapping(TBDate firstDay, TBDate lastDay);
+
+	// Event handles, and links between events by handle.  Links are only kept by handle, so parent and prerequisite
+	// IDs that aren't events in this timeline are dropped on load.
+	TBEventHandle GetEventHandle(const QUuid& eventID) const;
+	QUuid GetEventID(TBEventHandle handle) const;
+	const TBEvent* GetEvent(TBEventHandle handle) const;
+	TBEventHandle GetParentEvent(TBEventHandle handle) const;
+	std::span<const TBEventHandle> GetPrerequisiteEvents(TBEventHandle handle) const;
+	// Whether ancestor is somewhere up event's chain of parents.  Stops at the first repeat if the parents loop.
+	bool IsAncestorEvent(TBEventHandle ancestor, TBEventHandle event) const;
+
+	// Every event's scanned fields in columns, for filtering large timelines.  Rebuilt along with the day numbers.
+	const TBEventStore& GetEventStore();
+
+	// Every event, ordered by TBEvent::StartsBefore.  Sorts on the resolved day numbers without calling the calendar.
+	std::vector<const TBEvent*> GetEventsInStartOrder();
+
+	// Change dates and resolve the new ones straight away.  Return false, changing nothing, if there's no such event
+	// or era or the default calendar can't be loaded.
+	bool SetEventDates(const QUuid& eventID, const TBBrokenDate& startDate, const TBBrokenDate& endDate);
+	bool SetEraDates(const QUuid& eraID, const TBBrokenDate& startDate, const TBBrokenDate& endDate);
+
 protected:
+	// Numbers the events in map order and links their parents and prerequisites by handle, reading the links from
+	// the same "events" object the events were loaded from.
+	void AssignEventHandles(const QJsonObject& eventsObject);
+	void RebuildEventStore();
+
 	// Member variables
 	TBTimelineSettings Settings;
 	TBDate PresentDate;
 	QUuid DefaultCalendarSystem;
 	TBMap<QUuid, class TBEra> Eras;
 	TBMap<QUuid, class TBEvent> Events;
+	// The default calendar's script generation when the day numbers were resolved, or 0 if they never were.
+	uint64 ResolvedGeneration;
+	// Active days of every resolved event and era.
+	TBIntervalIndex<TBEventHandle> EventIndex;
+	TBIntervalIndex<QUuid> EraIndex;
+	TBEventStore EventStore;
+	// Indexed by handle.  The event pointers are into Events, which only gains or loses events on load.  Each
+	// event's prerequisites are EventPrerequisites[EventPrerequisiteStarts[handle]] up to the next event's start.
+	std::vector<TBEvent*> EventsByHandle;
+	std::vector<TBEventHandle> EventParents;
+	std::vector<uint32> EventPrerequisiteStarts;
+	std::vector<TBEventHandle> EventPrerequisites;
+
+	mutable std::mutex EraConverterMutex;
+	mutable QHash<QUuid, std::shared_ptr<const TBCalendarConverter>> EraConverters;
 };
\ No newline at end of file
@@ -0,0 +1,410 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (UuidMap.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+
+#include <QtCore/QList>
+#include <QtCore/QUuid>
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TB_UUID_MAP_SSE2 1
+#else
+#define TB_UUID_MAP_SSE2 0
+#endif
+
+/*
+	Map from QUuid to ValueType, with the same interface as the parts of QHash the project uses, so that TBMap can be
+	this for UUID keys (see TB_MAP_IS_FLAT in CommonTypes.h).
+
+	Keys and values are kept in two dense arrays, so there's no allocation per entry and iterating is a straight run
+	through the values.  Iteration is in insertion order, and doesn't depend on the hashes or the table size.  Removing
+	an entry moves the last one into its place, so only removals change the order.  Like QHash, adding entries can move
+	the values, so don't keep pointers to them across inserts.
+
+	Lookups go through an open-addressing table of 16-slot groups.  Each slot has a control byte holding 7 bits of its
+	key's hash, and a probe compares all 16 of a group's control bytes at once (with SSE2 where there is one), only
+	comparing whole keys for the slots that match.
+*/
+template<typename ValueType>
+class TBUuidMap
+{
+	template<bool IsConst>
+	class IteratorBase
+	{
+	public:
+		using MapType = std::conditional_t<IsConst, const TBUuidMap, TBUuidMap>;
+		using iterator_category = std::forward_iterator_tag;
+		using difference_type = std::ptrdiff_t;
+		using value_type = ValueType;
+		using pointer = std::conditional_t<IsConst, const ValueType*, ValueType*>;
+		using reference = std::conditional_t<IsConst, const ValueType&, ValueType&>;
+
+		IteratorBase() :
+			Map(nullptr),
+			Index(0)
+		{}
+
+		IteratorBase(MapType* map, size_t index) :
+			Map(map),
+			Index(index)
+		{}
+
+		operator IteratorBase<true>() const requires (!IsConst) { return IteratorBase<true>(Map, Index); }
+
+		const QUuid& key() const { return Map->Keys[Index]; }
+		reference value() const { return Map->Values[Index]; }
+		reference operator*() const { return Map->Values[Index]; }
+		pointer operator->() const { return &Map->Values[Index]; }
+
+		IteratorBase& operator++()
+		{
+			++Index;
+			return *this;
+		}
+
+		IteratorBase operator++(int)
+		{
+			IteratorBase previous = *this;
+			++Index;
+			return previous;
+		}
+
+		bool operator==(const IteratorBase& other) const { return Index == other.Index && Map == other.Map; }
+
+	private:
+		MapType* Map;
+		size_t Index;
+	};
+
+public:
+	using iterator = IteratorBase<false>;
+	using const_iterator = IteratorBase<true>;
+	using Iterator = iterator;
+	using ConstIterator = const_iterator;
+	using key_type = QUuid;
+	using mapped_type = ValueType;
+	using size_type = qsizetype;
+
+	TBUuidMap() :
+		Keys(),
+		Values(),
+		Controls(),
+		SlotEntries(),
+		Tombstones(0)
+	{}
+
+	qsizetype size() const { return static_cast<qsizetype>(Keys.size()); }
+	qsizetype count() const { return size(); }
+	bool isEmpty() const { return Keys.empty(); }
+	bool empty() const { return Keys.empty(); }
+	qsizetype capacity() const { return static_cast<qsizetype>(Controls.size() / GROUP_SIZE * MAX_FULL_PER_GROUP); }
+
+	void reserve(qsizetype entryCount)
+	{
+		const size_t slotCount = SlotCountFor(static_cast<size_t>(entryCount));
+		if (slotCount > Controls.size())
+		{
+			Rehash(slotCount);
+		}
+		Keys.reserve(entryCount);
+		Values.reserve(entryCount);
+	}
+
+	void clear()
+	{
+		Keys.clear();
+		Values.clear();
+		Controls.clear();
+		SlotEntries.clear();
+		Tombstones = 0;
+	}
+
+	bool contains(const QUuid& key) const { return FindSlot(key, HashKey(key)) != NO_SLOT; }
+
+	ValueType value(const QUuid& key) const
+	{
+		const size_t slot = FindSlot(key, HashKey(key));
+		return slot != NO_SLOT ? Values[SlotEntries[slot]] : ValueType();
+	}
+
+	ValueType value(const QUuid& key, const ValueType& defaultValue) const
+	{
+		const size_t slot = FindSlot(key, HashKey(key));
+		return slot != NO_SLOT ? Values[SlotEntries[slot]] : defaultValue;
+	}
+
+	QList<QUuid> keys() const { return QList<QUuid>(Keys.begin(), Keys.end()); }
+	QList<ValueType> values() const { return QList<ValueType>(Values.begin(), Values.end()); }
+
+	iterator insert(const QUuid& key, const ValueType& value) { return emplace(key, value); }
+
+	// Replaces the value if the key is already there, like QHash::emplace().
+	template<typename... ArgTypes>
+	iterator emplace(const QUuid& key, ArgTypes&&... args)
+	{
+		const uint64 hash = HashKey(key);
+		const size_t slot = FindSlot(key, hash);
+		if (slot != NO_SLOT)
+		{
+			const uint32 entry = SlotEntries[slot];
+			Values[entry] = ValueType(std::forward<ArgTypes>(args)...);
+			return iterator(this, entry);
+		}
+		return iterator(this, AddEntry(key, hash, std::forward<ArgTypes>(args)...));
+	}
+
+	ValueType& operator[](const QUuid& key)
+	{
+		const uint64 hash = HashKey(key);
+		const size_t slot = FindSlot(key, hash);
+		return Values[slot != NO_SLOT ? SlotEntries[slot] : AddEntry(key, hash)];
+	}
+
+	const ValueType operator[](const QUuid& key) const { return value(key); }
+
+	bool remove(const QUuid& key)
+	{
+		const size_t slot = FindSlot(key, HashKey(key));
+		if (slot == NO_SLOT)
+		{
+			return false;
+		}
+
+		// A probe only carries on past a group with no empty slots, so if this group has one, nothing can be relying
+		// on this slot being taken.
+		const uint8* group = Controls.data() + slot / GROUP_SIZE * GROUP_SIZE;
+		if (MatchByte(group, EMPTY) != 0)
+		{
+			Controls[slot] = EMPTY;
+		}
+		else
+		{
+			Controls[slot] = DELETED;
+			Tombstones++;
+		}
+
+		const uint32 entry = SlotEntries[slot];
+		const uint32 lastEntry = static_cast<uint32>(Keys.size() - 1);
+		if (entry != lastEntry)
+		{
+			SlotEntries[FindSlot(Keys[lastEntry], HashKey(Keys[lastEntry]))] = entry;
+			Keys[entry] = Keys[lastEntry];
+			Values[entry] = std::move(Values[lastEntry]);
+		}
+		Keys.pop_back();
+		Values.pop_back();
+		return true;
+	}
+
+	iterator find(const QUuid& key) { return iterator(this, FindEntry(key)); }
+	const_iterator find(const QUuid& key) const { return const_iterator(this, FindEntry(key)); }
+	const_iterator constFind(const QUuid& key) const { return find(key); }
+
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, Keys.size()); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, Keys.size()); }
+	const_iterator cbegin() const { return begin(); }
+	const_iterator cend() const { return end(); }
+	const_iterator constBegin() const { return begin(); }
+	const_iterator constEnd() const { return end(); }
+
+	// Bytes in the map's own arrays, not counting anything the values allocate.
+	size_t GetMemoryUsage() const
+	{
+		return Keys.capacity() * sizeof(QUuid) + Values.capacity() * sizeof(ValueType) + Controls.capacity()
+			+ SlotEntries.capacity() * sizeof(uint32);
+	}
+
+private:
+	static constexpr size_t GROUP_SIZE = 16;
+	// Groups are kept at most 14/16 full, counting tombstones, so probes always reach an empty slot before long.
+	static constexpr size_t MAX_FULL_PER_GROUP = 14;
+	static constexpr size_t NO_SLOT = SIZE_MAX;
+	// Full slots hold the low 7 bits of their key's hash, so they never have the top bit set.
+	static constexpr uint8 EMPTY = 0x80;
+	static constexpr uint8 DELETED = 0xFE;
+
+	static uint64 HashKey(const QUuid& key)
+	{
+		// Random UUIDs are mostly random already, but the version and variant bits aren't, and other kinds of UUID
+		// are far from it.  This mixes both halves into every bit.
+		const uint64 high = (static_cast<uint64>(key.data1) << 32) | (static_cast<uint64>(key.data2) << 16) | key.data3;
+		uint64 low;
+		std::memcpy(&low, key.data4, sizeof(low));
+
+		uint64 hash = high ^ (low * 0x9E3779B97F4A7C15ull);
+		hash ^= hash >> 33;
+		hash *= 0xFF51AFD7ED558CCDull;
+		hash ^= hash >> 33;
+		hash *= 0xC4CEB9FE1A85EC53ull;
+		hash ^= hash >> 33;
+		return hash;
+	}
+
+	static uint8 ControlFor(uint64 hash) { return static_cast<uint8>(hash & 0x7F); }
+
+	// Bit i of the result is set if group[i] == byte.
+	static uint32 MatchByte(const uint8* group, uint8 byte)
+	{
+#if TB_UUID_MAP_SSE2
+		const __m128i controls = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+		return static_cast<uint32>(_mm_movemask_epi8(_mm_cmpeq_epi8(controls, _mm_set1_epi8(static_cast<char>(byte)))));
+#else
+		uint32 matches = 0;
+		for (size_t index = 0; index < GROUP_SIZE; ++index)
+		{
+			matches |= static_cast<uint32>(group[index] == byte) << index;
+		}
+		return matches;
+#endif
+	}
+
+	// Bit i of the result is set if group[i] is empty or deleted.
+	static uint32 MatchFree(const uint8* group)
+	{
+#if TB_UUID_MAP_SSE2
+		return static_cast<uint32>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+#else
+		uint32 matches = 0;
+		for (size_t index = 0; index < GROUP_SIZE; ++index)
+		{
+			matches |= static_cast<uint32>(group[index] >> 7) << index;
+		}
+		return matches;
+#endif
+	}
+
+	// Smallest power-of-two number of slots that keeps entryCount entries under the load limit.
+	static size_t SlotCountFor(size_t entryCount)
+	{
+		const size_t groupCount = (entryCount + MAX_FULL_PER_GROUP - 1) / MAX_FULL_PER_GROUP;
+		return std::bit_ceil(std::max<size_t>(groupCount, 1)) * GROUP_SIZE;
+	}
+
+	size_t FindSlot(const QUuid& key, uint64 hash) const
+	{
+		if (Controls.empty())
+		{
+			return NO_SLOT;
+		}
+
+		const uint8 control = ControlFor(hash);
+		const size_t groupMask = Controls.size() / GROUP_SIZE - 1;
+		size_t group = (hash >> 7) & groupMask;
+		// Triangular steps, which visit every group once when the group count is a power of two.
+		for (size_t probe = 0; probe <= groupMask; )
+		{
+			const uint8* groupControls = Controls.data() + group * GROUP_SIZE;
+			for (uint32 matches = MatchByte(groupControls, control); matches != 0; matches &= matches - 1)
+			{
+				const size_t slot = group * GROUP_SIZE + std::countr_zero(matches);
+				if (Keys[SlotEntries[slot]] == key)
+				{
+					return slot;
+				}
+			}
+			if (MatchByte(groupControls, EMPTY) != 0)
+			{
+				return NO_SLOT;
+			}
+			group = (group + ++probe) & groupMask;
+		}
+		return NO_SLOT;
+	}
+
+	size_t FindEntry(const QUuid& key) const
+	{
+		const size_t slot = FindSlot(key, HashKey(key));
+		return slot != NO_SLOT ? SlotEntries[slot] : Keys.size();
+	}
+
+	// The load limit leaves every table with free slots, so this always finds one.
+	size_t FindFreeSlot(uint64 hash) const
+	{
+		const size_t groupMask = Controls.size() / GROUP_SIZE - 1;
+		size_t group = (hash >> 7) & groupMask;
+		for (size_t probe = 0; ; )
+		{
+			const uint32 freeSlots = MatchFree(Controls.data() + group * GROUP_SIZE);
+			if (freeSlots != 0)
+			{
+				return group * GROUP_SIZE + std::countr_zero(freeSlots);
+			}
+			group = (group + ++probe) & groupMask;
+		}
+	}
+
+	void PlaceEntry(uint32 entry, uint64 hash)
+	{
+		const size_t slot = FindFreeSlot(hash);
+		if (Controls[slot] == DELETED)
+		{
+			Tombstones--;
+		}
+		Controls[slot] = ControlFor(hash);
+		SlotEntries[slot] = entry;
+	}
+
+	void Rehash(size_t slotCount)
+	{
+		Controls.assign(slotCount, EMPTY);
+		SlotEntries.assign(slotCount, 0);
+		Tombstones = 0;
+		for (uint32 entry = 0; entry < Keys.size(); ++entry)
+		{
+			PlaceEntry(entry, HashKey(Keys[entry]));
+		}
+	}
+
+	// For a key that isn't in the map yet.  Returns its entry index.
+	template<typename... ArgTypes>
+	uint32 AddEntry(const QUuid& key, uint64 hash, ArgTypes&&... args)
+	{
+		if (Keys.size() + Tombstones + 1 > static_cast<size_t>(capacity()))
+		{
+			// Clears out tombstones too, which can leave the table the same size if that's all it needed.
+			Rehash(SlotCountFor(Keys.size() + 1));
+		}
+
+		const uint32 entry = static_cast<uint32>(Keys.size());
+		Values.emplace_back(std::forward<ArgTypes>(args)...);
+		Keys.push_back(key);
+		PlaceEntry(entry, hash);
+		return entry;
+	}
+
+	std::vector<QUuid> Keys;
+	std::vector<ValueType> Values;
+	// One per slot: EMPTY, DELETED, or the control byte of the key in it.
+	std::vector<uint8> Controls;
+	// Index into Keys and Values of each full slot's entry.
+	std::vector<uint32> SlotEntries;
+	size_t Tombstones;
+};
\ No newline at end of file
@@ -0,0 +1,267 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (YearIndexCalendar.cpp) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "YearIndexCalendar.h"
+#include "Calendar.h"
+#include "CacheFile.h"
+#include "Logging.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+
+#include <algorithm>
+#include <numeric>
+
+// Days asked of the script per batch call while building.
+static constexpr int64 BUILD_CHUNK_DAYS = 1 << 18;
+static constexpr quint32 INDEX_FILE_MAGIC = 0x54425949;		// "TBYI"
+// Bump this whenever the file layout changes, so that old files are rebuilt instead of misread.
+static constexpr quint32 INDEX_FILE_VERSION = 1;
+
+TBYearIndexCalendar::TBYearIndexCalendar() :
+	BrokenDateLength(0),
+	MinYear(0),
+	MaxYear(0),
+	PeriodStarts(),
+	PeriodKeys(),
+	PeriodFirstValues()
+{}
+
+std::unique_ptr<TBYearIndexCalendar> TBYearIndexCalendar::Build(const TBCalendarSystem& calendar, int64 minYear, int64 maxYear)
+{
+	const int32 dateLength = calendar.GetBrokenDateLength();
+	if (dateLength < 2 || minYear > maxYear)
+	{
+		return nullptr;
+	}
+
+	// Calendars without a year zero skip from -1 to 1.
+	int64 followingYear = maxYear + 1;
+	if (!calendar.TryValidateBrokenDate(TBBrokenDate({ followingYear })).value_or(false))
+	{
+		followingYear++;
+	}
+	const TBScriptResult<TBDate> firstDay = calendar.TryCombineDate(TBBrokenDate({ minYear }));
+	const TBScriptResult<TBDate> endDay = calendar.TryCombineDate(TBBrokenDate({ followingYear }));
+	if (!firstDay || !endDay || endDay->GetDays() <= firstDay->GetDays())
+	{
+		TBLog::Warning("Could not find the days for years %0 to %1 in calendar '%2'.  No year index built.", minYear, maxYear, calendar.GetName());
+		return nullptr;
+	}
+
+	std::unique_ptr<TBYearIndexCalendar> index(new TBYearIndexCalendar());
+	index->BrokenDateLength = dateLength;
+	index->MinYear = minYear;
+	index->MaxYear = maxYear;
+
+	const int64 keyLength = dateLength - 1;
+	std::vector<TBDate> days;
+	std::vector<int64> brokenDates;
+	int64 previousLast = 0;
+	for (int64 chunkStart = firstDay->GetDays(); chunkStart < endDay->GetDays(); chunkStart += BUILD_CHUNK_DAYS)
+	{
+		days.resize(std::min(BUILD_CHUNK_DAYS, endDay->GetDays() - chunkStart));
+		std::iota(days.begin(), days.end(), chunkStart);
+		calendar.BreakDates(days, brokenDates);
+
+		for (size_t dayIndex = 0; dayIndex < days.size(); dayIndex++)
+		{
+			const int64 day = chunkStart + static_cast<int64>(dayIndex);
+			std::span<const int64> components(brokenDates.data() + dayIndex * dateLength, dateLength);
+			std::span<const int64> key = components.first(keyLength);
+			const int64 last = components.back();
+
+			if (components[0] < minYear || components[0] > maxYear)
+			{
+				TBLog::Warning("Calendar '%0' puts day %1 in year %2, outside of years %3 to %4.  No year index built.",
+					calendar.GetName(), day, components[0], minYear, maxYear);
+				return nullptr;
+			}
+
+			const bool samePeriod = !index->PeriodFirstValues.empty()
+				&& std::equal(key.begin(), key.end(), index->PeriodKeys.end() - keyLength);
+			if (samePeriod)
+			{
+				if (last != previousLast + 1)
+				{
+					TBLog::Warning("Calendar '%0' doesn't count its last date component up by one each day (day %1).  No year index built.",
+						calendar.GetName(), day);
+					return nullptr;
+				}
+			}
+			else
+			{
+				if (!index->PeriodFirstValues.empty()
+					&& !std::lexicographical_compare(index->PeriodKeys.end() - keyLength, index->PeriodKeys.end(), key.begin(), key.end()))
+				{
+					TBLog::Warning("Calendar '%0' has dates out of order around day %1.  No year index built.", calendar.GetName(), day);
+					return nullptr;
+				}
+				index->PeriodStarts.push_back(day);
+				index->PeriodKeys.insert(index->PeriodKeys.end(), key.begin(), key.end());
+				index->PeriodFirstValues.push_back(last);
+			}
+			previousLast = last;
+		}
+	}
+	index->PeriodStarts.push_back(endDay->GetDays());
+
+	return index;
+}
+
+std::unique_ptr<TBYearIndexCalendar> TBYearIndexCalendar::Load(const QString& filePath, const QByteArray& scriptHash, int64 minYear,
+	int64 maxYear, int32 brokenDateLength)
+{
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return nullptr;
+	}
+
+	QDataStream stream(&file);
+	quint32 magic = 0;
+	quint32 version = 0;
+	QByteArray fileScriptHash;
+	qint64 fileMinYear = 0;
+	qint64 fileMaxYear = 0;
+	qint32 fileDateLength = 0;
+	stream >> magic >> version;
+	if (magic != INDEX_FILE_MAGIC || version != INDEX_FILE_VERSION)
+	{
+		return nullptr;
+	}
+	stream >> fileScriptHash >> fileMinYear >> fileMaxYear >> fileDateLength;
+	if (stream.status() != QDataStream::Ok || fileScriptHash != scriptHash || fileMinYear != minYear || fileMaxYear != maxYear
+		|| fileDateLength != brokenDateLength || brokenDateLength < 2)
+	{
+		return nullptr;
+	}
+
+	std::unique_ptr<TBYearIndexCalendar> index(new TBYearIndexCalendar());
+	index->BrokenDateLength = brokenDateLength;
+	index->MinYear = minYear;
+	index->MaxYear = maxYear;
+	if (!ReadInt64Vector(stream, index->PeriodStarts) || !ReadInt64Vector(stream, index->PeriodKeys)
+		|| !ReadInt64Vector(stream, index->PeriodFirstValues))
+	{
+		return nullptr;
+	}
+
+	// Don't trust a file that doesn't hang together, even if it claims to be for this script.
+	const size_t periodCount = index->PeriodFirstValues.size();
+	if (periodCount == 0 || index->PeriodStarts.size() != periodCount + 1 || index->PeriodKeys.size() != periodCount * (brokenDateLength - 1)
+		|| !std::is_sorted(index->PeriodStarts.begin(), index->PeriodStarts.end()))
+	{
+		TBLog::Warning("Year index file (%0) is damaged.  Rebuilding it.", filePath);
+		return nullptr;
+	}
+
+	return index;
+}
+
+bool TBYearIndexCalendar::Save(const QString& filePath, const QByteArray& scriptHash) const
+{
+	// Written to the side and moved into place, so that a crash mid-write can't leave half an index behind.
+	QSaveFile file(filePath);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream << INDEX_FILE_MAGIC << INDEX_FILE_VERSION << scriptHash << static_cast<qint64>(MinYear) << static_cast<qint64>(MaxYear)
+		<< static_cast<qint32>(BrokenDateLength);
+	WriteInt64Vector(stream, PeriodStarts);
+	WriteInt64Vector(stream, PeriodKeys);
+	WriteInt64Vector(stream, PeriodFirstValues);
+
+	return stream.status() == QDataStream::Ok && file.commit();
+}
+
+int64 TBYearIndexCalendar::FindPeriod(std::span<const int64> key) const
+{
+	const int64 keyLength = BrokenDateLength - 1;
+	auto keyAt = [&](int64 period) { return PeriodKeys.begin() + period * keyLength; };
+
+	int64 low = 0;
+	int64 high = GetPeriodCount();
+	while (low < high)
+	{
+		const int64 middle = low + (high - low) / 2;
+		if (std::lexicographical_compare(keyAt(middle), keyAt(middle) + keyLength, key.begin(), key.end()))
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return (low < GetPeriodCount() && std::equal(key.begin(), key.end(), keyAt(low))) ? low : -1;
+}
+
+bool TBYearIndexCalendar::BreakDate(int64 day, std::span<int64> outComponents) const
+{
+	if (day < PeriodStarts.front() || day >= PeriodStarts.back())
+	{
+		return false;
+	}
+
+	const int64 period = std::upper_bound(PeriodStarts.begin(), PeriodStarts.end(), day) - PeriodStarts.begin() - 1;
+	const int64 keyLength = BrokenDateLength - 1;
+	std::copy_n(PeriodKeys.begin() + period * keyLength, keyLength, outComponents.begin());
+	outComponents[keyLength] = PeriodFirstValues[period] + (day - PeriodStarts[period]);
+	return true;
+}
+
+bool TBYearIndexCalendar::CombineDate(std::span<const int64> components, int64& outDay) const
+{
+	if (components.size() != static_cast<size_t>(BrokenDateLength))
+	{
+		return false;
+	}
+
+	const int64 period = FindPeriod(components.first(BrokenDateLength - 1));
+	if (period < 0)
+	{
+		return false;
+	}
+
+	const int64 offset = components.back() - PeriodFirstValues[period];
+	if (offset < 0 || offset >= PeriodStarts[period + 1] - PeriodStarts[period])
+	{
+		return false;
+	}
+
+	outDay = PeriodStarts[period] + offset;
+	return true;
+}
+
+bool TBYearIndexCalendar::ValidateBrokenDate(std::span<const int64> components, bool& outValid) const
+{
+	// Every complete date in an indexed year was seen while building, so one that isn't in the index doesn't exist.
+	// Partial dates and other years are up to the script.
+	if (components.size() != static_cast<size_t>(BrokenDateLength) || components[0] < MinYear || components[0] > MaxYear)
+	{
+		return false;
+	}
+
+	int64 day = 0;
+	outValid = CombineDate(components, day);
+	return true;
+}
\ No newline at end of file
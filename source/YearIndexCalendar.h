@@ -0,0 +1,76 @@
+/*
+	Copyright (c) 2023 Tyler Pixley, all rights reserved.
+
+	This file (YearIndexCalendar.h) is part of TimelineBuilder.
+
+	TimelineBuilder is free software: you can redistribute it and/or modify it under
+	the terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later version.
+
+	TimelineBuilder is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+	PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with
+	TimelineBuilder. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+#include "NativeCalendar.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+#include <memory>
+#include <span>
+#include <vector>
+
+class TBCalendarSystem;
+
+/*
+	For calendars that don't repeat (observation-based ones, say), the day each month begins over a fixed range of
+	years.  Broken dates are split into periods that share every component but the last, with the last one counting
+	up by one each day: a period is a month of a year/month/day calendar, or a whole year of a year/day-of-year one.
+	Breaking and combining dates in range are then binary searches over the periods.
+
+	Building means breaking every day in the range through the script, so indexes are saved to a file, tagged with
+	a hash of the script they came from.
+*/
+class TBYearIndexCalendar : public TBNativeDateBackend
+{
+public:
+	// Breaks every day of years minYear through maxYear with the calendar's batch calls.  Returns null if the script's
+	// dates don't split into periods like that.
+	static std::unique_ptr<TBYearIndexCalendar> Build(const TBCalendarSystem& calendar, int64 minYear, int64 maxYear);
+	// Returns null if there's no index at filePath, or it was built from a different script or for a different range.
+	static std::unique_ptr<TBYearIndexCalendar> Load(const QString& filePath, const QByteArray& scriptHash, int64 minYear, int64 maxYear,
+		int32 brokenDateLength);
+	bool Save(const QString& filePath, const QByteArray& scriptHash) const;
+
+	virtual int32 GetBrokenDateLength() const override { return BrokenDateLength; }
+	virtual bool BreakDate(int64 day, std::span<int64> outComponents) const override;
+	virtual bool CombineDate(std::span<const int64> components, int64& outDay) const override;
+	virtual bool ValidateBrokenDate(std::span<const int64> components, bool& outValid) const override;
+
+	int64 GetPeriodCount() const { return static_cast<int64>(PeriodFirstValues.size()); }
+
+private:
+	TBYearIndexCalendar();
+
+	// Index of the period whose leading components match key, or -1.
+	int64 FindPeriod(std::span<const int64> key) const;
+
+	int32 BrokenDateLength;
+	int64 MinYear;
+	int64 MaxYear;
+
+	// Period p covers days PeriodStarts[p] up to PeriodStarts[p + 1].  The last entry is the day after the range.
+	std::vector<int64> PeriodStarts;
+	// Every component but the last, BrokenDateLength - 1 per period.  Periods are in day order, which has to also be
+	// the order of their keys.
+	std::vector<int64> PeriodKeys;
+	// The last component's value on each period's first day.
+	std::vector<int64> PeriodFirstValues;
+};
\ No newline at end of file
@@ -53,6 +53,11 @@
 #include "Logging.h"
 #include "Settings.h"
 #include "TestSuite.h"
+#include "CalendarProcessPool.h"
+#include "CalendarExecutor.h"
+#include "CalendarRegistry.h"
+#include "ScriptWatchdog.h"
+#include "ScriptProfiler.h"
 
 #include <QtWidgets/QApplication>
 
@@ -66,6 +71,17 @@ namespace py = pybind11;
 int cleanupAfter(int exitCode)
 {
 	// Any pre-exit logic we want to run goes here.
+	// The calendar executor goes first, since its tasks may still be using settings and logging.
+	TBCalendarExecutor::Cleanup();
+	TBCalendarRegistry::Cleanup();
+	// After the executor, so that a task stuck in a script can still be interrupted while the executor waits for it.
+	TBScriptWatchdog::Cleanup();
+	if constexpr (TBScriptProfiler::IsEnabled())
+	{
+		// Every script call has finished by now, so this is the whole run.
+		TBScriptProfiler::LogStats();
+		TBScriptProfiler::WriteStatsJson(TBUserFiles::GetBasePath().filePath("logs/ScriptProfile.json"));
+	}
 	TBSettings::Cleanup();
 	TBLog::Cleanup();
 
@@ -94,11 +110,18 @@ int main(int argc, char *argv[])
 	// This needs to be done after Qt app initialization so that we can carry forward some app info
 	TBUserFiles::Initialize(app);
 
+	// Calendar worker processes are started from this same executable.  They only need Python, and mustn't touch the
+	// main process's log or settings files, which it has open.
+	const bool isCalendarWorker = TBCalendarProcessPool::IsWorkerRequested(app);
+
 	// Initialize logging
-	TBLog::Initialize();
+	TBLog::Initialize(isCalendarWorker);
 
 	// Initialize settings
-	TBSettings::Initialize();
+	if (!isCalendarWorker)
+	{
+		TBSettings::Initialize();
+	}
 
 	// Do some Python initialization
 	py::scoped_interpreter pythonInterpreter;
@@ -115,6 +138,23 @@ int main(int argc, char *argv[])
 		return cleanupAfter(-1);
 	}
 
+	// Calendar workers never get as far as a window.
+	int workerExitCode = 0;
+	if (TBCalendarProcessPool::RunWorkerIfRequested(app, workerExitCode))
+	{
+		TBLog::Cleanup();
+		return workerExitCode;
+	}
+
+	// Interrupts calendar script calls that run past their time budget.
+	TBScriptWatchdog::Initialize();
+
+	// Calendar work that shouldn't block the GUI thread runs here.
+	TBCalendarExecutor::Initialize();
+
+	// Only reads calendar descriptors.  Scripts are imported when something first uses their calendar.
+	TBCalendarRegistry::Initialize("scripts");
+
 	{
 		// Scoping here so that the test suite doesn't exist for the entire runtime of the program.
 		TBTestSuite tests(app);
@@ -125,6 +165,10 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	// Let the calendar executor run scripts.  From here on, anything on this thread that calls into Python directly has
+	// to take the GIL first (TBCalendarSystem does this on its own).
+	py::gil_scoped_release releasePythonForCalendars;
+
 	TimelineBuilder mainWindow;
 	mainWindow.show();
 	try